@@ -0,0 +1,205 @@
+#ifndef __BLIT_HPP
+#define __BLIT_HPP
+
+#include "idisplay.hpp"
+#include "colourconvert.hpp"
+#include <stdint.h>
+#include <string.h>
+
+///////////////////////////////////////////////////
+//
+// Span blitters for the display buffers, compiled for
+// each destination format, source bit depth and write
+// mode. Drivers pick an instance once per write so
+// the pixel loops have no mode or format tests.
+// Spans are already clipped by the caller.
+//
+// Packed destinations are BPP bytes per pixel, which
+// is RGB332 or the 3 nibble RGB444 of the PCF8833.
+// Page destinations are SDD1306 pages where each
+// byte holds 8 rows of one column
+//
+///////////////////////////////////////////////////
+
+// Pixels converted at a time for exclusive 32 bit spans
+#define BLIT_CHUNK 64
+
+class Blit{
+public:
+  // Combine new pixels with the display. set selects foreground pixels
+  // and span selects every pixel written, as bit masks of the same width
+  // as the values. Only the MODE case is compiled in
+  template <IDisplay::enMode MODE, typename T>
+  static inline T combine(T d, T set, T span, T fg, T bg)
+  {
+    if (MODE == IDisplay::overwrite) return (T)((d & ~span) | (fg & set) | (bg & span & ~set)) ;
+    if (MODE == IDisplay::overlay) return (T)((d & ~set) | (fg & set)) ;
+    return (T)(d ^ (fg & set)) ; // exclusive
+  }
+
+  // Up to 8 bits from bit pos of a 1 bit row, least significant first
+  static inline uint8_t bits(const uint8_t *pSrc, int pos, int n)
+  {
+    const uint8_t *p = pSrc + (pos / 8) ;
+    unsigned int shift = pos % 8 ;
+    unsigned int v = p[0] >> shift ;
+
+    // Only read the next byte when the bits carry into it
+    if (shift + n > 8) v |= p[1] << (8 - shift) ;
+    return (uint8_t)(v & ((1u << n) - 1)) ;
+  }
+
+  // 1 bit source pixels one at a time onto packed pixels
+  template <int BPP, IDisplay::enMode MODE>
+  static void pixels1bpp(const uint8_t *pSrc, int srcx, uint8_t *pDst, int nPixels,
+			 const uint8_t *pFG, const uint8_t *pBG)
+  {
+    uint8_t set = 0 ;
+
+    for (int i=0; i < nPixels; i++, srcx++, pDst += BPP){
+      set = (uint8_t)(0 - ((pSrc[srcx / 8] >> (srcx % 8)) & 1)) ;
+      for (int b=0; b < BPP; b++) pDst[b] = combine<MODE, uint8_t>(pDst[b], set, 0xFF, pFG[b], pBG[b]) ;
+    }
+  }
+
+  // 1 bit source span from bit srcx onto packed pixels. Whole source bytes
+  // expand through 256 entry tables of 8 pixels, one with the foreground and
+  // background colours and one with 0xFF for set pixels, and are combined a
+  // word at a time
+  template <int BPP, IDisplay::enMode MODE>
+  static void span1bpp(const uint8_t *pSrc, int srcx, uint8_t *pDst, int nPixels,
+		       const uint8_t *pFG, const uint8_t *pBG,
+		       const uint8_t (*pLUT)[24], const uint8_t (*pMask)[24])
+  {
+    int head = (8 - (srcx % 8)) % 8 ;
+    int nBytes = 0 ;
+    const uint8_t *pBits = NULL ;
+    uint32_t d, e, m ;
+
+    // Pixels up to the first whole source byte
+    if (head > nPixels) head = nPixels ;
+    pixels1bpp<BPP, MODE>(pSrc, srcx, pDst, head, pFG, pBG) ;
+    srcx += head ;
+    pDst += head * BPP ;
+    nPixels -= head ;
+
+    nBytes = nPixels / 8 ;
+    pBits = pSrc + (srcx / 8) ;
+    for (int i=0; i < nBytes; i++, pDst += 8 * BPP){
+      if (MODE == IDisplay::overwrite){
+	memcpy(pDst, pLUT[pBits[i]], 8 * BPP) ;
+	continue ;
+      }
+      for (int w=0; w < 8 * BPP; w += 4){
+	memcpy(&d, pDst + w, 4) ;
+	memcpy(&e, pLUT[pBits[i]] + w, 4) ;
+	memcpy(&m, pMask[pBits[i]] + w, 4) ;
+	d = combine<MODE, uint32_t>(d, m, 0xFFFFFFFF, e, e) ;
+	memcpy(pDst + w, &d, 4) ;
+      }
+    }
+
+    // Remaining pixels of a partial source byte
+    pixels1bpp<BPP, MODE>(pSrc, srcx + (nBytes * 8), pDst, nPixels % 8, pFG, pBG) ;
+  }
+
+  // 32 bit RGBA span onto packed pixels. BPP 1 is RGB332 and 3 is RGB444,
+  // which is ordered dithered when pDither is set. Overlay blends with the
+  // alpha channel and exclusive xors the converted pixels
+  template <int BPP, IDisplay::enMode MODE>
+  static void span32bpp(const uint8_t *pSrc, uint8_t *pDst, int nPixels, const uint8_t *pDither)
+  {
+    uint8_t row[BLIT_CHUNK * 3] ;
+    int n = 0 ;
+
+    if (MODE == IDisplay::overlay){
+      if (BPP == 1) ColourConvert::blendRGBAToRGB332(pSrc, pDst, nPixels) ;
+      else ColourConvert::blendRGBAToRGB444(pSrc, pDst, nPixels) ;
+      return ;
+    }
+
+    if (MODE == IDisplay::overwrite){
+      if (BPP == 1) ColourConvert::rgbaToRGB332(pSrc, pDst, nPixels) ;
+      else ColourConvert::rgbaToRGB444(pSrc, pDst, nPixels, pDither) ;
+      return ;
+    }
+
+    // Chunks are a multiple of 4 pixels so the dither pattern stays in step
+    for (; nPixels > 0; nPixels -= n, pSrc += n * 4, pDst += n * BPP){
+      n = nPixels < BLIT_CHUNK?nPixels:BLIT_CHUNK ;
+      if (BPP == 1) ColourConvert::rgbaToRGB332(pSrc, row, n) ;
+      else ColourConvert::rgbaToRGB444(pSrc, row, n, pDither) ;
+      for (int i=0; i < n * BPP; i++) pDst[i] ^= row[i] ;
+    }
+  }
+
+  // 1 bit source span along a row of pages. pDst is the first page byte
+  // and bit the row within the page
+  template <IDisplay::enMode MODE>
+  static void spanToPage(const uint8_t *pSrc, int srcx, uint8_t *pDst, int nPixels, uint8_t bit)
+  {
+    int head = (8 - (srcx % 8)) % 8 ;
+    int nBytes = 0 ;
+    uint8_t set = 0, v = 0 ;
+
+    if (head > nPixels) head = nPixels ;
+    for (int i=0; i < head; i++, srcx++){
+      set = (uint8_t)(0 - ((pSrc[srcx / 8] >> (srcx % 8)) & 1)) ;
+      pDst[i] = combine<MODE, uint8_t>(pDst[i], set & bit, bit, 0xFF, 0x00) ;
+    }
+    pDst += head ;
+    nPixels -= head ;
+
+    // Whole source bytes with fixed shifts
+    nBytes = nPixels / 8 ;
+    for (int i=0; i < nBytes; i++, srcx += 8, pDst += 8){
+      v = pSrc[srcx / 8] ;
+      for (int b=0; b < 8; b++){
+	set = (uint8_t)(0 - ((v >> b) & 1)) ;
+	pDst[b] = combine<MODE, uint8_t>(pDst[b], set & bit, bit, 0xFF, 0x00) ;
+      }
+    }
+
+    for (int i=0; i < nPixels % 8; i++, srcx++){
+      set = (uint8_t)(0 - ((pSrc[srcx / 8] >> (srcx % 8)) & 1)) ;
+      pDst[i] = combine<MODE, uint8_t>(pDst[i], set & bit, bit, 0xFF, 0x00) ;
+    }
+  }
+
+  // 1 bit source span down a column of pages from row py, for rotated
+  // displays. Source bits are in the same order as page bits so each page
+  // byte takes up to 8 pixels at once. pDst is the column in the first
+  // page and pageStride the bytes between pages
+  template <IDisplay::enMode MODE>
+  static void spanToColumn(const uint8_t *pSrc, int srcx, uint8_t *pDst, int py, int nPixels,
+			   unsigned int pageStride)
+  {
+    int shift = py % 8, n = 0 ;
+    uint8_t span = 0 ;
+
+    pDst += (py / 8) * pageStride ;
+    for (; nPixels > 0; nPixels -= n, srcx += n, shift = 0, pDst += pageStride){
+      n = 8 - shift ;
+      if (n > nPixels) n = nPixels ;
+      span = (uint8_t)(((1 << n) - 1) << shift) ;
+      *pDst = combine<MODE, uint8_t>(*pDst, (uint8_t)(bits(pSrc, srcx, n) << shift), span, 0xFF, 0x00) ;
+    }
+  }
+
+  // Up to 32 bits down a column of pages from row py, least significant
+  // bit first, such as a glyph column. Every bit is in the span so
+  // overwrite clears the unset rows
+  template <IDisplay::enMode MODE>
+  static void bitsToColumn(uint32_t v, uint8_t *pDst, int py, int n, unsigned int pageStride)
+  {
+    uint64_t span = (((uint64_t)1 << n) - 1) << (py % 8) ;
+    uint64_t set = ((uint64_t)v << (py % 8)) & span ;
+
+    pDst += (py / 8) * pageStride ;
+    for (; span; span >>= 8, set >>= 8, pDst += pageStride){
+      *pDst = combine<MODE, uint8_t>(*pDst, (uint8_t)set, (uint8_t)span, 0xFF, 0x00) ;
+    }
+  }
+};
+
+#endif // __BLIT_HPP
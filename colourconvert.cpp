@@ -0,0 +1,469 @@
+#include "colourconvert.hpp"
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define COLOUR_CONVERT_NEON
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define COLOUR_CONVERT_SSSE3
+#endif
+
+const uint8_t ColourConvert::s_lut332[20] = {
+  0, 2, 4, 6, 9, 11, 13, 15, // red
+  0, 2, 4, 6, 9, 11, 13, 15, // green
+  0, 5, 10, 15 // blue
+};
+
+const uint8_t ColourConvert::s_bayer4[4][4] = {
+  { 0,  8,  2, 10},
+  {12,  4, 14,  6},
+  { 3, 11,  1,  9},
+  {15,  7, 13,  5}
+};
+
+void ColourConvert::ditherPattern(int x, int y, uint8_t *pPattern)
+{
+  for (int i=0; i < 4; i++){
+    pPattern[i] = s_bayer4[y & 3][(x + i) & 3] ;
+  }
+}
+
+void ColourConvert::rgbaToRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels, const uint8_t *pDither)
+{
+  uint8_t pattern[4] = {0, 0, 0, 0} ;
+  uint32_t i = 0 ;
+  int val = 0, d = 0 ;
+
+  if (pDither) memcpy(pattern, pDither, 4) ;
+
+  // Vector loops process 16 pixels at a time. The dither pattern
+  // repeats every 4 pixels so lines up with each block
+#if defined(COLOUR_CONVERT_NEON)
+  uint8_t dither16[16] ;
+  for (int k=0; k < 16; k++) dither16[k] = pattern[k & 3] ;
+  uint8x16_t vdither = vld1q_u8(dither16) ;
+  uint8x16x4_t in ;
+  uint8x16x3_t out ;
+
+  for (; i + 16 <= nPixels; i += 16){
+    // Deinterleave into R, G, B and A registers and drop A on the store
+    in = vld4q_u8(pSrc + (i*4)) ;
+    out.val[0] = vshrq_n_u8(vqaddq_u8(in.val[0], vdither), 4) ;
+    out.val[1] = vshrq_n_u8(vqaddq_u8(in.val[1], vdither), 4) ;
+    out.val[2] = vshrq_n_u8(vqaddq_u8(in.val[2], vdither), 4) ;
+    vst3q_u8(pDst + (i*3), out) ;
+  }
+#elif defined(COLOUR_CONVERT_SSSE3)
+  const __m128i vdither = _mm_setr_epi8(pattern[0], pattern[0], pattern[0], 0,
+					pattern[1], pattern[1], pattern[1], 0,
+					pattern[2], pattern[2], pattern[2], 0,
+					pattern[3], pattern[3], pattern[3], 0) ;
+  const __m128i vmask = _mm_set1_epi8(0x0F) ;
+  // Pack 4 RGBA pixels into 12 bytes of RGB, zero the top 4 bytes
+  const __m128i vpack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1) ;
+  __m128i v[4] ;
+
+  for (; i + 16 <= nPixels; i += 16){
+    for (int k=0; k < 4; k++){
+      v[k] = _mm_loadu_si128((const __m128i*)(pSrc + (i*4) + (k*16))) ;
+      v[k] = _mm_and_si128(_mm_srli_epi16(_mm_adds_epu8(v[k], vdither), 4), vmask) ;
+      v[k] = _mm_shuffle_epi8(v[k], vpack) ;
+    }
+    // Join the 12 byte blocks into 3 full registers
+    _mm_storeu_si128((__m128i*)(pDst + (i*3)), _mm_or_si128(v[0], _mm_slli_si128(v[1], 12))) ;
+    _mm_storeu_si128((__m128i*)(pDst + (i*3) + 16), _mm_or_si128(_mm_srli_si128(v[1], 4), _mm_slli_si128(v[2], 8))) ;
+    _mm_storeu_si128((__m128i*)(pDst + (i*3) + 32), _mm_or_si128(_mm_srli_si128(v[2], 8), _mm_slli_si128(v[3], 4))) ;
+  }
+#endif
+
+  if (!pDither){
+    for (; i < nPixels; i++){
+      pDst[i*3] = pSrc[i*4] >> 4 ;
+      pDst[(i*3)+1] = pSrc[(i*4)+1] >> 4 ;
+      pDst[(i*3)+2] = pSrc[(i*4)+2] >> 4 ;
+    }
+    return ;
+  }
+
+  for (; i < nPixels; i++){
+    d = pattern[i & 3] ;
+    val = pSrc[i*4] + d ;
+    pDst[i*3] = (val > 0xFF?0xFF:val) >> 4 ;
+    val = pSrc[(i*4)+1] + d ;
+    pDst[(i*3)+1] = (val > 0xFF?0xFF:val) >> 4 ;
+    val = pSrc[(i*4)+2] + d ;
+    pDst[(i*3)+2] = (val > 0xFF?0xFF:val) >> 4 ;
+  }
+}
+
+// Blend one RGBA pixel onto an RGB444 pixel. 4 bit destination
+// channels are scaled to 8 bits by multiplying by 17
+static inline void blendPixel444(const uint8_t *pSrc, uint8_t *pDst)
+{
+  uint8_t alpha = pSrc[3] ;
+
+  if (alpha == 0) return ;
+  if (alpha == 0xFF){
+    pDst[0] = pSrc[0] >> 4 ;
+    pDst[1] = pSrc[1] >> 4 ;
+    pDst[2] = pSrc[2] >> 4 ;
+    return ;
+  }
+  pDst[0] = ColourConvert::blend8(pSrc[0], pDst[0] * 17, alpha) >> 4 ;
+  pDst[1] = ColourConvert::blend8(pSrc[1], pDst[1] * 17, alpha) >> 4 ;
+  pDst[2] = ColourConvert::blend8(pSrc[2], pDst[2] * 17, alpha) >> 4 ;
+}
+
+void ColourConvert::blendRGBAToRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels)
+{
+  uint32_t i = 0 ;
+
+  // Blocks of 16 pixels are checked for fully transparent or opaque
+  // alpha before blending
+#if defined(COLOUR_CONVERT_NEON)
+  uint8x16x4_t in ;
+  uint8x16x3_t out ;
+  uint8x16_t vdst, vinv ;
+  uint16x8_t lo, hi ;
+  const uint16x8_t vround = vdupq_n_u16(128) ;
+  uint64x2_t vall ;
+
+  for (; i + 16 <= nPixels; i += 16){
+    in = vld4q_u8(pSrc + (i*4)) ;
+    vall = vreinterpretq_u64_u8(in.val[3]) ;
+    if ((vgetq_lane_u64(vall, 0) | vgetq_lane_u64(vall, 1)) == 0) continue ; // transparent
+    if ((vgetq_lane_u64(vall, 0) & vgetq_lane_u64(vall, 1)) == 0xFFFFFFFFFFFFFFFFULL){
+      rgbaToRGB444(pSrc + (i*4), pDst + (i*3), 16) ; // opaque
+      continue ;
+    }
+    out = vld3q_u8(pDst + (i*3)) ;
+    vinv = vmvnq_u8(in.val[3]) ;
+    for (int c=0; c < 3; c++){
+      // Scale 4 bit destination to 8 bits, blend and round the divide by 255
+      vdst = vorrq_u8(vshlq_n_u8(out.val[c], 4), out.val[c]) ;
+      lo = vmull_u8(vget_low_u8(in.val[c]), vget_low_u8(in.val[3])) ;
+      lo = vmlal_u8(lo, vget_low_u8(vdst), vget_low_u8(vinv)) ;
+      hi = vmull_u8(vget_high_u8(in.val[c]), vget_high_u8(in.val[3])) ;
+      hi = vmlal_u8(hi, vget_high_u8(vdst), vget_high_u8(vinv)) ;
+      lo = vaddq_u16(lo, vround) ;
+      hi = vaddq_u16(hi, vround) ;
+      lo = vaddq_u16(lo, vshrq_n_u16(lo, 8)) ;
+      hi = vaddq_u16(hi, vshrq_n_u16(hi, 8)) ;
+      out.val[c] = vshrq_n_u8(vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)), 4) ;
+    }
+    vst3q_u8(pDst + (i*3), out) ;
+  }
+#elif defined(COLOUR_CONVERT_SSSE3)
+  const __m128i vzero = _mm_setzero_si128() ;
+  const __m128i vround = _mm_set1_epi16(128) ;
+  const __m128i v255 = _mm_set1_epi16(255) ;
+  // Spread 12 bytes of RGB over 4 byte pixels and back again
+  const __m128i vspread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1) ;
+  const __m128i vpack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1) ;
+  // Copy each alpha byte to all channels of the pixel
+  const __m128i valpha = _mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15) ;
+  const __m128i vamask = _mm_set1_epi32(0xFF000000) ;
+  __m128i vsrc[4], vdst, va, vlo, vhi, valo, vahi ;
+  int trans = 0, opaque = 0, tail = 0 ;
+
+  for (; i + 16 <= nPixels; i += 16){
+    trans = opaque = 0 ;
+    for (int k=0; k < 4; k++){
+      vsrc[k] = _mm_loadu_si128((const __m128i*)(pSrc + (i*4) + (k*16))) ;
+      va = _mm_and_si128(vsrc[k], vamask) ;
+      trans += _mm_movemask_epi8(_mm_cmpeq_epi8(va, vzero)) == 0xFFFF ;
+      opaque += _mm_movemask_epi8(_mm_cmpeq_epi8(va, vamask)) == 0xFFFF ;
+    }
+    if (trans == 4) continue ;
+    if (opaque == 4){
+      rgbaToRGB444(pSrc + (i*4), pDst + (i*3), 16) ;
+      continue ;
+    }
+    for (int k=0; k < 4; k++){
+      uint8_t *pOut = pDst + (i*3) + (k*12) ;
+      // Load 12 destination bytes without reading past the span
+      memcpy(&tail, pOut + 8, 4) ;
+      vdst = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)pOut), _mm_cvtsi32_si128(tail)) ;
+      vdst = _mm_shuffle_epi8(vdst, vspread) ;
+      vdst = _mm_or_si128(_mm_slli_epi16(vdst, 4), vdst) ; // 4 to 8 bits. Values are below 16 so no carry
+      va = _mm_shuffle_epi8(vsrc[k], valpha) ;
+
+      valo = _mm_unpacklo_epi8(va, vzero) ;
+      vahi = _mm_unpackhi_epi8(va, vzero) ;
+      vlo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(vsrc[k], vzero), valo),
+			  _mm_mullo_epi16(_mm_unpacklo_epi8(vdst, vzero), _mm_sub_epi16(v255, valo))) ;
+      vhi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(vsrc[k], vzero), vahi),
+			  _mm_mullo_epi16(_mm_unpackhi_epi8(vdst, vzero), _mm_sub_epi16(v255, vahi))) ;
+      vlo = _mm_add_epi16(vlo, vround) ;
+      vhi = _mm_add_epi16(vhi, vround) ;
+      vlo = _mm_srli_epi16(_mm_add_epi16(vlo, _mm_srli_epi16(vlo, 8)), 12) ; // /255 then to 4 bits
+      vhi = _mm_srli_epi16(_mm_add_epi16(vhi, _mm_srli_epi16(vhi, 8)), 12) ;
+      vdst = _mm_shuffle_epi8(_mm_packus_epi16(vlo, vhi), vpack) ;
+
+      _mm_storel_epi64((__m128i*)pOut, vdst) ;
+      tail = _mm_cvtsi128_si32(_mm_srli_si128(vdst, 8)) ;
+      memcpy(pOut + 8, &tail, 4) ;
+    }
+  }
+#endif
+
+  for (; i < nPixels; i++){
+    blendPixel444(pSrc + (i*4), pDst + (i*3)) ;
+  }
+}
+
+void ColourConvert::blendRGBAToRGB332(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels)
+{
+  uint8_t alpha, c, red, green, blue ;
+
+  for (uint32_t i=0; i < nPixels; i++, pSrc += 4){
+    alpha = pSrc[3] ;
+    if (alpha == 0) continue ;
+    if (alpha == 0xFF){
+      rgbaToRGB332(pSrc, pDst + i, 1) ;
+      continue ;
+    }
+    // Expand the destination through the colour table to blend at 8 bits
+    c = pDst[i] ;
+    red = blend8(pSrc[0], s_lut332[c >> 5] * 17, alpha) ;
+    green = blend8(pSrc[1], s_lut332[8 + ((c >> 2) & 0x07)] * 17, alpha) ;
+    blue = blend8(pSrc[2], s_lut332[16 + (c & 0x03)] * 17, alpha) ;
+    pDst[i] = (red & 0xE0) | ((green >> 3) & 0x1C) | (blue >> 6) ;
+  }
+}
+
+void ColourConvert::blendCoverageRGB444(const uint8_t *pCoverage, const uint8_t *pColour, uint8_t *pDst, uint32_t nPixels)
+{
+  uint32_t i = 0 ;
+  uint8_t alpha = 0 ;
+
+#if defined(COLOUR_CONVERT_NEON)
+  uint8x16x3_t out ;
+  uint8x16_t va, vinv, vdst, vfull[3] ;
+  uint8x8_t vcol[3] ;
+  uint16x8_t lo, hi ;
+  const uint16x8_t vround = vdupq_n_u16(128) ;
+  uint64x2_t vall ;
+
+  for (int c=0; c < 3; c++){
+    vcol[c] = vdup_n_u8(pColour[c]) ;
+    vfull[c] = vdupq_n_u8(pColour[c] >> 4) ;
+  }
+
+  for (; i + 16 <= nPixels; i += 16){
+    va = vld1q_u8(pCoverage + i) ;
+    vall = vreinterpretq_u64_u8(va) ;
+    if ((vgetq_lane_u64(vall, 0) | vgetq_lane_u64(vall, 1)) == 0) continue ; // no coverage
+    if ((vgetq_lane_u64(vall, 0) & vgetq_lane_u64(vall, 1)) == 0xFFFFFFFFFFFFFFFFULL){
+      out.val[0] = vfull[0] ;
+      out.val[1] = vfull[1] ;
+      out.val[2] = vfull[2] ;
+      vst3q_u8(pDst + (i*3), out) ;
+      continue ;
+    }
+    out = vld3q_u8(pDst + (i*3)) ;
+    vinv = vmvnq_u8(va) ;
+    for (int c=0; c < 3; c++){
+      // As blendRGBAToRGB444 with the colour as the source
+      vdst = vorrq_u8(vshlq_n_u8(out.val[c], 4), out.val[c]) ;
+      lo = vmull_u8(vcol[c], vget_low_u8(va)) ;
+      lo = vmlal_u8(lo, vget_low_u8(vdst), vget_low_u8(vinv)) ;
+      hi = vmull_u8(vcol[c], vget_high_u8(va)) ;
+      hi = vmlal_u8(hi, vget_high_u8(vdst), vget_high_u8(vinv)) ;
+      lo = vaddq_u16(lo, vround) ;
+      hi = vaddq_u16(hi, vround) ;
+      lo = vaddq_u16(lo, vshrq_n_u16(lo, 8)) ;
+      hi = vaddq_u16(hi, vshrq_n_u16(hi, 8)) ;
+      out.val[c] = vshrq_n_u8(vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)), 4) ;
+    }
+    vst3q_u8(pDst + (i*3), out) ;
+  }
+#elif defined(COLOUR_CONVERT_SSSE3)
+  const __m128i vzero = _mm_setzero_si128() ;
+  const __m128i vround = _mm_set1_epi16(128) ;
+  const __m128i v255 = _mm_set1_epi16(255) ;
+  const __m128i vones = _mm_set1_epi8(-1) ;
+  // 16 pixels are 48 destination bytes in 3 blocks. Spread the coverage
+  // of each pixel over its 3 channel bytes in each block
+  const __m128i vspread[3] = {
+    _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5),
+    _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10),
+    _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15)
+  } ;
+  uint8_t colour48[48], full48[48] ;
+  __m128i vcol[3], vfull[3], va, vac, vdst, vlo, vhi, valo, vahi ;
+
+  // Glyph rows are often narrower than a block so only set up for spans
+  // which use it
+  if (nPixels >= 16){
+    for (int k=0; k < 48; k++){
+      colour48[k] = pColour[k % 3] ;
+      full48[k] = pColour[k % 3] >> 4 ;
+    }
+    for (int k=0; k < 3; k++){
+      vcol[k] = _mm_loadu_si128((const __m128i*)(colour48 + (k*16))) ;
+      vfull[k] = _mm_loadu_si128((const __m128i*)(full48 + (k*16))) ;
+    }
+  }
+
+  for (; i + 16 <= nPixels; i += 16){
+    va = _mm_loadu_si128((const __m128i*)(pCoverage + i)) ;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vzero)) == 0xFFFF) continue ; // no coverage
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vones)) == 0xFFFF){
+      for (int k=0; k < 3; k++) _mm_storeu_si128((__m128i*)(pDst + (i*3) + (k*16)), vfull[k]) ;
+      continue ;
+    }
+    for (int k=0; k < 3; k++){
+      uint8_t *pOut = pDst + (i*3) + (k*16) ;
+      vdst = _mm_loadu_si128((const __m128i*)pOut) ;
+      vdst = _mm_or_si128(_mm_slli_epi16(vdst, 4), vdst) ; // 4 to 8 bits. Values are below 16 so no carry
+      vac = _mm_shuffle_epi8(va, vspread[k]) ;
+
+      valo = _mm_unpacklo_epi8(vac, vzero) ;
+      vahi = _mm_unpackhi_epi8(vac, vzero) ;
+      vlo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(vcol[k], vzero), valo),
+			  _mm_mullo_epi16(_mm_unpacklo_epi8(vdst, vzero), _mm_sub_epi16(v255, valo))) ;
+      vhi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(vcol[k], vzero), vahi),
+			  _mm_mullo_epi16(_mm_unpackhi_epi8(vdst, vzero), _mm_sub_epi16(v255, vahi))) ;
+      vlo = _mm_add_epi16(vlo, vround) ;
+      vhi = _mm_add_epi16(vhi, vround) ;
+      vlo = _mm_srli_epi16(_mm_add_epi16(vlo, _mm_srli_epi16(vlo, 8)), 12) ; // /255 then to 4 bits
+      vhi = _mm_srli_epi16(_mm_add_epi16(vhi, _mm_srli_epi16(vhi, 8)), 12) ;
+      _mm_storeu_si128((__m128i*)pOut, _mm_packus_epi16(vlo, vhi)) ;
+    }
+  }
+#endif
+
+  for (; i < nPixels; i++){
+    alpha = pCoverage[i] ;
+    if (alpha == 0) continue ;
+    for (int c=0; c < 3; c++){
+      pDst[(i*3) + c] = alpha == 0xFF?pColour[c] >> 4:blend8(pColour[c], pDst[(i*3) + c] * 17, alpha) >> 4 ;
+    }
+  }
+}
+
+void ColourConvert::blendCoverageRGB332(const uint8_t *pCoverage, const uint8_t *pColour, uint8_t *pDst, uint32_t nPixels)
+{
+  uint8_t alpha, c, red, green, blue ;
+
+  for (uint32_t i=0; i < nPixels; i++){
+    alpha = pCoverage[i] ;
+    if (alpha == 0) continue ;
+    // Expand the destination through the colour table to blend at 8 bits
+    c = pDst[i] ;
+    red = blend8(pColour[0], s_lut332[c >> 5] * 17, alpha) ;
+    green = blend8(pColour[1], s_lut332[8 + ((c >> 2) & 0x07)] * 17, alpha) ;
+    blue = blend8(pColour[2], s_lut332[16 + (c & 0x03)] * 17, alpha) ;
+    pDst[i] = (red & 0xE0) | ((green >> 3) & 0x1C) | (blue >> 6) ;
+  }
+}
+
+void ColourConvert::rgbToRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels, const uint8_t *pDither)
+{
+  uint8_t pattern[4] = {0, 0, 0, 0} ;
+  uint8_t dither48[48] ;
+  uint32_t i = 0 ;
+  int val = 0 ;
+
+  if (pDither) memcpy(pattern, pDither, 4) ;
+
+  // 16 pixels are 48 bytes. The dither pattern repeats every 4 pixels
+  // so every block of bytes uses the same thresholds
+  for (int k=0; k < 48; k++) dither48[k] = pattern[(k / 3) & 3] ;
+
+#if defined(COLOUR_CONVERT_NEON)
+  uint8x16_t vdither[3] ;
+  uint8x16_t v ;
+
+  for (int k=0; k < 3; k++) vdither[k] = vld1q_u8(dither48 + (k*16)) ;
+
+  for (; i + 16 <= nPixels; i += 16){
+    for (int k=0; k < 3; k++){
+      v = vld1q_u8(pSrc + (i*3) + (k*16)) ;
+      vst1q_u8(pDst + (i*3) + (k*16), vshrq_n_u8(vqaddq_u8(v, vdither[k]), 4)) ;
+    }
+  }
+#elif defined(COLOUR_CONVERT_SSSE3)
+  const __m128i vmask = _mm_set1_epi8(0x0F) ;
+  __m128i vdither[3] ;
+  __m128i v ;
+
+  for (int k=0; k < 3; k++) vdither[k] = _mm_loadu_si128((const __m128i*)(dither48 + (k*16))) ;
+
+  for (; i + 16 <= nPixels; i += 16){
+    for (int k=0; k < 3; k++){
+      v = _mm_loadu_si128((const __m128i*)(pSrc + (i*3) + (k*16))) ;
+      v = _mm_and_si128(_mm_srli_epi16(_mm_adds_epu8(v, vdither[k]), 4), vmask) ;
+      _mm_storeu_si128((__m128i*)(pDst + (i*3) + (k*16)), v) ;
+    }
+  }
+#endif
+
+  if (!pDither){
+    for (i *= 3; i < nPixels * 3; i++) pDst[i] = pSrc[i] >> 4 ;
+    return ;
+  }
+
+  for (i *= 3; i < nPixels * 3; i++){
+    val = pSrc[i] + dither48[i % 12] ;
+    pDst[i] = (val > 0xFF?0xFF:val) >> 4 ;
+  }
+}
+
+void ColourConvert::rgbToRGB332(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels)
+{
+  for (uint32_t i=0; i < nPixels; i++){
+    pDst[i] = (pSrc[0] & 0xE0) | ((pSrc[1] >> 3) & 0x1C) | (pSrc[2] >> 6) ;
+    pSrc += 3 ;
+  }
+}
+
+void ColourConvert::unpackRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels)
+{
+  for (uint32_t i=0; i < nPixels; i++){
+    pDst[0] = pSrc[0] & 0x0F ;
+    pDst[1] = pSrc[1] >> 4 ;
+    pDst[2] = pSrc[1] & 0x0F ;
+    pSrc += 2 ;
+    pDst += 3 ;
+  }
+}
+
+void ColourConvert::rgbaToRGB332(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels)
+{
+  uint32_t px ;
+  uint32_t i = 0 ;
+
+  // Load a whole pixel at a time. Byte order in memory is R,G,B,A
+  // and the shifts below assume a little endian CPU as on the Pi
+  for (; i < nPixels; i++){
+    memcpy(&px, pSrc, 4) ;
+    pDst[i] = (px & 0xE0) | ((px >> 11) & 0x1C) | ((px >> 22) & 0x03) ;
+    pSrc += 4 ;
+  }
+}
+
+void ColourConvert::rgb444ToRGB332(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels)
+{
+  // Destination is never ahead of the source so this works in place
+  for (uint32_t i=0; i < nPixels; i++){
+    pDst[i] = packRGB332(pSrc[0], pSrc[1], pSrc[2]) ;
+    pSrc += 3 ;
+  }
+}
+
+void ColourConvert::rgb332ToRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels)
+{
+  uint8_t c ;
+
+  // Work backwards so the expanding output doesn't overwrite
+  // source pixels when converting in place
+  while (nPixels-- > 0){
+    c = pSrc[nPixels] ;
+    pDst[nPixels*3] = s_lut332[c >> 5] ;
+    pDst[nPixels*3+1] = s_lut332[8 + ((c >> 2) & 0x07)] ;
+    pDst[nPixels*3+2] = s_lut332[16 + (c & 0x03)] ;
+  }
+}
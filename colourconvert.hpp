@@ -0,0 +1,86 @@
+#ifndef __COLOUR_CONVERT_HPP
+#define __COLOUR_CONVERT_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+///////////////////////////////////////////////////
+//
+// Pixel format conversion kernels used by the display
+// drivers. All functions work on spans of pixels and
+// do no clipping.
+//
+// RGBA is 4 bytes per pixel in the order red, green, blue, alpha
+// RGB444 is 3 bytes per pixel with one 4 bit channel per byte
+// RGB332 is 1 byte per pixel, 3 bits red, 3 bits green, 2 bits blue
+// RGB24 is 3 bytes per pixel in the order red, green, blue
+// Packed RGB444 is 2 bytes per pixel, big endian 0x0RGB
+//
+///////////////////////////////////////////////////
+
+class ColourConvert{
+public:
+  // Convert a span of RGBA pixels to RGB444. Uses NEON or SSSE3 when
+  // built for them. pDither is an optional 4 entry threshold pattern
+  // from ditherPattern() for the first pixel of the span
+  static void rgbaToRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels, const uint8_t *pDither = NULL) ;
+
+  // Source over blend a span of RGBA pixels onto RGB444 or RGB332 pixels
+  // using the source alpha. Blocks of fully transparent or opaque pixels
+  // are skipped or copied without blending
+  static void blendRGBAToRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels) ;
+  static void blendRGBAToRGB332(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels) ;
+
+  // Blend a colour onto RGB444 or RGB332 pixels by 8 bit coverage, such as
+  // anti-aliased glyphs. pColour is 8 bit red, green and blue. Blocks of
+  // no coverage are skipped and full coverage is written without blending
+  static void blendCoverageRGB444(const uint8_t *pCoverage, const uint8_t *pColour, uint8_t *pDst, uint32_t nPixels) ;
+  static void blendCoverageRGB332(const uint8_t *pCoverage, const uint8_t *pColour, uint8_t *pDst, uint32_t nPixels) ;
+
+  // Fill pPattern with 4 ordered dither thresholds for a span starting at x, y
+  static void ditherPattern(int x, int y, uint8_t *pPattern) ;
+
+  // Convert a span of RGB24 pixels to RGB444. Each byte keeps its top
+  // 4 bits so this vectorises well without any shuffling. pDither is as
+  // for rgbaToRGB444
+  static void rgbToRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels, const uint8_t *pDither = NULL) ;
+
+  // Convert a span of RGB24 pixels to RGB332
+  static void rgbToRGB332(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels) ;
+
+  // Convert a span of packed RGB444 pixels to RGB444
+  static void unpackRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels) ;
+
+  // Convert a span of RGBA pixels to RGB332
+  static void rgbaToRGB332(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels) ;
+
+  // Convert a span of RGB444 pixels to RGB332. Source and destination
+  // can be the same buffer
+  static void rgb444ToRGB332(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels) ;
+
+  // Convert a span of RGB332 pixels to RGB444. Source and destination
+  // can be the same buffer
+  static void rgb332ToRGB444(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels) ;
+
+  // Blend 8 bit source and destination channels with alpha. Rounded divide by 255
+  static uint8_t blend8(uint8_t src, uint8_t dst, uint8_t alpha)
+  {
+    uint32_t x = (src * alpha) + (dst * (255 - alpha)) + 128 ;
+    return (x + (x >> 8)) >> 8 ;
+  }
+
+  // Pack 4 bit channels into RGB332
+  static uint8_t packRGB332(uint8_t red, uint8_t green, uint8_t blue)
+  {
+    return (red & 0x0E) << 4 | (green & 0x0E) << 1 | (blue & 0x0C) >> 2 ;
+  }
+
+  // Colour LUT for RGB332 pixels, 8 red, 8 green and 4 blue 4 bit levels.
+  // This is the order the PCF8833 expects for RGBSET
+  static const uint8_t s_lut332[20] ;
+
+  // 4x4 Bayer matrix scaled to the 16 steps lost when truncating 8 bits to 4
+  static const uint8_t s_bayer4[4][4] ;
+};
+
+#endif // __COLOUR_CONVERT_HPP
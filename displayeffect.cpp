@@ -0,0 +1,111 @@
+#include "displayeffect.hpp"
+#include <stddef.h>
+
+DisplayEffect::DisplayEffect()
+{
+  m_pfnApply = NULL ;
+  m_pContext = NULL ;
+  m_eEffect = none ;
+  m_nTime = 0 ;
+  m_nDuration = 0 ;
+  m_nPeriod = 0 ;
+  m_nFrom = 0 ;
+  m_nTo = 0 ;
+  m_nContrast = 0 ;
+  m_bInverted = false ;
+  m_bOn = true ;
+}
+
+void DisplayEffect::setApply(ApplyFn pfnApply, void *pContext)
+{
+  m_pfnApply = pfnApply ;
+  m_pContext = pContext ;
+}
+
+void DisplayEffect::apply(enEffect eEffect)
+{
+  if (m_pfnApply && eEffect != none) m_pfnApply(m_pContext, *this, eEffect) ;
+}
+
+void DisplayEffect::startFade(int from, int to, unsigned int duration)
+{
+  stop() ;
+  m_eEffect = fade ;
+  m_nTime = 0 ;
+  m_nDuration = duration ;
+  m_nFrom = from ;
+  m_nTo = to ;
+  m_nContrast = from ;
+  apply(fade) ;
+}
+
+void DisplayEffect::startBlink(unsigned int count, unsigned int period)
+{
+  stop() ;
+  m_eEffect = blink ;
+  m_nTime = 0 ;
+  m_nPeriod = period ;
+  m_nDuration = count * period ;
+  m_bOn = false ;
+  apply(blink) ;
+}
+
+void DisplayEffect::startFlash(unsigned int count, unsigned int period)
+{
+  stop() ;
+  m_eEffect = flash ;
+  m_nTime = 0 ;
+  m_nPeriod = period ;
+  m_nDuration = count * period ;
+  m_bInverted = true ;
+  apply(flash) ;
+}
+
+void DisplayEffect::stop()
+{
+  enEffect eEffect = m_eEffect ;
+
+  reset() ;
+  apply(eEffect) ;
+}
+
+void DisplayEffect::reset()
+{
+  m_eEffect = none ;
+  m_bOn = true ;
+  m_bInverted = false ;
+}
+
+bool DisplayEffect::step(unsigned int elapsed)
+{
+  enEffect eEffect = m_eEffect ;
+  bool bFirstHalf = false ;
+
+  if (eEffect == none) return false ;
+
+  m_nTime += elapsed ;
+  if (m_nTime >= m_nDuration){
+    if (eEffect == fade) m_nContrast = m_nTo ;
+    reset() ;
+    apply(eEffect) ;
+    return false ;
+  }
+
+  switch(m_eEffect){
+  case fade:
+    m_nContrast = m_nFrom + (((m_nTo - m_nFrom) * (int)m_nTime) / (int)m_nDuration) ;
+    break ;
+  case blink:
+  case flash:
+    // Off or inverted for the first half of each period
+    bFirstHalf = m_nPeriod == 0 || (m_nTime % m_nPeriod) < (m_nPeriod / 2) ;
+    if (m_eEffect == blink) m_bOn = !bFirstHalf ;
+    else m_bInverted = bFirstHalf ;
+    break ;
+  default:
+    break ;
+  }
+  apply(eEffect) ;
+
+  return true ;
+}
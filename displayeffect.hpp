@@ -0,0 +1,73 @@
+#ifndef __DISPLAY_EFFECT_HPP
+#define __DISPLAY_EFFECT_HPP
+
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// Timed display effects which only change panel
+// registers: contrast, inversion and display on/off.
+// The drivers step an effect with the elapsed time.
+// Each change is passed to the driver's apply
+// function, which sends a command only when a
+// register differs from the panel
+//
+///////////////////////////////////////////////////
+
+class DisplayEffect{
+public:
+  DisplayEffect() ;
+
+  enum enEffect{none, fade, blink, flash} ;
+
+  // Called after the register values change. eEffect is the effect
+  // which changed them, so only its register needs sending
+  typedef void (*ApplyFn)(void *pContext, DisplayEffect &effect, enEffect eEffect) ;
+  void setApply(ApplyFn pfnApply, void *pContext) ;
+
+  // Ramp contrast between two values over a duration. Starting an
+  // effect stops any running effect first
+  void startFade(int from, int to, unsigned int duration) ;
+
+  // Turn the display off and on count times, once per period
+  void startBlink(unsigned int count, unsigned int period) ;
+
+  // Invert the display and back count times, once per period
+  void startFlash(unsigned int count, unsigned int period) ;
+
+  // End the effect with the display on and not inverted. Contrast stays as it is
+  void stop() ;
+
+  // Move the effect on by elapsed milliseconds. Returns true
+  // while the effect is still running
+  bool step(unsigned int elapsed) ;
+
+  bool isRunning(){return m_eEffect != none;}
+  enEffect getEffect(){return m_eEffect;}
+
+  // Register values for the current step
+  int getContrast(){return m_nContrast;}
+  bool isInverted(){return m_bInverted;}
+  bool isOn(){return m_bOn;}
+
+protected:
+  // Reset to no effect without applying
+  void reset() ;
+
+  void apply(enEffect eEffect) ;
+
+  ApplyFn m_pfnApply ;
+  void *m_pContext ;
+
+  enEffect m_eEffect ;
+  uint32_t m_nTime ; // milliseconds into the effect
+  uint32_t m_nDuration ;
+  uint32_t m_nPeriod ;
+  int m_nFrom, m_nTo ;
+
+  int m_nContrast ;
+  bool m_bInverted ;
+  bool m_bOn ;
+};
+
+#endif // __DISPLAY_EFFECT_HPP
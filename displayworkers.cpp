@@ -0,0 +1,172 @@
+#include "displayworkers.hpp"
+#include "framepacer.hpp"
+#include <stdio.h>
+#include <string.h>
+
+DisplayWorkers::DisplayWorkers()
+{
+  m_nWorkers = 0 ;
+  m_nThreads = 0 ;
+  m_nBuses = 0 ;
+  m_pfnDraw = NULL ;
+  m_pfnSend = NULL ;
+  m_pContext = NULL ;
+  m_bBarrier = false ;
+  m_nFrame = 0 ;
+  m_nDrawing = 0 ;
+  m_nPending = 0 ;
+  m_bQuit = false ;
+  memset(m_workers, 0, sizeof(m_workers)) ;
+  for (int b=0; b < DISPLAY_WORKERS_MAX; b++) pthread_mutex_init(&m_busLocks[b], NULL) ;
+  pthread_mutex_init(&m_lock, NULL) ;
+  pthread_cond_init(&m_start, NULL) ;
+  pthread_cond_init(&m_send, NULL) ;
+  pthread_cond_init(&m_done, NULL) ;
+}
+
+DisplayWorkers::~DisplayWorkers()
+{
+  stop() ;
+  pthread_cond_destroy(&m_done) ;
+  pthread_cond_destroy(&m_send) ;
+  pthread_cond_destroy(&m_start) ;
+  pthread_mutex_destroy(&m_lock) ;
+  for (int b=0; b < DISPLAY_WORKERS_MAX; b++) pthread_mutex_destroy(&m_busLocks[b]) ;
+}
+
+bool DisplayWorkers::add(unsigned int bus)
+{
+  unsigned int b = 0 ;
+
+  if (m_nThreads > 0){
+    fprintf(stderr, "add: cannot add displays once started\n") ;
+    return false ;
+  }
+  if (m_nWorkers >= DISPLAY_WORKERS_MAX){
+    fprintf(stderr, "add: limited to %d displays\n", DISPLAY_WORKERS_MAX) ;
+    return false ;
+  }
+
+  for (b=0; b < m_nBuses; b++){
+    if (m_buses[b] == bus) break ;
+  }
+  if (b == m_nBuses) m_buses[m_nBuses++] = bus ;
+
+  m_workers[m_nWorkers].pOwner = this ;
+  m_workers[m_nWorkers].n = m_nWorkers ;
+  m_workers[m_nWorkers].bus = b ;
+  memset(&m_workers[m_nWorkers].timing, 0, sizeof(Timing)) ;
+  m_workers[m_nWorkers].timing.bOK = true ;
+  m_nWorkers++ ;
+
+  return true ;
+}
+
+bool DisplayWorkers::start(WorkFn pfnDraw, WorkFn pfnSend, void *pContext, bool bBarrier)
+{
+  if (m_nThreads > 0) return true ;
+  if (m_nWorkers == 0){
+    fprintf(stderr, "start: no displays added\n") ;
+    return false ;
+  }
+
+  m_pfnDraw = pfnDraw ;
+  m_pfnSend = pfnSend ;
+  m_pContext = pContext ;
+  m_bBarrier = bBarrier ;
+  m_bQuit = false ;
+  m_nDrawing = 0 ;
+  m_nPending = 0 ;
+  for (unsigned int n=0; n < m_nWorkers; n++){
+    m_workers[n].frame = m_nFrame ;
+    if (pthread_create(&m_workers[n].thread, NULL, workerThread, &m_workers[n]) != 0){
+      fprintf(stderr, "start: cannot start worker thread\n") ;
+      stop() ;
+      return false ;
+    }
+    m_nThreads++ ;
+  }
+
+  return true ;
+}
+
+void DisplayWorkers::stop()
+{
+  if (m_nThreads == 0) return ;
+
+  pthread_mutex_lock(&m_lock) ;
+  m_bQuit = true ;
+  pthread_cond_broadcast(&m_start) ;
+  pthread_mutex_unlock(&m_lock) ;
+
+  for (unsigned int n=0; n < m_nThreads; n++) pthread_join(m_workers[n].thread, NULL) ;
+  m_nThreads = 0 ;
+}
+
+bool DisplayWorkers::run()
+{
+  bool bOK = true ;
+
+  if (m_nThreads == 0){
+    fprintf(stderr, "run: call start first\n") ;
+    return false ;
+  }
+
+  pthread_mutex_lock(&m_lock) ;
+  m_nFrame++ ;
+  m_nDrawing = m_nThreads ;
+  m_nPending = m_nThreads ;
+  pthread_cond_broadcast(&m_start) ;
+  while (m_nPending > 0) pthread_cond_wait(&m_done, &m_lock) ;
+  pthread_mutex_unlock(&m_lock) ;
+
+  for (unsigned int n=0; n < m_nWorkers; n++) bOK = bOK && m_workers[n].timing.bOK ;
+
+  return bOK ;
+}
+
+void *DisplayWorkers::workerThread(void *pArg)
+{
+  Worker *pWorker = (Worker *)pArg ;
+
+  pWorker->pOwner->work(*pWorker) ;
+
+  return NULL ;
+}
+
+void DisplayWorkers::work(Worker &worker)
+{
+  Timing &timing = worker.timing ;
+
+  pthread_mutex_lock(&m_lock) ;
+  for(;;){
+    while (!m_bQuit && m_nFrame == worker.frame) pthread_cond_wait(&m_start, &m_lock) ;
+    if (m_bQuit) break ;
+    worker.frame = m_nFrame ;
+    pthread_mutex_unlock(&m_lock) ;
+
+    // The timing is only touched by this thread until run sees the
+    // frame finish
+    timing.drawStart = FramePacer::timeMicros() ;
+    timing.bOK = m_pfnDraw(m_pContext, worker.n) ;
+    timing.drawEnd = FramePacer::timeMicros() ;
+
+    // Hold the send until every display has the frame
+    if (m_bBarrier){
+      pthread_mutex_lock(&m_lock) ;
+      if (--m_nDrawing == 0) pthread_cond_broadcast(&m_send) ;
+      while (m_nDrawing > 0) pthread_cond_wait(&m_send, &m_lock) ;
+      pthread_mutex_unlock(&m_lock) ;
+    }
+
+    pthread_mutex_lock(&m_busLocks[worker.bus]) ;
+    timing.sendStart = FramePacer::timeMicros() ;
+    if (timing.bOK) timing.bOK = m_pfnSend(m_pContext, worker.n) ;
+    timing.sendEnd = FramePacer::timeMicros() ;
+    pthread_mutex_unlock(&m_busLocks[worker.bus]) ;
+
+    pthread_mutex_lock(&m_lock) ;
+    if (--m_nPending == 0) pthread_cond_signal(&m_done) ;
+  }
+  pthread_mutex_unlock(&m_lock) ;
+}
@@ -0,0 +1,101 @@
+#ifndef __DISPLAY_WORKERS_HPP
+#define __DISPLAY_WORKERS_HPP
+
+#include <pthread.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// A thread for each of several displays. A frame is
+// drawn into every display buffer at once, then each
+// display sends while holding a lock for its bus, so
+// displays sharing a bus take turns to send while
+// conversion still overlaps. With the barrier every
+// draw finishes before any display sends, so the
+// displays change together. Used by FanoutPresenter
+// and VideoWall
+//
+///////////////////////////////////////////////////
+
+#define DISPLAY_WORKERS_MAX 16
+
+class DisplayWorkers{
+public:
+  DisplayWorkers() ;
+  ~DisplayWorkers() ;
+
+  // Work for display n. Called on its thread and returns false on failure
+  typedef bool (*WorkFn)(void *pContext, unsigned int n) ;
+
+  // Add a display on a bus. Displays are numbered from 0 in the order
+  // added. Give displays sharing a SPI bus or GPIO lines the same bus
+  // number. Call before start
+  bool add(unsigned int bus) ;
+
+  // Start a thread for each display. pfnDraw writes the display buffer
+  // and pfnSend, called only if the draw worked, sends it. With bBarrier
+  // no display sends until every display has drawn
+  bool start(WorkFn pfnDraw, WorkFn pfnSend, void *pContext, bool bBarrier = false) ;
+
+  // Stop the threads
+  void stop() ;
+
+  bool isRunning(){return m_nThreads > 0;}
+
+  // Draw and send a frame on every display and wait for them all.
+  // Returns false if any display failed
+  bool run() ;
+
+  unsigned int getDisplays(){return m_nWorkers;}
+
+  // Distinct buses in the order first added, and the index of the bus
+  // display n was added on
+  unsigned int getBuses(){return m_nBuses;}
+  unsigned int getBus(unsigned int b){return m_buses[b];}
+  unsigned int getBusIndex(unsigned int n){return m_workers[n].bus;}
+
+  // Times of the last run for a display from FramePacer::timeMicros
+  struct Timing{
+    uint64_t drawStart, drawEnd ;
+    uint64_t sendStart, sendEnd ; // with the bus held
+    bool bOK ;
+  };
+  const Timing &getTiming(unsigned int n){return m_workers[n].timing;}
+
+protected:
+  struct Worker{
+    DisplayWorkers *pOwner ;
+    unsigned int n ;
+    unsigned int bus ; // index into m_buses
+    uint32_t frame ; // last frame run
+    pthread_t thread ;
+    Timing timing ;
+  };
+
+  static void *workerThread(void *pArg) ;
+  void work(Worker &worker) ;
+
+  Worker m_workers[DISPLAY_WORKERS_MAX] ;
+  unsigned int m_nWorkers ;
+  unsigned int m_nThreads ;
+
+  unsigned int m_buses[DISPLAY_WORKERS_MAX] ; // distinct bus numbers
+  pthread_mutex_t m_busLocks[DISPLAY_WORKERS_MAX] ;
+  unsigned int m_nBuses ;
+
+  WorkFn m_pfnDraw ;
+  WorkFn m_pfnSend ;
+  void *m_pContext ;
+  bool m_bBarrier ;
+
+  pthread_mutex_t m_lock ;
+  pthread_cond_t m_start ; // threads wait for a new frame
+  pthread_cond_t m_send ; // threads wait at the barrier for every draw
+  pthread_cond_t m_done ; // run waits for the threads
+  uint32_t m_nFrame ; // counts frames so threads see each one once
+  unsigned int m_nDrawing ; // threads still drawing the frame
+  unsigned int m_nPending ; // threads still working on the frame
+  bool m_bQuit ;
+};
+
+#endif // __DISPLAY_WORKERS_HPP
@@ -0,0 +1,100 @@
+#include "fanoutpresenter.hpp"
+#include "framepacer.hpp"
+#include <stdio.h>
+
+FanoutPresenter::FanoutPresenter()
+{
+  m_nDisplays = 0 ;
+  m_pImage = NULL ;
+  m_nLastMicros = 0 ;
+}
+
+FanoutPresenter::~FanoutPresenter()
+{
+  stop() ;
+}
+
+bool FanoutPresenter::addDisplay(IDisplay &display, unsigned int bus, bool bFit, ImageScale::enFilter eFilter)
+{
+  if (m_nDisplays >= FANOUT_MAX_DISPLAYS){
+    fprintf(stderr, "addDisplay: limited to %d displays\n", FANOUT_MAX_DISPLAYS) ;
+    return false ;
+  }
+  if (!m_workers.add(bus)) return false ;
+
+  m_displays[m_nDisplays].pDisplay = &display ;
+  m_displays[m_nDisplays].bFit = bFit ;
+  m_displays[m_nDisplays].eFilter = eFilter ;
+  m_displays[m_nDisplays].micros = 0 ;
+  m_nDisplays++ ;
+
+  return true ;
+}
+
+bool FanoutPresenter::start()
+{
+  if (m_nDisplays == 0){
+    fprintf(stderr, "start: no displays added\n") ;
+    return false ;
+  }
+
+  return m_workers.start(drawDisplay, sendDisplay, this) ;
+}
+
+void FanoutPresenter::stop()
+{
+  m_workers.stop() ;
+}
+
+bool FanoutPresenter::present(DisplayImage &img)
+{
+  uint64_t start = FramePacer::timeMicros() ;
+  bool bOK = true ;
+
+  if (!m_workers.isRunning()){
+    fprintf(stderr, "present: call start first\n") ;
+    return false ;
+  }
+
+  m_pImage = &img ;
+  bOK = m_workers.run() ;
+  m_pImage = NULL ;
+
+  m_nLastMicros = (uint32_t)(FramePacer::timeMicros() - start) ;
+  for (unsigned int i=0; i < m_nDisplays; i++){
+    const DisplayWorkers::Timing &timing = m_workers.getTiming(i) ;
+    m_displays[i].micros = (uint32_t)((timing.drawEnd - timing.drawStart) + (timing.sendEnd - timing.sendStart)) ;
+  }
+
+  return bOK ;
+}
+
+uint32_t FanoutPresenter::getSerialMicros()
+{
+  uint32_t total = 0 ;
+
+  for (unsigned int i=0; i < m_nDisplays; i++) total += m_displays[i].micros ;
+
+  return total ;
+}
+
+bool FanoutPresenter::drawDisplay(void *pContext, unsigned int n)
+{
+  FanoutPresenter *pPresenter = (FanoutPresenter *)pContext ;
+  FanoutDisplay &display = pPresenter->m_displays[n] ;
+  IDisplay *pDisplay = display.pDisplay ;
+
+  if (display.bFit){
+    return pDisplay->writeScaled(*pPresenter->m_pImage, display.eFilter, 0, 0,
+				 pDisplay->getWidth(), pDisplay->getHeight()) ;
+  }
+
+  return pDisplay->writeImage(*pPresenter->m_pImage, IDisplay::overwrite, 0, 0) ;
+}
+
+bool FanoutPresenter::sendDisplay(void *pContext, unsigned int n)
+{
+  FanoutPresenter *pPresenter = (FanoutPresenter *)pContext ;
+
+  return pPresenter->m_displays[n].pDisplay->display() ;
+}
@@ -0,0 +1,75 @@
+#ifndef __FANOUT_PRESENTER_HPP
+#define __FANOUT_PRESENTER_HPP
+
+#include "idisplay.hpp"
+#include "imagescale.hpp"
+#include "displayworkers.hpp"
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// Mirrors one image to several displays at once.
+// Each display is converted on its own thread and
+// displays on different buses send at the same time,
+// so a frame takes about as long as the slowest bus
+// rather than the sum of all the displays
+//
+///////////////////////////////////////////////////
+
+#define FANOUT_MAX_DISPLAYS 4
+
+class FanoutPresenter{
+public:
+  FanoutPresenter() ;
+  ~FanoutPresenter() ;
+
+  // Add a set up and initialised display. Displays given the same bus
+  // number take turns to send but are still converted at the same time,
+  // so give displays sharing a SPI bus or GPIO lines the same number. Fitted
+  // images are scaled to fill the display, otherwise they are written
+  // unscaled to the top left. Call before start
+  bool addDisplay(IDisplay &display, unsigned int bus, bool bFit = true,
+		  ImageScale::enFilter eFilter = ImageScale::box) ;
+
+  // Start a thread for each display
+  bool start() ;
+
+  // Stop the threads. Displays can then be used directly again
+  void stop() ;
+
+  // Draw the image on every display and wait for them all to finish.
+  // The image must not change until this returns. Returns false if
+  // any display failed
+  bool present(DisplayImage &img) ;
+
+  unsigned int getDisplays(){return m_nDisplays;}
+
+  // Timings of the last present in microseconds. A display's time is
+  // its conversion and send without waiting for the bus. Serial is the
+  // sum of the display times, which is roughly what drawing them in turn
+  // takes
+  uint32_t getLastMicros(){return m_nLastMicros;}
+  uint32_t getDisplayMicros(unsigned int n){return n < m_nDisplays?m_displays[n].micros:0;}
+  uint32_t getSerialMicros() ;
+
+protected:
+  struct FanoutDisplay{
+    IDisplay *pDisplay ;
+    bool bFit ;
+    ImageScale::enFilter eFilter ;
+    uint32_t micros ;
+  };
+
+  // DisplayWorkers calls. pContext is the presenter
+  static bool drawDisplay(void *pContext, unsigned int n) ;
+  static bool sendDisplay(void *pContext, unsigned int n) ;
+
+  FanoutDisplay m_displays[FANOUT_MAX_DISPLAYS] ;
+  unsigned int m_nDisplays ;
+  DisplayWorkers m_workers ;
+  DisplayImage *m_pImage ; // set while presenting
+
+  uint32_t m_nLastMicros ;
+};
+
+#endif // __FANOUT_PRESENTER_HPP
@@ -0,0 +1,271 @@
+#include "fontatlas.hpp"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <stdio.h>
+#include <string.h>
+
+FontAtlas::FontAtlas(uint32_t maxBytes)
+{
+  m_library = NULL ;
+  m_nFaces = 0 ;
+  for (int i=0; i < FONT_ATLAS_MAX_FACES; i++){
+    m_faces[i] = NULL ;
+    m_nSizes[i] = 0 ;
+  }
+  m_pHead = NULL ;
+  m_pTail = NULL ;
+  memset(m_buckets, 0, sizeof(m_buckets)) ;
+  m_nMaxBytes = maxBytes ;
+  m_nBytes = 0 ;
+  m_nGlyphs = 0 ;
+  resetStats() ;
+}
+
+FontAtlas::~FontAtlas()
+{
+  clear() ;
+  for (int i=0; i < m_nFaces; i++) FT_Done_Face(m_faces[i]) ;
+  if (m_library) FT_Done_FreeType(m_library) ;
+}
+
+int FontAtlas::loadFace(const char *szFile)
+{
+  if (m_nFaces >= FONT_ATLAS_MAX_FACES){
+    fprintf(stderr, "loadFace: limited to %d faces\n", FONT_ATLAS_MAX_FACES) ;
+    return -1 ;
+  }
+
+  if (!m_library && FT_Init_FreeType(&m_library) != 0){
+    fprintf(stderr, "loadFace: cannot initialise FreeType\n") ;
+    m_library = NULL ;
+    return -1 ;
+  }
+
+  if (FT_New_Face(m_library, szFile, 0, &m_faces[m_nFaces]) != 0){
+    fprintf(stderr, "loadFace: cannot load %s\n", szFile) ;
+    m_faces[m_nFaces] = NULL ;
+    return -1 ;
+  }
+  m_nSizes[m_nFaces] = 0 ;
+
+  return m_nFaces++ ;
+}
+
+bool FontAtlas::setSize(int face, unsigned int size)
+{
+  if (face < 0 || face >= m_nFaces){
+    fprintf(stderr, "setSize: no face %d\n", face) ;
+    return false ;
+  }
+  if (m_nSizes[face] == size) return true ;
+
+  if (size == 0 || FT_Set_Pixel_Sizes(m_faces[face], 0, size) != 0){
+    fprintf(stderr, "setSize: cannot use %u pixels\n", size) ;
+    m_nSizes[face] = 0 ;
+    return false ;
+  }
+  m_nSizes[face] = size ;
+
+  return true ;
+}
+
+int FontAtlas::getAscender(int face, unsigned int size)
+{
+  if (!setSize(face, size)) return 0 ;
+  return m_faces[face]->size->metrics.ascender >> 6 ;
+}
+
+int FontAtlas::getLineHeight(int face, unsigned int size)
+{
+  if (!setSize(face, size)) return 0 ;
+  return m_faces[face]->size->metrics.height >> 6 ;
+}
+
+uint32_t FontAtlas::nextCodepoint(const char *&pText)
+{
+  const uint8_t *p = (const uint8_t *)pText ;
+  uint32_t cp = p[0] ;
+  int extra = 0 ;
+
+  if (cp >= 0xF0 && cp < 0xF8){
+    cp &= 0x07 ;
+    extra = 3 ;
+  }else if (cp >= 0xE0){
+    cp &= 0x0F ;
+    extra = 2 ;
+  }else if (cp >= 0xC0){
+    cp &= 0x1F ;
+    extra = 1 ;
+  }
+
+  for (int i=1; i <= extra; i++){
+    if ((p[i] & 0xC0) != 0x80){
+      // Not a continuation byte so use the lead byte on its own
+      pText++ ;
+      return p[0] ;
+    }
+    cp = (cp << 6) | (p[i] & 0x3F) ;
+  }
+  pText += extra + 1 ;
+
+  return cp ;
+}
+
+int FontAtlas::textWidth(int face, unsigned int size, const char *szText)
+{
+  const Glyph *pGlyph = NULL ;
+  int width = 0 ;
+
+  while (*szText){
+    pGlyph = getGlyph(face, size, nextCodepoint(szText)) ;
+    if (pGlyph) width += pGlyph->advance ;
+  }
+
+  return width ;
+}
+
+unsigned int FontAtlas::bucket(int face, unsigned int size, uint32_t codepoint)
+{
+  uint32_t h = (codepoint * 2654435761u) ^ (size * 40503u) ^ (face * 97u) ;
+  return (h ^ (h >> 16)) & (FONT_ATLAS_BUCKETS - 1) ;
+}
+
+const FontAtlas::Glyph *FontAtlas::getGlyph(int face, unsigned int size, uint32_t codepoint)
+{
+  Entry *pEntry = NULL ;
+
+  for (pEntry = m_buckets[bucket(face, size, codepoint)]; pEntry; pEntry = pEntry->pHashNext){
+    if (pEntry->codepoint == codepoint && pEntry->size == size && pEntry->face == face){
+      if (pEntry != m_pHead){
+	unlink(pEntry) ;
+	pushFront(pEntry) ;
+      }
+      m_nHits++ ;
+      return &pEntry->glyph ;
+    }
+  }
+
+  m_nMisses++ ;
+  pEntry = rasterise(face, size, codepoint) ;
+
+  return pEntry?&pEntry->glyph:NULL ;
+}
+
+FontAtlas::Entry *FontAtlas::rasterise(int face, unsigned int size, uint32_t codepoint)
+{
+  Entry *pEntry = NULL ;
+  FT_GlyphSlot slot = NULL ;
+  uint8_t *pCoverage = NULL ;
+  uint32_t len = 0 ;
+  unsigned int b = 0 ;
+
+  if (!setSize(face, size)) return NULL ;
+
+  if (FT_Load_Char(m_faces[face], codepoint, FT_LOAD_RENDER) != 0){
+    fprintf(stderr, "rasterise: cannot render codepoint %u\n", codepoint) ;
+    return NULL ;
+  }
+  slot = m_faces[face]->glyph ;
+  if (slot->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY){
+    fprintf(stderr, "rasterise: codepoint %u is not 8 bit coverage\n", codepoint) ;
+    return NULL ;
+  }
+
+  len = slot->bitmap.width * slot->bitmap.rows ;
+  if (len > m_nMaxBytes) return NULL ;
+
+  trim(len) ;
+
+  pEntry = new Entry ;
+  if (!pEntry) return NULL ;
+  if (len > 0){
+    pCoverage = new uint8_t[len] ;
+    if (!pCoverage){
+      delete pEntry ;
+      return NULL ;
+    }
+    // Rows are copied without the FreeType padding
+    for (unsigned int y=0; y < slot->bitmap.rows; y++){
+      memcpy(pCoverage + (y * slot->bitmap.width), slot->bitmap.buffer + (y * slot->bitmap.pitch), slot->bitmap.width) ;
+    }
+  }
+
+  pEntry->face = face ;
+  pEntry->size = size ;
+  pEntry->codepoint = codepoint ;
+  pEntry->len = len ;
+  pEntry->glyph.left = slot->bitmap_left ;
+  pEntry->glyph.top = slot->bitmap_top ;
+  pEntry->glyph.width = slot->bitmap.width ;
+  pEntry->glyph.height = slot->bitmap.rows ;
+  pEntry->glyph.advance = slot->advance.x >> 6 ;
+  pEntry->glyph.pCoverage = pCoverage ;
+
+  b = bucket(face, size, codepoint) ;
+  pEntry->pHashNext = m_buckets[b] ;
+  m_buckets[b] = pEntry ;
+  pushFront(pEntry) ;
+
+  m_nBytes += len ;
+  m_nGlyphs++ ;
+
+  return pEntry ;
+}
+
+void FontAtlas::clear()
+{
+  while (m_pHead) remove(m_pHead) ;
+}
+
+void FontAtlas::setMaxBytes(uint32_t maxBytes)
+{
+  m_nMaxBytes = maxBytes ;
+  trim(0) ;
+}
+
+void FontAtlas::resetStats()
+{
+  m_nHits = 0 ;
+  m_nMisses = 0 ;
+  m_nEvictions = 0 ;
+}
+
+void FontAtlas::unlink(Entry *pEntry)
+{
+  if (pEntry->pPrev) pEntry->pPrev->pNext = pEntry->pNext ;
+  else m_pHead = pEntry->pNext ;
+
+  if (pEntry->pNext) pEntry->pNext->pPrev = pEntry->pPrev ;
+  else m_pTail = pEntry->pPrev ;
+}
+
+void FontAtlas::pushFront(Entry *pEntry)
+{
+  pEntry->pPrev = NULL ;
+  pEntry->pNext = m_pHead ;
+  if (m_pHead) m_pHead->pPrev = pEntry ;
+  else m_pTail = pEntry ;
+  m_pHead = pEntry ;
+}
+
+void FontAtlas::remove(Entry *pEntry)
+{
+  Entry **ppLink = &m_buckets[bucket(pEntry->face, pEntry->size, pEntry->codepoint)] ;
+
+  while (*ppLink != pEntry) ppLink = &(*ppLink)->pHashNext ;
+  *ppLink = pEntry->pHashNext ;
+
+  unlink(pEntry) ;
+  m_nBytes -= pEntry->len ;
+  m_nGlyphs-- ;
+  delete[] pEntry->glyph.pCoverage ;
+  delete pEntry ;
+}
+
+void FontAtlas::trim(uint32_t extra)
+{
+  while (m_pTail && m_nBytes + extra > m_nMaxBytes){
+    remove(m_pTail) ;
+    m_nEvictions++ ;
+  }
+}
@@ -0,0 +1,119 @@
+#ifndef __FONT_ATLAS_HPP
+#define __FONT_ATLAS_HPP
+
+#include <stdint.h>
+
+// FreeType handles. Only fontatlas.cpp needs the FreeType headers
+typedef struct FT_LibraryRec_ *FT_Library ;
+typedef struct FT_FaceRec_ *FT_Face ;
+
+///////////////////////////////////////////////////
+//
+// Anti-aliased glyphs from FreeType fonts kept as 8
+// bit coverage. Glyphs are rasterised the first time
+// a face, pixel size and codepoint is used and then
+// found in the cache. Least recently used glyphs are
+// dropped to stay within the memory cap, as for
+// FrameCache. Draw with PCF8833LCD::writeText
+//
+///////////////////////////////////////////////////
+
+// Fonts loaded at once
+#define FONT_ATLAS_MAX_FACES 4
+
+// Default memory cap for coverage. Several hundred glyphs at 16 pixels
+#define FONT_ATLAS_DEFAULT_SIZE 131072
+
+// Hash buckets for finding glyphs. Power of 2
+#define FONT_ATLAS_BUCKETS 256
+
+class FontAtlas{
+public:
+  FontAtlas(uint32_t maxBytes = FONT_ATLAS_DEFAULT_SIZE) ;
+  ~FontAtlas() ;
+
+  struct Glyph{
+    int left ; // pixels from the pen to the first column
+    int top ; // pixels from the baseline up to the first row
+    unsigned int width, height ;
+    int advance ; // pixels to the next pen position
+    const uint8_t *pCoverage ; // width x height, 0 to 255
+  };
+
+  // Load a font file such as a TrueType font. Returns the face number
+  // to use with the other calls or -1 on error
+  int loadFace(const char *szFile) ;
+
+  // Find a glyph at a pixel size, rasterising it if it isn't cached. The
+  // glyph stays valid until the next call to getGlyph. Returns NULL if
+  // the glyph cannot be rasterised or is larger than the cap
+  const Glyph *getGlyph(int face, unsigned int size, uint32_t codepoint) ;
+
+  // Pixels from the top of a line to the baseline and between lines
+  int getAscender(int face, unsigned int size) ;
+  int getLineHeight(int face, unsigned int size) ;
+
+  // Width of UTF-8 text in pixels
+  int textWidth(int face, unsigned int size, const char *szText) ;
+
+  // Read the next codepoint from UTF-8 text and move past it. Invalid
+  // bytes are returned as they are
+  static uint32_t nextCodepoint(const char *&pText) ;
+
+  // Remove all glyphs. Faces and counters are kept
+  void clear() ;
+
+  // Change the memory cap, dropping glyphs if required
+  void setMaxBytes(uint32_t maxBytes) ;
+  uint32_t getMaxBytes(){return m_nMaxBytes;}
+
+  uint32_t getBytes(){return m_nBytes;}
+  uint32_t getGlyphs(){return m_nGlyphs;}
+  uint32_t getHits(){return m_nHits;}
+  uint32_t getMisses(){return m_nMisses;}
+  uint32_t getEvictions(){return m_nEvictions;}
+  void resetStats() ;
+
+protected:
+  struct Entry{
+    int face ;
+    unsigned int size ;
+    uint32_t codepoint ;
+    Glyph glyph ;
+    uint32_t len ; // coverage bytes
+    Entry *pPrev, *pNext ; // most to least recently used
+    Entry *pHashNext ;
+  };
+
+  static unsigned int bucket(int face, unsigned int size, uint32_t codepoint) ;
+
+  // Select a pixel size on a face. FreeType is only called on a change
+  bool setSize(int face, unsigned int size) ;
+
+  // Rasterise a glyph into a new entry
+  Entry *rasterise(int face, unsigned int size, uint32_t codepoint) ;
+
+  void unlink(Entry *pEntry) ;
+  void pushFront(Entry *pEntry) ;
+  void remove(Entry *pEntry) ;
+
+  // Drop least recently used glyphs until extra bytes will fit
+  void trim(uint32_t extra) ;
+
+  FT_Library m_library ;
+  FT_Face m_faces[FONT_ATLAS_MAX_FACES] ;
+  unsigned int m_nSizes[FONT_ATLAS_MAX_FACES] ; // pixel size set on each face
+  int m_nFaces ;
+
+  Entry *m_pHead ; // most recently used
+  Entry *m_pTail ; // least recently used
+  Entry *m_buckets[FONT_ATLAS_BUCKETS] ;
+  uint32_t m_nMaxBytes ;
+  uint32_t m_nBytes ;
+  uint32_t m_nGlyphs ;
+  uint32_t m_nHits ;
+  uint32_t m_nMisses ;
+  uint32_t m_nEvictions ;
+};
+
+#endif // __FONT_ATLAS_HPP
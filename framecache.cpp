@@ -0,0 +1,146 @@
+#include "framecache.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+FrameCache::FrameCache(uint32_t maxBytes)
+{
+  m_pHead = NULL ;
+  m_pTail = NULL ;
+  m_nMaxBytes = maxBytes ;
+  m_nBytes = 0 ;
+  m_nFrames = 0 ;
+  resetStats() ;
+}
+
+FrameCache::~FrameCache()
+{
+  clear() ;
+}
+
+uint64_t FrameCache::hash(const void *pData, uint32_t len, uint64_t seed)
+{
+  const uint8_t *p = (const uint8_t *)pData ;
+  uint64_t h = seed ^ len, word = 0 ;
+
+  // Mix a word at a time. Frames are tens of kilobytes so
+  // a byte at a time hash would cost as much as the encode
+  for (; len >= 8; len -= 8, p += 8){
+    memcpy(&word, p, 8) ;
+    h = (h ^ word) * 0x100000001b3ULL ;
+    h ^= h >> 29 ;
+  }
+  for (; len > 0; len--, p++){
+    h = (h ^ *p) * 0x100000001b3ULL ;
+  }
+
+  // Final avalanche so similar frames don't share low bits
+  h ^= h >> 33 ;
+  h *= 0xff51afd7ed558ccdULL ;
+  h ^= h >> 33 ;
+
+  return h ;
+}
+
+const uint8_t *FrameCache::find(uint64_t key, uint32_t &len)
+{
+  for (Entry *pEntry = m_pHead; pEntry; pEntry = pEntry->pNext){
+    if (pEntry->key == key){
+      if (pEntry != m_pHead){
+	unlink(pEntry) ;
+	pushFront(pEntry) ;
+      }
+      m_nHits++ ;
+      len = pEntry->len ;
+      return pEntry->pData ;
+    }
+  }
+
+  m_nMisses++ ;
+  return NULL ;
+}
+
+uint8_t *FrameCache::add(uint64_t key, uint32_t len)
+{
+  Entry *pEntry = NULL ;
+
+  if (len > m_nMaxBytes) return NULL ;
+
+  // Replace an existing frame with the same key
+  for (pEntry = m_pHead; pEntry; pEntry = pEntry->pNext){
+    if (pEntry->key == key){
+      remove(pEntry) ;
+      break ;
+    }
+  }
+
+  trim(len) ;
+
+  pEntry = new Entry ;
+  if (!pEntry) return NULL ;
+  pEntry->pData = new uint8_t[len] ;
+  if (!pEntry->pData){
+    delete pEntry ;
+    return NULL ;
+  }
+  pEntry->key = key ;
+  pEntry->len = len ;
+  pushFront(pEntry) ;
+
+  m_nBytes += len ;
+  m_nFrames++ ;
+
+  return pEntry->pData ;
+}
+
+void FrameCache::clear()
+{
+  while (m_pHead) remove(m_pHead) ;
+}
+
+void FrameCache::setMaxBytes(uint32_t maxBytes)
+{
+  m_nMaxBytes = maxBytes ;
+  trim(0) ;
+}
+
+void FrameCache::resetStats()
+{
+  m_nHits = 0 ;
+  m_nMisses = 0 ;
+  m_nEvictions = 0 ;
+}
+
+void FrameCache::unlink(Entry *pEntry)
+{
+  if (pEntry->pPrev) pEntry->pPrev->pNext = pEntry->pNext ;
+  else m_pHead = pEntry->pNext ;
+
+  if (pEntry->pNext) pEntry->pNext->pPrev = pEntry->pPrev ;
+  else m_pTail = pEntry->pPrev ;
+}
+
+void FrameCache::pushFront(Entry *pEntry)
+{
+  pEntry->pPrev = NULL ;
+  pEntry->pNext = m_pHead ;
+  if (m_pHead) m_pHead->pPrev = pEntry ;
+  else m_pTail = pEntry ;
+  m_pHead = pEntry ;
+}
+
+void FrameCache::remove(Entry *pEntry)
+{
+  unlink(pEntry) ;
+  m_nBytes -= pEntry->len ;
+  m_nFrames-- ;
+  delete[] pEntry->pData ;
+  delete pEntry ;
+}
+
+void FrameCache::trim(uint32_t extra)
+{
+  while (m_pTail && m_nBytes + extra > m_nMaxBytes){
+    remove(m_pTail) ;
+    m_nEvictions++ ;
+  }
+}
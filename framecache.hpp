@@ -0,0 +1,83 @@
+#ifndef __FRAME_CACHE_HPP
+#define __FRAME_CACHE_HPP
+
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// Bounded cache of encoded display frames keyed by
+// a 64 bit hash. Used by the drivers to skip image
+// conversion and encoding for frames which have already
+// been shown, such as looping animations.
+// Least recently used frames are dropped to stay
+// within the memory cap
+//
+///////////////////////////////////////////////////
+
+// Default memory cap. Enough for several full 12 bit PCF8833 frames
+#define FRAME_CACHE_DEFAULT_SIZE 524288
+
+// Starting value for hash()
+#define FRAME_CACHE_SEED 0xcbf29ce484222325ULL
+
+class FrameCache{
+public:
+  FrameCache(uint32_t maxBytes = FRAME_CACHE_DEFAULT_SIZE) ;
+  ~FrameCache() ;
+
+  // Hash a block of memory. Chain calls by passing the previous
+  // result as the seed to build a key from several blocks
+  static uint64_t hash(const void *pData, uint32_t len, uint64_t seed = FRAME_CACHE_SEED) ;
+
+  // Find a frame. Returns NULL and counts a miss if the key isn't cached.
+  // A hit becomes the most recently used frame
+  const uint8_t *find(uint64_t key, uint32_t &len) ;
+
+  // Add a frame of len bytes and return the buffer for the caller to fill.
+  // Replaces any frame with the same key. Returns NULL if the frame is
+  // larger than the cap or memory cannot be allocated
+  uint8_t *add(uint64_t key, uint32_t len) ;
+
+  // Remove all frames. Counters are kept
+  void clear() ;
+
+  // Change the memory cap, dropping frames if required
+  void setMaxBytes(uint32_t maxBytes) ;
+  uint32_t getMaxBytes(){return m_nMaxBytes;}
+
+  uint32_t getBytes(){return m_nBytes;}
+  uint32_t getFrames(){return m_nFrames;}
+  uint32_t getHits(){return m_nHits;}
+  uint32_t getMisses(){return m_nMisses;}
+  uint32_t getEvictions(){return m_nEvictions;}
+  void resetStats() ;
+
+protected:
+  // Frames are kept in a list from most to least recently used.
+  // Caches are expected to hold a handful of frames so finding
+  // by walking the list is quicker than maintaining a table
+  struct Entry{
+    uint64_t key ;
+    uint8_t *pData ;
+    uint32_t len ;
+    Entry *pPrev, *pNext ;
+  };
+
+  void unlink(Entry *pEntry) ;
+  void pushFront(Entry *pEntry) ;
+  void remove(Entry *pEntry) ;
+
+  // Drop least recently used frames until extra bytes will fit
+  void trim(uint32_t extra) ;
+
+  Entry *m_pHead ; // most recently used
+  Entry *m_pTail ; // least recently used
+  uint32_t m_nMaxBytes ;
+  uint32_t m_nBytes ;
+  uint32_t m_nFrames ;
+  uint32_t m_nHits ;
+  uint32_t m_nMisses ;
+  uint32_t m_nEvictions ;
+};
+
+#endif // __FRAME_CACHE_HPP
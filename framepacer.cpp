@@ -0,0 +1,53 @@
+#include "framepacer.hpp"
+#include <time.h>
+
+FramePacer::FramePacer(IHardwareTimer &time, unsigned int fps)
+{
+  m_pTime = &time ;
+  m_nFrames = 0 ;
+  m_nLate = 0 ;
+  setFPS(fps) ;
+  reset() ;
+}
+
+uint64_t FramePacer::timeMicros()
+{
+  struct timespec ts ;
+  clock_gettime(CLOCK_MONOTONIC, &ts) ;
+  return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000) ;
+}
+
+void FramePacer::setFPS(unsigned int fps)
+{
+  if (fps == 0) fps = 1 ;
+  m_nFPS = fps ;
+  m_nPeriod = 1000000 / fps ;
+}
+
+void FramePacer::reset()
+{
+  m_nLast = timeMicros() ;
+  m_nNext = m_nLast + m_nPeriod ;
+}
+
+unsigned int FramePacer::wait()
+{
+  uint64_t now = timeMicros() ;
+  unsigned int elapsed = 0 ;
+
+  if (now < m_nNext){
+    m_pTime->microSleep(m_nNext - now) ;
+    now = timeMicros() ;
+    m_nNext += m_nPeriod ;
+  }else{
+    // Running late. Don't try to catch up on missed frames
+    m_nLate++ ;
+    m_nNext = now + m_nPeriod ;
+  }
+
+  elapsed = (now - m_nLast) / 1000 ;
+  m_nLast = now ;
+  m_nFrames++ ;
+
+  return elapsed ;
+}
@@ -0,0 +1,46 @@
+#ifndef __FRAME_PACER_HPP
+#define __FRAME_PACER_HPP
+
+#include "hardware.hpp"
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// Paces a display loop to a target frame rate.
+// Call wait() once per frame. It sleeps for whatever
+// is left of the frame and returns the elapsed time
+// which can be passed on to timed effects
+//
+///////////////////////////////////////////////////
+
+class FramePacer{
+public:
+  FramePacer(IHardwareTimer &time, unsigned int fps = 30) ;
+
+  void setFPS(unsigned int fps) ;
+  unsigned int getFPS(){return m_nFPS;}
+
+  // Sleep until the next frame is due. Returns milliseconds since the
+  // previous call. Frames which overrun don't sleep and are counted as late
+  unsigned int wait() ;
+
+  // Start timing from now, for example after a long pause
+  void reset() ;
+
+  uint32_t getFrames(){return m_nFrames;}
+  uint32_t getLateFrames(){return m_nLate;}
+
+  // Monotonic clock in microseconds
+  static uint64_t timeMicros() ;
+
+protected:
+  IHardwareTimer *m_pTime ;
+  unsigned int m_nFPS ;
+  uint64_t m_nPeriod ; // microseconds per frame
+  uint64_t m_nNext ; // time the next frame is due
+  uint64_t m_nLast ; // time of the last wait
+  uint32_t m_nFrames ;
+  uint32_t m_nLate ;
+};
+
+#endif // __FRAME_PACER_HPP
@@ -0,0 +1,170 @@
+#include "framepresenter.hpp"
+#include "framepacer.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Set in m_nState when the middle frame is waiting to be sent
+#define FRAME_NEW 4
+#define FRAME_INDEX 3
+
+FramePresenter::FramePresenter()
+{
+  for (int i=0; i < 3; i++){
+    m_pFrames[i] = NULL ;
+    m_published[i] = 0 ;
+  }
+  m_nFrameSize = 0 ;
+  m_nState = 1 ;
+  m_nBack = 0 ;
+  m_nFront = 2 ;
+  m_pfnSend = NULL ;
+  m_pContext = NULL ;
+  m_bRunning = false ;
+  m_bQuit = false ;
+  m_nPublished = 0 ;
+  m_nDropped = 0 ;
+  m_nPresented = 0 ;
+  m_nFailed = 0 ;
+  m_nSendMicros = 0 ;
+  m_nMaxLatency = 0 ;
+  pthread_mutex_init(&m_statsLock, NULL) ;
+}
+
+FramePresenter::~FramePresenter()
+{
+  stop() ;
+  delete[] m_pFrames[0] ; // one block for all three frames
+  pthread_mutex_destroy(&m_statsLock) ;
+}
+
+bool FramePresenter::start(uint32_t frameSize, SendFrame pfnSend, void *pContext)
+{
+  if (m_bRunning){
+    fprintf(stderr, "start: presenter already running\n") ;
+    return false ;
+  }
+  if (frameSize == 0 || !pfnSend){
+    fprintf(stderr, "start: no frame size or send function\n") ;
+    return false ;
+  }
+
+  // Frames are kept between starts when the size is the same
+  if (frameSize != m_nFrameSize){
+    delete[] m_pFrames[0] ;
+    m_pFrames[0] = new uint8_t[frameSize * 3] ;
+    m_pFrames[1] = m_pFrames[0] + frameSize ;
+    m_pFrames[2] = m_pFrames[1] + frameSize ;
+    m_nFrameSize = frameSize ;
+  }
+
+  m_nState = 1 ;
+  m_nBack = 0 ;
+  m_nFront = 2 ;
+  m_pfnSend = pfnSend ;
+  m_pContext = pContext ;
+  m_bQuit = false ;
+  m_nPublished = m_nDropped = 0 ;
+  m_nPresented = m_nFailed = m_nMaxLatency = 0 ;
+  m_nSendMicros = 0 ;
+
+  if (sem_init(&m_ready, 0, 0) != 0){
+    fprintf(stderr, "start: cannot create semaphore\n") ;
+    return false ;
+  }
+  if (pthread_create(&m_thread, NULL, presentThread, this) != 0){
+    fprintf(stderr, "start: cannot start present thread\n") ;
+    sem_destroy(&m_ready) ;
+    return false ;
+  }
+  m_bRunning = true ;
+
+  return true ;
+}
+
+void FramePresenter::stop()
+{
+  if (!m_bRunning) return ;
+
+  __atomic_store_n(&m_bQuit, true, __ATOMIC_RELEASE) ;
+  sem_post(&m_ready) ;
+  pthread_join(m_thread, NULL) ;
+  sem_destroy(&m_ready) ;
+  m_bRunning = false ;
+}
+
+void FramePresenter::publish()
+{
+  uint32_t old = 0 ;
+
+  if (!m_bRunning) return ;
+
+  m_published[m_nBack] = FramePacer::timeMicros() ;
+  m_nPublished++ ;
+
+  // Swap the back frame into the middle. Release makes the frame contents
+  // visible to the present thread when it takes the middle frame
+  old = __atomic_exchange_n(&m_nState, m_nBack | FRAME_NEW, __ATOMIC_ACQ_REL) ;
+  m_nBack = old & FRAME_INDEX ;
+
+  // Only wake the present thread for a new frame. A frame still waiting
+  // has been replaced so the thread is already due to wake
+  if (old & FRAME_NEW) m_nDropped++ ;
+  else sem_post(&m_ready) ;
+}
+
+void FramePresenter::getStats(PresenterStats &stats)
+{
+  stats.published = m_nPublished ;
+  stats.dropped = m_nDropped ;
+
+  pthread_mutex_lock(&m_statsLock) ;
+  stats.presented = m_nPresented ;
+  stats.failed = m_nFailed ;
+  stats.sendMicros = m_nSendMicros ;
+  stats.maxLatency = m_nMaxLatency ;
+  pthread_mutex_unlock(&m_statsLock) ;
+}
+
+void *FramePresenter::presentThread(void *pArg)
+{
+  ((FramePresenter *)pArg)->present() ;
+
+  return NULL ;
+}
+
+void FramePresenter::present()
+{
+  uint32_t old = 0, latency = 0 ;
+  uint64_t start = 0, end = 0 ;
+  bool bOK = false, bQuit = false ;
+
+  for(;;){
+    while (sem_wait(&m_ready) != 0 && errno == EINTR) ;
+
+    // Read before the frame state so a frame published before stop is
+    // seen and sent before leaving
+    bQuit = __atomic_load_n(&m_bQuit, __ATOMIC_ACQUIRE) ;
+
+    // Only this thread clears FRAME_NEW so a new frame seen here is
+    // still there for the exchange
+    if (__atomic_load_n(&m_nState, __ATOMIC_ACQUIRE) & FRAME_NEW){
+      old = __atomic_exchange_n(&m_nState, m_nFront, __ATOMIC_ACQ_REL) ;
+      m_nFront = old & FRAME_INDEX ;
+
+      start = FramePacer::timeMicros() ;
+      bOK = m_pfnSend(m_pContext, m_pFrames[m_nFront]) ;
+      end = FramePacer::timeMicros() ;
+      latency = (uint32_t)(end - m_published[m_nFront]) ;
+
+      pthread_mutex_lock(&m_statsLock) ;
+      if (bOK) m_nPresented++ ;
+      else m_nFailed++ ;
+      m_nSendMicros += end - start ;
+      if (latency > m_nMaxLatency) m_nMaxLatency = latency ;
+      pthread_mutex_unlock(&m_statsLock) ;
+    }
+
+    if (bQuit) break ;
+  }
+}
@@ -0,0 +1,95 @@
+#ifndef __FRAME_PRESENTER_HPP
+#define __FRAME_PRESENTER_HPP
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// Triple buffered frame handoff to a present thread.
+// The drawing thread fills the back frame and
+// publishes it, then carries on with another frame
+// straight away. The present thread always sends
+// the newest published frame so older frames not
+// yet sent are dropped rather than queued.
+//
+// Frames are swapped with an atomic exchange so
+// publishing never waits on the present thread.
+// A semaphore wakes the present thread
+//
+///////////////////////////////////////////////////
+
+class FramePresenter{
+public:
+  FramePresenter() ;
+  ~FramePresenter() ;
+
+  // Sends a frame to the display. Called on the present thread
+  typedef bool (*SendFrame)(void *pContext, uint8_t *pFrame) ;
+
+  // Counters since start. Times are in microseconds
+  struct PresenterStats{
+    uint32_t published ;
+    uint32_t presented ;
+    uint32_t dropped ; // replaced before they were sent
+    uint32_t failed ;
+    uint64_t sendMicros ; // total time sending
+    uint32_t maxLatency ; // longest from publish to sent
+  };
+
+  // Allocate 3 frames of frameSize bytes and start the present thread
+  bool start(uint32_t frameSize, SendFrame pfnSend, void *pContext) ;
+
+  // Send any frame still waiting and stop the thread
+  void stop() ;
+
+  bool isRunning(){return m_bRunning;}
+  uint32_t getFrameSize(){return m_nFrameSize;}
+
+  // Frame owned by the drawing thread. Always free to write
+  uint8_t *getBack(){return m_pFrames[m_nBack];}
+
+  // Hand the back frame to the present thread and take a free frame
+  // as the new back frame. Never waits
+  void publish() ;
+
+  // Call from the thread which publishes
+  void getStats(PresenterStats &stats) ;
+
+protected:
+  static void *presentThread(void *pArg) ;
+  void present() ;
+
+  uint8_t *m_pFrames[3] ;
+  uint32_t m_nFrameSize ;
+
+  // Middle frame index in the low bits and FRAME_NEW when it hasn't been
+  // sent. The back frame belongs to the drawing thread and the front to the
+  // present thread. The 3 indexes are always different
+  uint32_t m_nState ;
+  unsigned int m_nBack ;
+  unsigned int m_nFront ;
+  uint64_t m_published[3] ; // publish time of each frame
+
+  SendFrame m_pfnSend ;
+  void *m_pContext ;
+
+  pthread_t m_thread ;
+  sem_t m_ready ;
+  bool m_bRunning ;
+  bool m_bQuit ;
+
+  // Drawing thread counters
+  uint32_t m_nPublished ;
+  uint32_t m_nDropped ;
+
+  // Present thread counters
+  pthread_mutex_t m_statsLock ;
+  uint32_t m_nPresented ;
+  uint32_t m_nFailed ;
+  uint64_t m_nSendMicros ;
+  uint32_t m_nMaxLatency ;
+};
+
+#endif // __FRAME_PRESENTER_HPP
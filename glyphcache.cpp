@@ -0,0 +1,89 @@
+// macro required for display image to support friend class
+#define DISPLAY_GLYPHCACHE
+
+#include "glyphcache.hpp"
+#include "displayimage.hpp"
+#include <stdio.h>
+#include <string.h>
+
+GlyphCache::GlyphCache()
+{
+  clear() ;
+}
+
+void GlyphCache::clear()
+{
+  memset(m_glyphs, 0, sizeof(m_glyphs)) ;
+  m_height = 0 ;
+}
+
+bool GlyphCache::load(DisplayFont &font)
+{
+  DisplayImage img ;
+  char szChar[2] = {0, 0} ;
+
+  clear() ;
+  for (int c=GLYPH_FIRST; c < GLYPH_FIRST + GLYPH_COUNT; c++){
+    szChar[0] = (char)c ;
+    if (!font.createText(szChar, &img) || img.m_colourbitdepth != 1){
+      fprintf(stderr, "load: cannot create glyph %d\n", c) ;
+      clear() ;
+      return false ;
+    }
+    if (!setGlyph(szChar[0], img.m_img, img.m_stride, img.m_width, img.m_height)){
+      clear() ;
+      return false ;
+    }
+  }
+
+  return true ;
+}
+
+unsigned int GlyphCache::textWidth(const char *szText)
+{
+  unsigned int width = 0 ;
+
+  for (; *szText; szText++) width += glyph(*szText).width ;
+
+  return width ;
+}
+
+bool GlyphCache::setGlyph(char c, const uint8_t *pBits, unsigned int stride, unsigned int width, unsigned int height)
+{
+  unsigned int n = (unsigned char)c ;
+  const uint8_t *pRow = NULL ;
+
+  if (n < GLYPH_FIRST || n >= GLYPH_FIRST + GLYPH_COUNT){
+    fprintf(stderr, "setGlyph: character %u is not cached\n", n) ;
+    return false ;
+  }
+  if (width > GLYPH_MAX_SIZE || height == 0 || height > GLYPH_MAX_SIZE){
+    fprintf(stderr, "setGlyph: glyph %u is %u x %u, limit is %d\n", n, width, height, GLYPH_MAX_SIZE) ;
+    return false ;
+  }
+  if (m_height > 0 && height != m_height){
+    fprintf(stderr, "setGlyph: glyph %u height %u differs from %u\n", n, height, m_height) ;
+    return false ;
+  }
+
+  Glyph &g = m_glyphs[n - GLYPH_FIRST] ;
+  memset(&g, 0, sizeof(g)) ;
+  g.width = width ;
+
+  for (unsigned int y=0; y < height; y++){
+    pRow = pBits + (y * stride) ;
+    memcpy(g.rows[y], pRow, (width + 7) / 8) ;
+    for (unsigned int x=0; x < width; x++){
+      if ((pRow[x / 8] >> (x % 8)) & 1) g.columns[x] |= 1u << y ;
+    }
+  }
+
+  // Clear any bits past the width in the last row byte
+  if (width % 8){
+    for (unsigned int y=0; y < height; y++) g.rows[y][width / 8] &= (uint8_t)((1 << (width % 8)) - 1) ;
+  }
+
+  m_height = height ;
+
+  return true ;
+}
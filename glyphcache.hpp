@@ -0,0 +1,67 @@
+#ifndef __GLYPH_CACHE_HPP
+#define __GLYPH_CACHE_HPP
+
+#include <stdint.h>
+
+class DisplayFont ;
+
+///////////////////////////////////////////////////
+//
+// Glyphs of a font expanded once for writeText.
+// Each glyph is kept as 1 bit rows, which the LCD
+// expands through its colour tables, and as bit
+// columns which OR straight into SDD1306 pages.
+// Drawing a string then needs no text image.
+// A cache loaded once can be used by any display
+//
+///////////////////////////////////////////////////
+
+// Printable ASCII. Other characters draw as a space
+#define GLYPH_FIRST 32
+#define GLYPH_COUNT 95
+
+// Largest glyph width and height
+#define GLYPH_MAX_SIZE 32
+
+class GlyphCache{
+public:
+  GlyphCache() ;
+
+  // Expand every glyph of a font. The font must draw 1 bit images
+  bool load(DisplayFont &font) ;
+
+  bool isLoaded(){return m_height > 0;}
+
+  // Height of every glyph
+  unsigned int getHeight(){return m_height;}
+
+  // Width of a string in pixels
+  unsigned int textWidth(const char *szText) ;
+
+protected:
+  friend class SDD1306OLED ;
+  friend class PCF8833LCD ;
+
+  struct Glyph{
+    unsigned int width ;
+    uint32_t columns[GLYPH_MAX_SIZE] ; // bit n is row n
+    uint8_t rows[GLYPH_MAX_SIZE][GLYPH_MAX_SIZE / 8] ; // least significant bit first
+  };
+
+  // Remove all glyphs before loading a font
+  void clear() ;
+
+  // Expand a glyph from a 1 bit image. Every glyph must be the same height
+  bool setGlyph(char c, const uint8_t *pBits, unsigned int stride, unsigned int width, unsigned int height) ;
+
+  const Glyph &glyph(char c)
+  {
+    unsigned int n = (unsigned char)c ;
+    return m_glyphs[n < GLYPH_FIRST || n >= GLYPH_FIRST + GLYPH_COUNT?0:n - GLYPH_FIRST] ;
+  }
+
+  Glyph m_glyphs[GLYPH_COUNT] ;
+  unsigned int m_height ;
+};
+
+#endif // __GLYPH_CACHE_HPP
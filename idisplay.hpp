@@ -0,0 +1,88 @@
+#ifndef __IDISPLAY_HPP
+#define __IDISPLAY_HPP
+
+#include "imagescale.hpp"
+#include <stdint.h>
+
+// displayimage.hpp is left to the drivers as they define their
+// friend macros before including it
+class DisplayImage ;
+class GlyphCache ;
+
+// Create a pure virtual base class for the display drivers so
+// code can draw to any panel, such as mirroring one frame to
+// several displays
+class IDisplay{
+public:
+  virtual ~IDisplay(){}
+
+  // Image write modes. Overwrite replaces pixels, overlay adds the
+  // set pixels and exclusive xors them
+  enum enMode{overwrite, overlay, exclusive} ;
+
+  // Size of the display after rotation
+  virtual unsigned int getWidth() = 0 ;
+  virtual unsigned int getHeight() = 0 ;
+
+  // Turn the display off and on. Contents remain in memory
+  virtual bool turnOff() = 0 ;
+  virtual bool turnOn() = 0 ;
+
+  // Power sequences which return at each delay instead of sleeping, so
+  // one thread can bring up several panels at once. See PanelSequencer
+  enum enSequence{sequenceInitialise, sequenceTurnOn, sequenceTurnOff} ;
+
+  // Set up a sequence to run with stepSequence
+  virtual bool startSequence(enSequence eSequence) = 0 ;
+
+  // Run the sequence up to its next delay. Returns the milliseconds to
+  // wait before the next step, 0 once finished or -1 on failure
+  virtual int stepSequence() = 0 ;
+
+  // Set where the 0 row origin is on the display
+  virtual bool setYOrigin(bool bTop) = 0 ;
+
+  // Rotate by 0, 90, 180 or 270 degrees. Redraw after changing
+  virtual bool setRotation(unsigned int degrees) = 0 ;
+  virtual unsigned int getRotation() = 0 ;
+
+  // Panel registers. The contrast range depends on the display
+  virtual bool setContrast(int contrast) = 0 ;
+  virtual int getContrast() = 0 ;
+  virtual bool setInverse(bool bInverse) = 0 ;
+
+  // Clear the display buffer to the background
+  virtual bool clearImage() = 0 ;
+
+  // Limit clearImage and image writes to a region of the display
+  virtual bool setClip(int x, int y, unsigned int width, unsigned int height) = 0 ;
+  virtual void clearClip() = 0 ;
+
+  // Load an image object into the display buffer.
+  // Call display() to send it to the panel
+  virtual bool writeImage(DisplayImage &img, enum enMode eMode, int xoffset=0, int yoffset=0) = 0 ;
+
+  // Draw text from a glyph cache into the display buffer with its top
+  // left at xoffset, yoffset. Overwrite replaces the glyph cells
+  virtual bool writeText(GlyphCache &glyphs, const char *szText, enum enMode eMode, int xoffset=0, int yoffset=0) = 0 ;
+
+  // Vector drawing into the display buffer. Overwrite and overlay draw
+  // the shape and exclusive inverts it
+  virtual bool drawHLine(int x, int y, unsigned int width, enum enMode eMode = overlay) = 0 ;
+  virtual bool drawVLine(int x, int y, unsigned int height, enum enMode eMode = overlay) = 0 ;
+  virtual bool drawLine(int x0, int y0, int x1, int y1, enum enMode eMode = overlay) = 0 ;
+  virtual bool drawRect(int x, int y, unsigned int width, unsigned int height, bool bFill = false, enum enMode eMode = overlay) = 0 ;
+  virtual bool drawCircle(int cx, int cy, unsigned int radius, bool bFill = false, enum enMode eMode = overlay) = 0 ;
+
+  // Scale an image to width x height and overwrite the display buffer
+  virtual bool writeScaled(DisplayImage &img, ImageScale::enFilter eFilter, int xoffset, int yoffset,
+			   unsigned int width, unsigned int height) = 0 ;
+
+  // Write the display buffer to the panel
+  virtual bool display() = 0 ;
+
+  // Overwrite the display buffer with an image and display it
+  virtual bool displayImage(DisplayImage &img, int xoffset=0, int yoffset=0) = 0 ;
+};
+
+#endif // __IDISPLAY_HPP
@@ -0,0 +1,336 @@
+#include "imagescale.hpp"
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMAGE_SCALE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_SCALE_SSE2
+#endif
+
+ImageScale::ImageScale()
+{
+  m_pImg = NULL ;
+  m_srcWidth = m_srcHeight = m_stride = m_bpp = 0 ;
+  m_nChannels = 0 ;
+  m_dstWidth = m_dstHeight = 0 ;
+  m_eFilter = nearest ;
+  m_xStep = m_yStep = 0 ;
+  m_pColumns = NULL ;
+  m_pCounts = NULL ;
+  m_pExpanded[0] = m_pExpanded[1] = NULL ;
+  m_nExpanded[0] = m_nExpanded[1] = -1 ;
+  m_nNextExpand = 0 ;
+  m_pBlend = NULL ;
+  m_pSum = NULL ;
+}
+
+ImageScale::~ImageScale()
+{
+  freeBuffers() ;
+}
+
+void ImageScale::freeBuffers()
+{
+  delete[] m_pColumns ;
+  delete[] m_pCounts ;
+  delete[] m_pExpanded[0] ;
+  delete[] m_pExpanded[1] ;
+  delete[] m_pBlend ;
+  delete[] m_pSum ;
+  m_pColumns = NULL ;
+  m_pCounts = NULL ;
+  m_pExpanded[0] = m_pExpanded[1] = NULL ;
+  m_pBlend = NULL ;
+  m_pSum = NULL ;
+}
+
+bool ImageScale::setSource(const uint8_t *pImg, unsigned int width, unsigned int height,
+			   unsigned int stride, unsigned int bpp)
+{
+  // Positions are signed 16.16 so sizes must fit in 15 bits
+  if (!pImg || width == 0 || height == 0 || width > IMAGE_SCALE_MAX_SIZE || height > IMAGE_SCALE_MAX_SIZE) return false ;
+  if (bpp != 1 && bpp != 32) return false ;
+
+  freeBuffers() ;
+  m_pImg = pImg ;
+  m_srcWidth = width ;
+  m_srcHeight = height ;
+  m_stride = stride ;
+  m_bpp = bpp ;
+  m_nChannels = bpp == 1?1:4 ;
+  m_dstWidth = m_dstHeight = 0 ;
+
+  if (bpp == 1){
+    m_pExpanded[0] = new uint8_t[width] ;
+    m_pExpanded[1] = new uint8_t[width] ;
+  }
+  m_nExpanded[0] = m_nExpanded[1] = -1 ;
+  m_nNextExpand = 0 ;
+  m_pBlend = new uint8_t[width * m_nChannels] ;
+  m_pSum = new uint16_t[width * m_nChannels] ;
+
+  return true ;
+}
+
+bool ImageScale::setTarget(unsigned int width, unsigned int height, enFilter eFilter)
+{
+  uint32_t x0 = 0, x1 = 0 ;
+  int32_t pos = 0 ;
+
+  if (!m_pImg || width == 0 || height == 0 || width > IMAGE_SCALE_MAX_SIZE || height > IMAGE_SCALE_MAX_SIZE) return false ;
+
+  delete[] m_pColumns ;
+  delete[] m_pCounts ;
+  m_pColumns = new uint32_t[width] ;
+  m_pCounts = new uint16_t[width] ;
+
+  m_dstWidth = width ;
+  m_dstHeight = height ;
+  m_eFilter = eFilter ;
+  m_xStep = (m_srcWidth << 16) / width ;
+  m_yStep = (m_srcHeight << 16) / height ;
+
+  for (unsigned int x=0; x < width; x++){
+    switch(eFilter){
+    case nearest:
+      // Centre of the target pixel
+      m_pColumns[x] = ((x * m_xStep) + (m_xStep / 2)) >> 16 ;
+      if (m_pColumns[x] >= m_srcWidth) m_pColumns[x] = m_srcWidth - 1 ;
+      break ;
+    case bilinear:
+      // Pixel centres line up, so the position is half a pixel back
+      pos = (int32_t)((x * m_xStep) + (m_xStep / 2)) - 0x8000 ;
+      if (pos < 0) pos = 0 ;
+      if (pos > (int32_t)((m_srcWidth - 1) << 16)) pos = (m_srcWidth - 1) << 16 ;
+      m_pColumns[x] = pos ;
+      break ;
+    default:
+      // Every column which starts under the target pixel, and at least one
+      x0 = (x * m_srcWidth) / width ;
+      x1 = ((x + 1) * m_srcWidth) / width ;
+      if (x1 <= x0) x1 = x0 + 1 ;
+      m_pColumns[x] = x0 ;
+      m_pCounts[x] = x1 - x0 ;
+      break ;
+    }
+  }
+
+  return true ;
+}
+
+const uint8_t *ImageScale::sourceRow(unsigned int y, const uint8_t *pKeep)
+{
+  int n = 0 ;
+
+  if (m_bpp == 32) return m_pImg + (y * m_stride) ;
+
+  if (m_nExpanded[0] == (int)y) return m_pExpanded[0] ;
+  if (m_nExpanded[1] == (int)y) return m_pExpanded[1] ;
+
+  // Replace the older row unless it is still in use. Bilinear
+  // needs 2 rows at a time
+  n = m_nNextExpand ;
+  if (m_pExpanded[n] == pKeep) n = 1 - n ;
+  m_nNextExpand = 1 - n ;
+  expand1bpp(m_pImg + (y * m_stride), m_pExpanded[n], m_srcWidth) ;
+  m_nExpanded[n] = y ;
+
+  return m_pExpanded[n] ;
+}
+
+void ImageScale::scaleRow(unsigned int y, uint8_t *pDst)
+{
+  if (!m_pImg || m_dstWidth == 0 || y >= m_dstHeight) return ;
+
+  switch(m_eFilter){
+  case nearest:
+    scaleNearest(y, pDst) ;
+    break ;
+  case bilinear:
+    scaleBilinear(y, pDst) ;
+    break ;
+  default:
+    scaleBox(y, pDst) ;
+    break ;
+  }
+}
+
+void ImageScale::scaleNearest(unsigned int y, uint8_t *pDst)
+{
+  unsigned int sy = ((y * m_yStep) + (m_yStep / 2)) >> 16 ;
+  const uint8_t *pSrc = NULL ;
+  uint32_t word = 0 ;
+
+  if (sy >= m_srcHeight) sy = m_srcHeight - 1 ;
+  pSrc = sourceRow(sy) ;
+
+  if (m_nChannels == 1){
+    for (unsigned int x=0; x < m_dstWidth; x++) pDst[x] = pSrc[m_pColumns[x]] ;
+    return ;
+  }
+
+  // RGBA pixels move as words
+  for (unsigned int x=0; x < m_dstWidth; x++){
+    memcpy(&word, pSrc + (m_pColumns[x] * 4), 4) ;
+    memcpy(pDst + (x * 4), &word, 4) ;
+  }
+}
+
+void ImageScale::scaleBilinear(unsigned int y, uint8_t *pDst)
+{
+  int32_t pos = (int32_t)((y * m_yStep) + (m_yStep / 2)) - 0x8000 ;
+  unsigned int y0 = 0, y1 = 0, x0 = 0, w = 0, c = m_nChannels ;
+  const uint8_t *pA = NULL, *pB = NULL, *p = NULL ;
+
+  if (pos < 0) pos = 0 ;
+  if (pos > (int32_t)((m_srcHeight - 1) << 16)) pos = (m_srcHeight - 1) << 16 ;
+  y0 = pos >> 16 ;
+  y1 = y0 + 1 < m_srcHeight?y0 + 1:y0 ;
+  w = (pos >> 8) & 0xFF ;
+
+  // Blend the 2 source rows, then across each row
+  pA = sourceRow(y0) ;
+  if (w == 0){
+    p = pA ;
+  }else{
+    pB = sourceRow(y1, pA) ;
+    blendRows(pA, pB, m_pBlend, m_srcWidth * c, w) ;
+    p = m_pBlend ;
+  }
+
+  for (unsigned int x=0; x < m_dstWidth; x++){
+    x0 = m_pColumns[x] >> 16 ;
+    w = (m_pColumns[x] >> 8) & 0xFF ;
+    if (w == 0 || x0 + 1 >= m_srcWidth){
+      for (unsigned int i=0; i < c; i++) pDst[(x * c) + i] = p[(x0 * c) + i] ;
+    }else{
+      for (unsigned int i=0; i < c; i++){
+	pDst[(x * c) + i] = ((p[(x0 * c) + i] * (256 - w)) + (p[((x0 + 1) * c) + i] * w) + 128) >> 8 ;
+      }
+    }
+  }
+}
+
+void ImageScale::scaleBox(unsigned int y, uint8_t *pDst)
+{
+  unsigned int y0 = (y * m_srcHeight) / m_dstHeight ;
+  unsigned int y1 = ((y + 1) * m_srcHeight) / m_dstHeight ;
+  unsigned int rows = 0, rowStep = 1, c = m_nChannels ;
+  uint32_t sum = 0, recip = 0 ;
+  const uint16_t *pSum = NULL ;
+
+  if (y1 <= y0) y1 = y0 + 1 ;
+
+  // Sum the rows under the target row into 16 bit column sums
+  if (y1 - y0 > IMAGE_SCALE_MAX_BOX_ROWS){
+    rowStep = (y1 - y0 + IMAGE_SCALE_MAX_BOX_ROWS - 1) / IMAGE_SCALE_MAX_BOX_ROWS ;
+  }
+  memset(m_pSum, 0, m_srcWidth * c * sizeof(uint16_t)) ;
+  for (unsigned int sy=y0; sy < y1; sy += rowStep, rows++){
+    addRow(sourceRow(sy), m_pSum, m_srcWidth * c) ;
+  }
+
+  // Divide each box by multiplying with a 24 bit reciprocal
+  for (unsigned int x=0; x < m_dstWidth; x++){
+    pSum = m_pSum + (m_pColumns[x] * c) ;
+    recip = (1 << 24) / (m_pCounts[x] * rows) ;
+    for (unsigned int i=0; i < c; i++){
+      sum = 0 ;
+      for (unsigned int n=0; n < m_pCounts[x]; n++) sum += pSum[(n * c) + i] ;
+      pDst[(x * c) + i] = (((uint64_t)sum * recip) + (1 << 23)) >> 24 ;
+    }
+  }
+}
+
+void ImageScale::expand1bpp(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels)
+{
+  uint32_t i = 0 ;
+  uint8_t bits = 0 ;
+
+  // Whole bytes first
+  for (; i + 8 <= nPixels; i += 8){
+    bits = pSrc[i / 8] ;
+    for (int b=0; b < 8; b++) pDst[i + b] = (bits & (1 << b))?0xFF:0x00 ;
+  }
+  for (; i < nPixels; i++) pDst[i] = (pSrc[i / 8] & (1 << (i % 8)))?0xFF:0x00 ;
+}
+
+void ImageScale::blendRows(const uint8_t *pA, const uint8_t *pB, uint8_t *pDst, uint32_t nBytes, uint32_t weight)
+{
+  uint32_t i = 0 ;
+  uint32_t inverse = 256 - weight ;
+
+  if (weight == 0){
+    memcpy(pDst, pA, nBytes) ;
+    return ;
+  }
+
+  // Weights fit in a byte once weight 0 is handled, so a
+  // widening multiply accumulate blends 16 bytes at a time
+#if defined(IMAGE_SCALE_NEON)
+  uint8x8_t vw = vdup_n_u8(weight), vi = vdup_n_u8(inverse) ;
+  uint8x16_t a, b ;
+  uint16x8_t lo, hi ;
+
+  for (; i + 16 <= nBytes; i += 16){
+    a = vld1q_u8(pA + i) ;
+    b = vld1q_u8(pB + i) ;
+    lo = vmull_u8(vget_low_u8(a), vi) ;
+    lo = vmlal_u8(lo, vget_low_u8(b), vw) ;
+    hi = vmull_u8(vget_high_u8(a), vi) ;
+    hi = vmlal_u8(hi, vget_high_u8(b), vw) ;
+    vst1q_u8(pDst + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8))) ;
+  }
+#elif defined(IMAGE_SCALE_SSE2)
+  const __m128i zero = _mm_setzero_si128() ;
+  const __m128i vw = _mm_set1_epi16(weight), vi = _mm_set1_epi16(inverse) ;
+  const __m128i round = _mm_set1_epi16(128) ;
+  __m128i a, b, lo, hi ;
+
+  for (; i + 16 <= nBytes; i += 16){
+    a = _mm_loadu_si128((const __m128i *)(pA + i)) ;
+    b = _mm_loadu_si128((const __m128i *)(pB + i)) ;
+    lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), vi),
+		       _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), vw)) ;
+    hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), vi),
+		       _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), vw)) ;
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8) ;
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8) ;
+    _mm_storeu_si128((__m128i *)(pDst + i), _mm_packus_epi16(lo, hi)) ;
+  }
+#endif
+
+  for (; i < nBytes; i++){
+    pDst[i] = ((pA[i] * inverse) + (pB[i] * weight) + 128) >> 8 ;
+  }
+}
+
+void ImageScale::addRow(const uint8_t *pSrc, uint16_t *pSum, uint32_t nBytes)
+{
+  uint32_t i = 0 ;
+
+#if defined(IMAGE_SCALE_NEON)
+  uint8x16_t s ;
+
+  for (; i + 16 <= nBytes; i += 16){
+    s = vld1q_u8(pSrc + i) ;
+    vst1q_u16(pSum + i, vaddw_u8(vld1q_u16(pSum + i), vget_low_u8(s))) ;
+    vst1q_u16(pSum + i + 8, vaddw_u8(vld1q_u16(pSum + i + 8), vget_high_u8(s))) ;
+  }
+#elif defined(IMAGE_SCALE_SSE2)
+  const __m128i zero = _mm_setzero_si128() ;
+  __m128i s ;
+
+  for (; i + 16 <= nBytes; i += 16){
+    s = _mm_loadu_si128((const __m128i *)(pSrc + i)) ;
+    _mm_storeu_si128((__m128i *)(pSum + i),
+		     _mm_add_epi16(_mm_loadu_si128((const __m128i *)(pSum + i)), _mm_unpacklo_epi8(s, zero))) ;
+    _mm_storeu_si128((__m128i *)(pSum + i + 8),
+		     _mm_add_epi16(_mm_loadu_si128((const __m128i *)(pSum + i + 8)), _mm_unpackhi_epi8(s, zero))) ;
+  }
+#endif
+
+  for (; i < nBytes; i++) pSum[i] += pSrc[i] ;
+}
@@ -0,0 +1,97 @@
+#ifndef __IMAGE_SCALE_HPP
+#define __IMAGE_SCALE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+///////////////////////////////////////////////////
+//
+// Image resampling in 16.16 fixed point for fitting
+// images to a display. Works on raw image rows so the
+// drivers convert the scaled rows straight into their
+// display buffers. No floating point is used so it
+// runs well on ARMv6 without a vector unit.
+//
+// Sources are 1 bit rows, least significant bit first,
+// or 32 bit RGBA rows. Scaled 1 bit rows are 8 bit
+// coverage from 0 to 255, scaled 32 bit rows are RGBA
+//
+///////////////////////////////////////////////////
+
+// Largest source or target width and height
+#define IMAGE_SCALE_MAX_SIZE 32767
+
+// Box filter sums are 16 bits so at most this many source rows are
+// added for one target row. Taller boxes skip rows evenly
+#define IMAGE_SCALE_MAX_BOX_ROWS 257
+
+class ImageScale{
+public:
+  ImageScale() ;
+  ~ImageScale() ;
+
+  // nearest picks the closest source pixel. bilinear blends the 4 nearest
+  // pixels and suits scales down to a half. box averages every source
+  // pixel under a target pixel and suits large reductions
+  enum enFilter{nearest, bilinear, box} ;
+
+  // Image to scale. The pixels are read when rows are scaled
+  bool setSource(const uint8_t *pImg, unsigned int width, unsigned int height,
+		 unsigned int stride, unsigned int bpp) ;
+
+  // Size to scale to. Call after setSource
+  bool setTarget(unsigned int width, unsigned int height, enFilter eFilter) ;
+
+  // Bytes per scaled pixel. 1 for 1 bit sources and 4 for 32 bit
+  unsigned int getChannels(){return m_nChannels;}
+
+  // Scale target row y into pDst. Rows can be scaled in any order but
+  // source rows are reused when scaled top to bottom
+  void scaleRow(unsigned int y, uint8_t *pDst) ;
+
+  // Row kernels
+
+  // Expand 1 bit pixels to 0 or 255
+  static void expand1bpp(const uint8_t *pSrc, uint8_t *pDst, uint32_t nPixels) ;
+
+  // pDst = pA + ((pB - pA) * weight / 256) for weight 0 to 255.
+  // Uses NEON or SSE2 when built for them, as does addRow
+  static void blendRows(const uint8_t *pA, const uint8_t *pB, uint8_t *pDst, uint32_t nBytes, uint32_t weight) ;
+
+  // Add bytes of a row to 16 bit sums
+  static void addRow(const uint8_t *pSrc, uint16_t *pSum, uint32_t nBytes) ;
+
+protected:
+  // Source row as bytes with m_nChannels per pixel. 1 bit rows
+  // are expanded into one of two cached rows. pKeep is a row
+  // still in use, which is never replaced
+  const uint8_t *sourceRow(unsigned int y, const uint8_t *pKeep = NULL) ;
+
+  void scaleNearest(unsigned int y, uint8_t *pDst) ;
+  void scaleBilinear(unsigned int y, uint8_t *pDst) ;
+  void scaleBox(unsigned int y, uint8_t *pDst) ;
+
+  // Free the row buffers
+  void freeBuffers() ;
+
+  const uint8_t *m_pImg ;
+  unsigned int m_srcWidth, m_srcHeight, m_stride, m_bpp ;
+  unsigned int m_nChannels ;
+
+  unsigned int m_dstWidth, m_dstHeight ;
+  enFilter m_eFilter ;
+  uint32_t m_xStep, m_yStep ; // 16.16 source pixels per target pixel
+
+  // Per target column source position. Nearest and bilinear use the
+  // 16.16 position, box uses the first column and column count
+  uint32_t *m_pColumns ;
+  uint16_t *m_pCounts ;
+
+  uint8_t *m_pExpanded[2] ; // expanded 1 bit rows
+  int m_nExpanded[2] ; // source row in each or -1
+  int m_nNextExpand ;
+  uint8_t *m_pBlend ; // vertically blended row for bilinear
+  uint16_t *m_pSum ; // column sums for box
+};
+
+#endif // __IMAGE_SCALE_HPP
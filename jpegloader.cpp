@@ -0,0 +1,463 @@
+#include "jpegloader.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <pthread.h>
+#include "framepacer.hpp"
+
+// libjpeg calls exit() on errors by default. Jump back to load instead
+struct JPEGError{
+  struct jpeg_error_mgr mgr ;
+  jmp_buf jump ;
+};
+
+static void onJPEGError(j_common_ptr cinfo)
+{
+  JPEGError *pErr = (JPEGError *)cinfo->err ;
+
+  (*cinfo->err->output_message)(cinfo) ;
+  longjmp(pErr->jump, 1) ;
+}
+
+void JPEGLoader::chooseScale(struct jpeg_decompress_struct *pCinfo, int width, int height)
+{
+  // Try eighths from the smallest. Older libjpeg only has 1/8, 1/4, 1/2
+  // and 1/1 and rounds up to the next of these so still covers the display
+  pCinfo->scale_denom = 8 ;
+  for (unsigned int num=1; num <= 8; num++){
+    pCinfo->scale_num = num ;
+    jpeg_calc_output_dimensions(pCinfo) ;
+    if ((int)pCinfo->output_width >= width && (int)pCinfo->output_height >= height) break ;
+  }
+}
+
+bool JPEGLoader::load(PCF8833LCD &lcd, const char *szFile)
+{
+  struct jpeg_decompress_struct cinfo ;
+  JPEGError err ;
+  FILE *pFile = NULL ;
+  uint8_t * volatile pRow = NULL ; // volatile as it is used after longjmp
+  JSAMPROW rows[1] ;
+  int width = lcd.getWidth(), height = lcd.getHeight() ;
+  int xoffset = 0, yoffset = 0, y = 0 ;
+
+  if ((pFile = fopen(szFile, "rb")) == NULL){
+    fprintf(stderr, "load: cannot open %s\n", szFile) ;
+    return false ;
+  }
+
+  cinfo.err = jpeg_std_error(&err.mgr) ;
+  err.mgr.error_exit = onJPEGError ;
+  if (setjmp(err.jump)){
+    jpeg_destroy_decompress(&cinfo) ;
+    fclose(pFile) ;
+    if (pRow) delete[] pRow ;
+    return false ;
+  }
+
+  jpeg_create_decompress(&cinfo) ;
+  jpeg_stdio_src(&cinfo, pFile) ;
+  jpeg_read_header(&cinfo, TRUE) ;
+
+  if (cinfo.num_components != 1 && cinfo.num_components != 3){
+    fprintf(stderr, "load: unsupported JPEG colour space\n") ;
+    jpeg_destroy_decompress(&cinfo) ;
+    fclose(pFile) ;
+    return false ;
+  }
+  // Greyscale is expanded to RGB below as older libjpeg cannot convert it
+  cinfo.out_color_space = cinfo.num_components == 1?JCS_GRAYSCALE:JCS_RGB ;
+
+  chooseScale(&cinfo, width, height) ;
+  jpeg_start_decompress(&cinfo) ;
+
+  xoffset = (width - (int)cinfo.output_width) / 2 ;
+  yoffset = (height - (int)cinfo.output_height) / 2 ;
+  if (xoffset > 0 || yoffset > 0) lcd.clearImage() ; // doesn't cover the display
+
+  // One RGB24 scanline is all the memory needed
+  pRow = new uint8_t[cinfo.output_width * 3] ;
+  rows[0] = pRow ;
+
+  while (cinfo.output_scanline < cinfo.output_height){
+    y = yoffset + cinfo.output_scanline ;
+    if (y >= height) break ; // rest is cropped
+
+    jpeg_read_scanlines(&cinfo, rows, 1) ;
+    if (y < 0) continue ; // cropped above the display
+
+    if (cinfo.output_components == 1){
+      // Expand in place from the end of the row
+      for (int x=cinfo.output_width - 1; x >= 0; x--){
+	pRow[(x*3)+2] = pRow[(x*3)+1] = pRow[x*3] = pRow[x] ;
+      }
+    }
+    lcd.writeRaw(pRow, PCF8833LCD::rawRGB24, cinfo.output_width, 1, xoffset, y) ;
+  }
+
+  // Cropped rows don't need decoding
+  if (cinfo.output_scanline < cinfo.output_height) jpeg_abort_decompress(&cinfo) ;
+  else jpeg_finish_decompress(&cinfo) ;
+
+  jpeg_destroy_decompress(&cinfo) ;
+  fclose(pFile) ;
+  delete[] pRow ;
+
+  return true ;
+}
+
+bool JPEGLoader::decode(const char *szFile, unsigned int width, unsigned int height,
+			uint8_t *pRGB, const uint8_t *pBackground)
+{
+  struct jpeg_decompress_struct cinfo ;
+  JPEGError err ;
+  FILE *pFile = NULL ;
+  uint8_t * volatile pRow = NULL ; // volatile as it is used after longjmp
+  JSAMPROW rows[1] ;
+  int xoffset = 0, yoffset = 0, y = 0, x0 = 0, x1 = 0 ;
+
+  if ((pFile = fopen(szFile, "rb")) == NULL){
+    fprintf(stderr, "decode: cannot open %s\n", szFile) ;
+    return false ;
+  }
+
+  cinfo.err = jpeg_std_error(&err.mgr) ;
+  err.mgr.error_exit = onJPEGError ;
+  if (setjmp(err.jump)){
+    jpeg_destroy_decompress(&cinfo) ;
+    fclose(pFile) ;
+    if (pRow) delete[] pRow ;
+    return false ;
+  }
+
+  jpeg_create_decompress(&cinfo) ;
+  jpeg_stdio_src(&cinfo, pFile) ;
+  jpeg_read_header(&cinfo, TRUE) ;
+
+  if (cinfo.num_components != 1 && cinfo.num_components != 3){
+    fprintf(stderr, "decode: unsupported JPEG colour space\n") ;
+    jpeg_destroy_decompress(&cinfo) ;
+    fclose(pFile) ;
+    return false ;
+  }
+  cinfo.out_color_space = cinfo.num_components == 1?JCS_GRAYSCALE:JCS_RGB ;
+  chooseScale(&cinfo, width, height) ;
+  jpeg_start_decompress(&cinfo) ;
+
+  xoffset = ((int)width - (int)cinfo.output_width) / 2 ;
+  yoffset = ((int)height - (int)cinfo.output_height) / 2 ;
+  if (xoffset > 0 || yoffset > 0){
+    for (unsigned int i=0; i < width * height; i++){
+      pRGB[i*3] = pBackground[0] ;
+      pRGB[(i*3)+1] = pBackground[1] ;
+      pRGB[(i*3)+2] = pBackground[2] ;
+    }
+  }
+
+  // Columns of the scanline which are in the buffer
+  x0 = xoffset < 0?-xoffset:0 ;
+  x1 = (int)cinfo.output_width ;
+  if (xoffset + x1 > (int)width) x1 = width - xoffset ;
+
+  pRow = new uint8_t[cinfo.output_width * 3] ;
+  rows[0] = pRow ;
+
+  while (cinfo.output_scanline < cinfo.output_height){
+    y = yoffset + cinfo.output_scanline ;
+    if (y >= (int)height) break ; // rest is cropped
+
+    jpeg_read_scanlines(&cinfo, rows, 1) ;
+    if (y < 0) continue ; // cropped above the buffer
+
+    if (cinfo.output_components == 1){
+      for (int x=x1 - 1; x >= x0; x--){
+	pRow[(x*3)+2] = pRow[(x*3)+1] = pRow[x*3] = pRow[x] ;
+      }
+    }
+    memcpy(pRGB + (((y * width) + xoffset + x0) * 3), pRow + (x0 * 3), (x1 - x0) * 3) ;
+  }
+
+  if (cinfo.output_scanline < cinfo.output_height) jpeg_abort_decompress(&cinfo) ;
+  else jpeg_finish_decompress(&cinfo) ;
+
+  jpeg_destroy_decompress(&cinfo) ;
+  fclose(pFile) ;
+  delete[] pRow ;
+
+  return true ;
+}
+
+// A band of display rows on its way through the pipeline
+struct JPEGBand{
+  int y0, rows ;        // display rows
+  int imageY, imageRows ; // display rows covered by decoded image rows
+  uint8_t *pRGB ;       // decoded RGB24 rows
+  uint8_t *pWire ;      // band encoded for the LCD
+  uint32_t wireSize, wireLen ;
+};
+
+// Bounded queue between stages. A NULL band marks the end
+struct BandQueue{
+  pthread_mutex_t lock ;
+  pthread_cond_t cond ;
+  JPEGBand *pBands[JPEG_BANDS + 1] ;
+  int head, count ;
+};
+
+struct JPEGPipeline{
+  PCF8833LCD *pLCD ;
+  struct jpeg_decompress_struct *pCinfo ;
+  JPEGError *pErr ;
+  int xoffset, yoffset, nBands ;
+  bool bFailed ; // read once the threads have finished
+
+  BandQueue freeQ, convertQ, sendQ ;
+
+  uint64_t decodeMicros, convertMicros ;
+};
+
+static void queueInit(BandQueue *pQ)
+{
+  pthread_mutex_init(&pQ->lock, NULL) ;
+  pthread_cond_init(&pQ->cond, NULL) ;
+  pQ->head = pQ->count = 0 ;
+}
+
+static void queueDestroy(BandQueue *pQ)
+{
+  pthread_cond_destroy(&pQ->cond) ;
+  pthread_mutex_destroy(&pQ->lock) ;
+}
+
+static void queuePush(BandQueue *pQ, JPEGBand *pBand)
+{
+  pthread_mutex_lock(&pQ->lock) ;
+  // Never full. There are only JPEG_BANDS bands and one end marker
+  pQ->pBands[(pQ->head + pQ->count) % (JPEG_BANDS + 1)] = pBand ;
+  pQ->count++ ;
+  pthread_cond_signal(&pQ->cond) ;
+  pthread_mutex_unlock(&pQ->lock) ;
+}
+
+static JPEGBand *queuePop(BandQueue *pQ)
+{
+  JPEGBand *pBand = NULL ;
+
+  pthread_mutex_lock(&pQ->lock) ;
+  while (pQ->count == 0) pthread_cond_wait(&pQ->cond, &pQ->lock) ;
+  pBand = pQ->pBands[pQ->head] ;
+  pQ->head = (pQ->head + 1) % (JPEG_BANDS + 1) ;
+  pQ->count-- ;
+  pthread_mutex_unlock(&pQ->lock) ;
+
+  return pBand ;
+}
+
+// Stage 1. Decode scanlines into free bands
+static void *decodeThread(void *pArg)
+{
+  JPEGPipeline *pPipe = (JPEGPipeline *)pArg ;
+  struct jpeg_decompress_struct *pCinfo = pPipe->pCinfo ;
+  int height = pPipe->pLCD->getHeight() ;
+  int band = 0 ;
+  JPEGBand *pBand = NULL ;
+  JSAMPROW rows[1] ;
+  uint8_t *pRow = NULL ;
+  uint64_t start = 0 ;
+  int y = 0 ;
+
+  if (setjmp(pPipe->pErr->jump)){
+    pPipe->bFailed = true ;
+    queuePush(&pPipe->convertQ, NULL) ;
+    return NULL ;
+  }
+
+  for (; band < pPipe->nBands; band++){
+    pBand = queuePop(&pPipe->freeQ) ;
+    pBand->y0 = band * JPEG_BAND_ROWS ;
+    pBand->rows = height - pBand->y0 < JPEG_BAND_ROWS?height - pBand->y0:JPEG_BAND_ROWS ;
+    pBand->imageY = pBand->y0 ;
+    pBand->imageRows = 0 ;
+
+    start = FramePacer::timeMicros() ;
+    for (y=pBand->y0; y < pBand->y0 + pBand->rows; y++){
+      // Skip rows above the display and background rows above the image
+      while (pCinfo->output_scanline < pCinfo->output_height &&
+	     pPipe->yoffset + (int)pCinfo->output_scanline < y){
+	rows[0] = pBand->pRGB ;
+	jpeg_read_scanlines(pCinfo, rows, 1) ;
+      }
+      if (pCinfo->output_scanline >= pCinfo->output_height ||
+	  pPipe->yoffset + (int)pCinfo->output_scanline > y){
+	if (pBand->imageRows == 0) pBand->imageY = y + 1 ;
+	continue ;
+      }
+
+      pRow = pBand->pRGB + (pBand->imageRows * pCinfo->output_width * 3) ;
+      rows[0] = pRow ;
+      jpeg_read_scanlines(pCinfo, rows, 1) ;
+      if (pCinfo->output_components == 1){
+	// Expand in place from the end of the row
+	for (int x=pCinfo->output_width - 1; x >= 0; x--){
+	  pRow[(x*3)+2] = pRow[(x*3)+1] = pRow[x*3] = pRow[x] ;
+	}
+      }
+      pBand->imageRows++ ;
+    }
+    pPipe->decodeMicros += FramePacer::timeMicros() - start ;
+
+    queuePush(&pPipe->convertQ, pBand) ;
+  }
+
+  // Cropped rows don't need decoding
+  if (pCinfo->output_scanline < pCinfo->output_height) jpeg_abort_decompress(pCinfo) ;
+  else jpeg_finish_decompress(pCinfo) ;
+
+  queuePush(&pPipe->convertQ, NULL) ;
+  return NULL ;
+}
+
+// Stage 2. Convert into the display buffer and encode the band rows.
+// Only this thread touches the display buffer while the pipeline runs
+static void *convertThread(void *pArg)
+{
+  JPEGPipeline *pPipe = (JPEGPipeline *)pArg ;
+  PCF8833LCD *pLCD = pPipe->pLCD ;
+  JPEGBand *pBand = NULL ;
+  uint64_t start = 0 ;
+
+  while ((pBand = queuePop(&pPipe->convertQ)) != NULL){
+    start = FramePacer::timeMicros() ;
+    if (pBand->imageRows > 0){
+      pLCD->writeRaw(pBand->pRGB, PCF8833LCD::rawRGB24, pPipe->pCinfo->output_width,
+		     pBand->imageRows, pPipe->xoffset, pBand->imageY) ;
+    }
+    pBand->wireLen = pLCD->encodeRows(pBand->y0, pBand->y0 + pBand->rows - 1, pBand->pWire, pBand->wireSize) ;
+    pPipe->convertMicros += FramePacer::timeMicros() - start ;
+
+    queuePush(&pPipe->sendQ, pBand) ;
+  }
+
+  queuePush(&pPipe->sendQ, NULL) ;
+  return NULL ;
+}
+
+bool JPEGLoader::loadPipelined(PCF8833LCD &lcd, const char *szFile, JPEGTimings *pTimings)
+{
+  struct jpeg_decompress_struct cinfo ;
+  JPEGError err ;
+  FILE *pFile = NULL ;
+  JPEGPipeline pipe ;
+  JPEGBand bands[JPEG_BANDS] ;
+  JPEGBand *pBand = NULL ;
+  pthread_t decoder, converter ;
+  int width = lcd.getWidth(), height = lcd.getHeight() ;
+  int nBands = 0 ;
+  uint64_t start = FramePacer::timeMicros(), t = 0 ;
+  uint32_t wireSize = 0 ;
+  bool bSent = true, bDecoder = false, bConverter = false ;
+
+  if (pTimings){
+    pTimings->firstPixel = pTimings->total = 0 ;
+    pTimings->decode = pTimings->convert = pTimings->send = 0 ;
+  }
+
+  if ((pFile = fopen(szFile, "rb")) == NULL){
+    fprintf(stderr, "loadPipelined: cannot open %s\n", szFile) ;
+    return false ;
+  }
+
+  cinfo.err = jpeg_std_error(&err.mgr) ;
+  err.mgr.error_exit = onJPEGError ;
+  if (setjmp(err.jump)){
+    jpeg_destroy_decompress(&cinfo) ;
+    fclose(pFile) ;
+    return false ;
+  }
+
+  jpeg_create_decompress(&cinfo) ;
+  jpeg_stdio_src(&cinfo, pFile) ;
+  jpeg_read_header(&cinfo, TRUE) ;
+
+  if (cinfo.num_components != 1 && cinfo.num_components != 3){
+    fprintf(stderr, "loadPipelined: unsupported JPEG colour space\n") ;
+    jpeg_destroy_decompress(&cinfo) ;
+    fclose(pFile) ;
+    return false ;
+  }
+  cinfo.out_color_space = cinfo.num_components == 1?JCS_GRAYSCALE:JCS_RGB ;
+  chooseScale(&cinfo, width, height) ;
+  jpeg_start_decompress(&cinfo) ;
+
+  pipe.pLCD = &lcd ;
+  pipe.pCinfo = &cinfo ;
+  pipe.pErr = &err ;
+  pipe.xoffset = (width - (int)cinfo.output_width) / 2 ;
+  pipe.yoffset = (height - (int)cinfo.output_height) / 2 ;
+  pipe.nBands = (height + JPEG_BAND_ROWS - 1) / JPEG_BAND_ROWS ;
+  pipe.bFailed = false ;
+  pipe.decodeMicros = pipe.convertMicros = 0 ;
+  if (pipe.xoffset > 0 || pipe.yoffset > 0) lcd.clearImage() ; // doesn't cover the display
+
+  // Every band is sized for the tallest band
+  wireSize = lcd.encodeRows(0, JPEG_BAND_ROWS < height?JPEG_BAND_ROWS - 1:height - 1, NULL, 0) ;
+  queueInit(&pipe.freeQ) ;
+  queueInit(&pipe.convertQ) ;
+  queueInit(&pipe.sendQ) ;
+  for (int i=0; i < JPEG_BANDS; i++){
+    bands[i].pRGB = new uint8_t[cinfo.output_width * 3 * JPEG_BAND_ROWS] ;
+    bands[i].pWire = new uint8_t[wireSize] ;
+    bands[i].wireSize = wireSize ;
+    queuePush(&pipe.freeQ, &bands[i]) ;
+  }
+
+  // The decoder is only started when something will take its bands
+  bConverter = pthread_create(&converter, NULL, convertThread, &pipe) == 0 ;
+  if (bConverter) bDecoder = pthread_create(&decoder, NULL, decodeThread, &pipe) == 0 ;
+  if (!bDecoder){
+    fprintf(stderr, "loadPipelined: cannot start threads\n") ;
+    pipe.bFailed = true ;
+    queuePush(bConverter?&pipe.convertQ:&pipe.sendQ, NULL) ;
+  }
+
+  // Stage 3. Send bands to the LCD in this thread
+  while ((pBand = queuePop(&pipe.sendQ)) != NULL){
+    t = FramePacer::timeMicros() ;
+    if (pBand->wireLen == 0 || !lcd.writeEncoded(pBand->pWire, pBand->wireLen)) bSent = false ;
+    if (bSent && nBands == 0 && pTimings) pTimings->firstPixel = FramePacer::timeMicros() - start ;
+    if (pTimings) pTimings->send += FramePacer::timeMicros() - t ;
+    nBands++ ;
+
+    queuePush(&pipe.freeQ, pBand) ;
+  }
+
+  if (bConverter) pthread_join(converter, NULL) ;
+  if (bDecoder) pthread_join(decoder, NULL) ;
+
+  jpeg_destroy_decompress(&cinfo) ;
+  fclose(pFile) ;
+  for (int i=0; i < JPEG_BANDS; i++){
+    delete[] bands[i].pRGB ;
+    delete[] bands[i].pWire ;
+  }
+  queueDestroy(&pipe.freeQ) ;
+  queueDestroy(&pipe.convertQ) ;
+  queueDestroy(&pipe.sendQ) ;
+
+  if (pTimings){
+    pTimings->total = FramePacer::timeMicros() - start ;
+    pTimings->decode = pipe.decodeMicros ;
+    pTimings->convert = pipe.convertMicros ;
+  }
+
+  // Bands cover every row so the LCD now matches the display buffer
+  if (pipe.bFailed || !bSent || nBands != pipe.nBands){
+    lcd.invalidate() ;
+    return false ;
+  }
+  lcd.validate() ;
+
+  return true ;
+}
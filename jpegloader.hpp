@@ -0,0 +1,56 @@
+#ifndef __JPEG_LOADER_HPP
+#define __JPEG_LOADER_HPP
+
+#include "pcf8833lcd.hpp"
+#include <stdint.h>
+
+struct jpeg_decompress_struct ;
+
+///////////////////////////////////////////////////
+//
+// Decodes JPEG files straight into the PCF8833 display
+// buffer. libjpeg scales the image down in the DCT so
+// only a scaled scanline is ever held in memory,
+// however large the photo is
+//
+///////////////////////////////////////////////////
+
+// Rows in each band of loadPipelined and the number of bands in flight
+#define JPEG_BAND_ROWS 16
+#define JPEG_BANDS 4
+
+// Microsecond times from loadPipelined. Stage times are totals over all bands
+struct JPEGTimings{
+  uint64_t firstPixel ; // until the first band is on the LCD
+  uint64_t total ;
+  uint64_t decode ;
+  uint64_t convert ;
+  uint64_t send ;
+};
+
+class JPEGLoader{
+public:
+  // Decode szFile at the smallest scale which still covers the display
+  // and centre it. Parts outside of the display are cropped and a
+  // small image is shown on the background colour.
+  // Call display() to send to the LCD
+  static bool load(PCF8833LCD &lcd, const char *szFile) ;
+
+  // As load but split into bands of display rows which are written to
+  // the LCD as they are ready. One thread decodes a band while a second
+  // converts the band before and the calling thread sends the one before
+  // that. Don't call display() after, the LCD is already up to date
+  static bool loadPipelined(PCF8833LCD &lcd, const char *szFile, JPEGTimings *pTimings=NULL) ;
+
+  // Decode szFile into a width x height RGB24 buffer, scaled and centred
+  // as load does. Uncovered pixels are set to pBackground RGB. Doesn't
+  // use a display so can run on any thread
+  static bool decode(const char *szFile, unsigned int width, unsigned int height,
+		     uint8_t *pRGB, const uint8_t *pBackground) ;
+
+protected:
+  // Set the smallest scale which still covers width x height
+  static void chooseScale(struct jpeg_decompress_struct *pCinfo, int width, int height) ;
+};
+
+#endif // __JPEG_LOADER_HPP
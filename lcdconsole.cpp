@@ -0,0 +1,119 @@
+#include "lcdconsole.hpp"
+#include <stdio.h>
+#include <string.h>
+
+LCDConsole::LCDConsole()
+{
+  m_pLCD = NULL ;
+  m_pFont = NULL ;
+  m_pImg = NULL ;
+  m_nTop = 0 ;
+  m_nLineHeight = 0 ;
+  m_nLines = 0 ;
+  m_nNext = 0 ;
+  m_nUsed = 0 ;
+}
+
+LCDConsole::~LCDConsole()
+{
+  if (m_pImg) delete m_pImg ;
+}
+
+bool LCDConsole::open(PCF8833LCD &lcd, DisplayFont &fnt, unsigned int lineHeight, unsigned int top, unsigned int bottom)
+{
+  unsigned int height = lcd.getHeight() ;
+
+  if (lineHeight == 0 || top + bottom + lineHeight > height){
+    fprintf(stderr, "open: no room for a line of text\n") ;
+    return false ;
+  }
+
+  m_pLCD = &lcd ;
+  m_pFont = &fnt ;
+  m_nTop = top ;
+  m_nLineHeight = lineHeight ;
+  m_nLines = (height - top - bottom) / lineHeight ;
+  m_nNext = 0 ;
+  m_nUsed = 0 ;
+
+  // Scroll area is a whole number of lines. Any spare rows join the bottom fixed area
+  if (!m_pLCD->setScrollArea(top, height - top - (m_nLines * lineHeight))) return false ;
+  if (!m_pLCD->setScrollStart(top)) return false ;
+
+  if (!m_pLCD->setClip(0, top, lcd.getWidth(), m_nLines * lineHeight)) return false ;
+  m_pLCD->clearImage() ;
+  m_pLCD->clearClip() ;
+
+  return m_pLCD->display() ;
+}
+
+bool LCDConsole::print(const char *szText)
+{
+  char szLine[LCD_CONSOLE_MAX_LINE] ;
+  const char *pEnd = NULL ;
+  unsigned int len = 0 ;
+
+  if (!m_pLCD){
+    fprintf(stderr, "print: console not open\n") ;
+    return false ;
+  }
+
+  for (;;){
+    pEnd = strchr(szText, '\n') ;
+    len = pEnd?pEnd - szText:strlen(szText) ;
+    if (len >= LCD_CONSOLE_MAX_LINE) len = LCD_CONSOLE_MAX_LINE - 1 ;
+    memcpy(szLine, szText, len) ;
+    szLine[len] = '\0' ;
+    if (!printLine(szLine)) return false ;
+    if (!pEnd) break ;
+    szText = pEnd + 1 ;
+  }
+
+  return true ;
+}
+
+bool LCDConsole::printLine(char *szLine)
+{
+  char szBlank[] = " " ;
+  unsigned int y = m_nTop + (m_nNext * m_nLineHeight) ;
+
+  if (szLine[0] == '\0') szLine = szBlank ;
+
+  // Reuse the image from the last line where possible
+  if (m_pImg) m_pFont->createText(szLine, m_pImg) ;
+  else m_pImg = m_pFont->createText(szLine) ;
+  if (!m_pImg){
+    fprintf(stderr, "printLine: failed to create text\n") ;
+    return false ;
+  }
+
+  // Only the band for this line is changed so only this band is sent
+  m_pLCD->setClip(0, y, m_pLCD->getWidth(), m_nLineHeight) ;
+  m_pLCD->writeImage(*m_pImg, PCF8833LCD::overwrite, 0, y) ;
+  m_pLCD->clearClip() ;
+  if (!m_pLCD->display()) return false ;
+
+  m_nNext = (m_nNext + 1) % m_nLines ;
+  if (m_nUsed < m_nLines) m_nUsed++ ;
+
+  // Once every line is in use the oldest line is next and
+  // scrolls to the top of the area
+  if (m_nUsed == m_nLines){
+    return m_pLCD->setScrollStart(m_nTop + (m_nNext * m_nLineHeight)) ;
+  }
+
+  return true ;
+}
+
+bool LCDConsole::close()
+{
+  if (!m_pLCD) return true ;
+
+  bool bRet = m_pLCD->endScroll() ;
+
+  // RAM rows no longer match their display position
+  m_pLCD->invalidate() ;
+  m_pLCD = NULL ;
+
+  return bRet ;
+}
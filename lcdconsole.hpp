@@ -0,0 +1,49 @@
+#ifndef __LCD_CONSOLE_HPP
+#define __LCD_CONSOLE_HPP
+
+#include "pcf8833lcd.hpp"
+#include "displayimage.hpp"
+
+///////////////////////////////////////////////////
+//
+// Scrolling text console for the PCF8833 LCD.
+// Uses the LCD vertical scrolling so each new line
+// only writes one text row to the LCD RAM
+//
+///////////////////////////////////////////////////
+
+// Longest line of text handled by print()
+#define LCD_CONSOLE_MAX_LINE 256
+
+class LCDConsole{
+public:
+  LCDConsole() ;
+  ~LCDConsole() ;
+
+  // Start the console on a set up and initialised LCD. lineHeight is the
+  // font height in pixels. Rows above top and below bottom are not used
+  // by the console and don't scroll
+  bool open(PCF8833LCD &lcd, DisplayFont &fnt, unsigned int lineHeight, unsigned int top=0, unsigned int bottom=0) ;
+
+  // Add text to the bottom of the console and scroll up. Each newline
+  // starts another line. Text beyond the LCD width is clipped
+  bool print(const char *szText) ;
+
+  // Stop scrolling. The LCD RAM rows stay in their scrolled order
+  bool close() ;
+
+protected:
+  bool printLine(char *szLine) ;
+
+  PCF8833LCD *m_pLCD ;
+  DisplayFont *m_pFont ;
+  DisplayImage *m_pImg ; // reused for each line of text
+
+  unsigned int m_nTop ; // first RAM row of the scroll area
+  unsigned int m_nLineHeight ;
+  unsigned int m_nLines ; // text lines in the scroll area
+  unsigned int m_nNext ; // line written next
+  unsigned int m_nUsed ; // lines written since open
+};
+
+#endif // __LCD_CONSOLE_HPP
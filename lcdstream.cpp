@@ -0,0 +1,301 @@
+#include "hardware.hpp"
+#include "wpihardware.hpp"
+#include "spihardware.hpp"
+#include "pcf8833lcd.hpp"
+#include "framepacer.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+
+///////////////////////////////////////////////////
+//
+// Raw video player for the Nokia 6100 LCD. Reads fixed
+// size frames from stdin or a FIFO and shows the newest
+// frame at a target frame rate. Frames arriving faster
+// than the LCD can be written are dropped.
+//
+// Example using ffmpeg as the decoder:
+// ffmpeg -i clip.mp4 -vf scale=132:132 -f rawvideo -pix_fmt rgb24 - | ./lcdstream -r 20
+//
+///////////////////////////////////////////////////
+
+// Frames are passed from the reader thread through 3 buffers. The reader
+// fills one, the newest complete frame waits in another and the display
+// owns the third. A new frame replaces any frame still waiting, which is dropped
+struct FrameQueue{
+  pthread_mutex_t lock ;
+  uint8_t *pBuffers[3] ;
+  int nWrite, nReady, nShow ;
+  bool bNew ; // nReady holds a frame not yet shown
+  bool bEnd ; // no more frames
+
+  int fd ;
+  uint32_t frameSize ;
+
+  // Counters updated by the reader
+  uint32_t frames ;
+  uint32_t drops ;
+  uint64_t readMicros ;
+};
+
+static volatile sig_atomic_t g_bQuit = 0 ;
+
+static void onSignal(int sig)
+{
+  g_bQuit = 1 ;
+}
+
+// Read a whole frame. Pipes return partial reads
+static bool readFrame(int fd, uint8_t *pBuffer, uint32_t len)
+{
+  ssize_t n = 0 ;
+
+  while (len > 0){
+    n = read(fd, pBuffer, len) ;
+    if (n <= 0) return false ;
+    pBuffer += n ;
+    len -= n ;
+  }
+
+  return true ;
+}
+
+static void *readerThread(void *pArg)
+{
+  FrameQueue *pQ = (FrameQueue *)pArg ;
+  uint64_t start = 0 ;
+  int tmp = 0 ;
+
+  for (;;){
+    start = FramePacer::timeMicros() ;
+    if (!readFrame(pQ->fd, pQ->pBuffers[pQ->nWrite], pQ->frameSize)) break ;
+
+    pthread_mutex_lock(&pQ->lock) ;
+    tmp = pQ->nReady ;
+    pQ->nReady = pQ->nWrite ;
+    pQ->nWrite = tmp ;
+    if (pQ->bNew) pQ->drops++ ; // replaced a frame that was never shown
+    pQ->bNew = true ;
+    pQ->frames++ ;
+    pQ->readMicros += FramePacer::timeMicros() - start ;
+    pthread_mutex_unlock(&pQ->lock) ;
+  }
+
+  pthread_mutex_lock(&pQ->lock) ;
+  pQ->bEnd = true ;
+  pthread_mutex_unlock(&pQ->lock) ;
+
+  return NULL ;
+}
+
+static void usage(const char *szName)
+{
+  fprintf(stderr, "Usage: %s [-f rgb24|rgba|rgb444] [-s WIDTHxHEIGHT] [-r fps] [-i file] [-8] [-d]\n", szName) ;
+  fprintf(stderr, "  -f  frame pixel format, default rgb24. rgb444 is 2 bytes per pixel big endian\n") ;
+  fprintf(stderr, "  -s  frame size, default 132x132. Smaller frames are centred\n") ;
+  fprintf(stderr, "  -r  target frames per second, default 25\n") ;
+  fprintf(stderr, "  -i  read frames from a file or FIFO instead of stdin\n") ;
+  fprintf(stderr, "  -8  use 8 bit LCD colour\n") ;
+  fprintf(stderr, "  -d  dither 12 bit colour\n") ;
+}
+
+int main(int argc, char **argv)
+{
+  // BCM pin
+  const int reset_pin = 25 ;
+
+  PCF8833LCD::enRaw eFormat = PCF8833LCD::rawRGB24 ;
+  const int rawBytes[3] = {3, 4, 2} ;
+  unsigned int width = 132, height = 132, fps = 25 ;
+  const char *szInput = NULL ;
+  bool b8bit = false, bDither = false ;
+  int opt = 0 ;
+
+  while ((opt = getopt(argc, argv, "f:s:r:i:8d")) != -1){
+    switch(opt){
+    case 'f':
+      if (strcmp(optarg, "rgb24") == 0) eFormat = PCF8833LCD::rawRGB24 ;
+      else if (strcmp(optarg, "rgba") == 0) eFormat = PCF8833LCD::rawRGBA ;
+      else if (strcmp(optarg, "rgb444") == 0) eFormat = PCF8833LCD::rawRGB444 ;
+      else{
+	usage(argv[0]) ;
+	return -1 ;
+      }
+      break ;
+    case 's':
+      if (sscanf(optarg, "%ux%u", &width, &height) != 2 || width == 0 || height == 0){
+	usage(argv[0]) ;
+	return -1 ;
+      }
+      break ;
+    case 'r':
+      fps = atoi(optarg) ;
+      break ;
+    case 'i':
+      szInput = optarg ;
+      break ;
+    case '8':
+      b8bit = true ;
+      break ;
+    case 'd':
+      bDither = true ;
+      break ;
+    default:
+      usage(argv[0]) ;
+      return -1 ;
+    }
+  }
+
+  FrameQueue q ;
+  memset(&q, 0, sizeof(q)) ;
+  q.frameSize = width * height * rawBytes[eFormat] ;
+  q.nWrite = 0 ;
+  q.nReady = 1 ;
+  q.nShow = 2 ;
+
+  q.fd = szInput?open(szInput, O_RDONLY):STDIN_FILENO ;
+  if (q.fd < 0){
+    fprintf(stderr, "Cannot open %s\n", szInput) ;
+    return -1 ;
+  }
+
+  for (int i=0; i < 3; i++){
+    q.pBuffers[i] = new uint8_t[q.frameSize] ;
+    if (!q.pBuffers[i]){
+      fprintf(stderr, "Memory error\n") ;
+      return -1 ;
+    }
+  }
+
+  // Create new wiringPi instance
+  wPi pi ; // init GPIO
+
+  spiHw spi ;
+  if (!spi.spiopen(0,0)){ // init SPI
+    fprintf(stderr, "Cannot Open SPI\n") ;
+    return -1 ;
+  }
+  spi.setSpeed(6000000) ;
+
+  PCF8833LCD lcd ;
+
+  lcd.setGPIO(pi) ;
+  lcd.setSPI(spi) ;
+  lcd.setTime(pi) ;
+
+  if (!lcd.setup(132,132, reset_pin)){
+    fprintf(stderr,"Failed to setup LCD\n") ;
+    return -1 ;
+  }
+
+  if (!lcd.initialise()){
+    fprintf(stderr,"Failed to initialise LCD\n") ;
+    return -1 ;
+  }
+
+  if (b8bit) lcd.setColourMode(PCF8833LCD::colour8bit) ;
+  lcd.setDither(bDither) ;
+  lcd.setBackground(0, 0, 0) ;
+  lcd.clearImage() ;
+  lcd.display() ;
+
+  // Centre frames smaller than the LCD
+  int xoffset = ((int)lcd.getWidth() - (int)width) / 2 ;
+  int yoffset = ((int)lcd.getHeight() - (int)height) / 2 ;
+  if (xoffset < 0) xoffset = 0 ;
+  if (yoffset < 0) yoffset = 0 ;
+
+  signal(SIGINT, onSignal) ;
+  signal(SIGTERM, onSignal) ;
+
+  pthread_mutex_init(&q.lock, NULL) ;
+  pthread_t reader ;
+  if (pthread_create(&reader, NULL, readerThread, &q) != 0){
+    fprintf(stderr, "Cannot start reader thread\n") ;
+    return -1 ;
+  }
+
+  FramePacer pacer(pi, fps) ;
+  bool bFrame = false, bEnd = false ;
+  int tmp = 0 ;
+  uint32_t shown = 0, lastShown = 0, lastFrames = 0, lastDrops = 0 ;
+  uint64_t convertMicros = 0, sendMicros = 0, lastRead = 0, lastConvert = 0, lastSend = 0 ;
+  uint64_t t0 = 0, t1 = 0, t2 = 0 ;
+  uint64_t start = FramePacer::timeMicros(), report = start ;
+
+  while (!g_bQuit){
+    // Take the newest frame if there is one
+    pthread_mutex_lock(&q.lock) ;
+    bFrame = q.bNew ;
+    if (bFrame){
+      tmp = q.nShow ;
+      q.nShow = q.nReady ;
+      q.nReady = tmp ;
+      q.bNew = false ;
+    }
+    bEnd = q.bEnd ;
+    pthread_mutex_unlock(&q.lock) ;
+
+    if (bFrame){
+      t0 = FramePacer::timeMicros() ;
+      lcd.writeRaw(q.pBuffers[q.nShow], eFormat, width, height, xoffset, yoffset) ;
+      t1 = FramePacer::timeMicros() ;
+      if (!lcd.display()) fprintf(stderr, "LCD display write failed\n") ;
+      t2 = FramePacer::timeMicros() ;
+
+      convertMicros += t1 - t0 ;
+      sendMicros += t2 - t1 ;
+      shown++ ;
+    }else if (bEnd){
+      break ;
+    }
+
+    pacer.wait() ;
+
+    // Report once a second. Stage times are averages per frame
+    if (t2 - report >= 1000000 && shown > lastShown){
+      pthread_mutex_lock(&q.lock) ;
+      uint32_t frames = q.frames, drops = q.drops ;
+      uint64_t readMicros = q.readMicros ;
+      pthread_mutex_unlock(&q.lock) ;
+
+      printf("%.1f fps, %u read, %u dropped, read %.2fms, convert %.2fms, send %.2fms\n",
+	     (shown - lastShown) * 1000000.0 / (t2 - report),
+	     frames - lastFrames, drops - lastDrops,
+	     frames > lastFrames?(readMicros - lastRead) / 1000.0 / (frames - lastFrames):0.0,
+	     (convertMicros - lastConvert) / 1000.0 / (shown - lastShown),
+	     (sendMicros - lastSend) / 1000.0 / (shown - lastShown)) ;
+
+      report = t2 ;
+      lastShown = shown ;
+      lastFrames = frames ;
+      lastDrops = drops ;
+      lastRead = readMicros ;
+      lastConvert = convertMicros ;
+      lastSend = sendMicros ;
+    }
+  }
+
+  // The reader may still be blocked reading the pipe
+  if (!bEnd) pthread_cancel(reader) ;
+  pthread_join(reader, NULL) ;
+
+  double secs = (FramePacer::timeMicros() - start) / 1000000.0 ;
+  printf("Shown %u of %u frames in %.1fs, %.1f fps, %u dropped, %u late\n",
+	 shown, q.frames, secs, secs > 0?shown / secs:0.0, q.drops, pacer.getLateFrames()) ;
+  if (shown > 0){
+    printf("Average convert %.2fms, send %.2fms\n",
+	   convertMicros / 1000.0 / shown, sendMicros / 1000.0 / shown) ;
+  }
+
+  for (int i=0; i < 3; i++) delete[] q.pBuffers[i] ;
+  if (szInput) close(q.fd) ;
+
+  lcd.turnOff() ;
+
+  return 0 ;
+}
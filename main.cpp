@@ -2,6 +2,8 @@
 #include "wpihardware.hpp"
 #include "spihardware.hpp"
 #include "sdd1306oled.hpp"
+#include "framepacer.hpp"
+#include "widget.hpp"
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -72,13 +74,11 @@ int main(int argc, char **argv)
   oled.setYOrigin(true) ;
 
   printf ("Displaying line...\n") ;
-  DisplayImage imgLines ;
-  if (!imgLines.createImage(64,48,1)) fprintf(stderr, "Failed to create image\n") ;
-  imgLines.drawLine(0,0,63,47) ;
-  imgLines.drawLine(63,0,0,47) ;
-  imgLines.drawLine(31,47,0,23) ;
-  imgLines.drawLine(31,47,63,23) ;
-  if (!oled.writeImage(imgLines,SDD1306OLED::overwrite)) fprintf(stderr, "Failed to call writeImage for OLED\n") ;
+  oled.clearImage() ;
+  oled.drawLine(0,0,63,47) ;
+  oled.drawLine(63,0,0,47) ;
+  oled.drawLine(31,47,0,23) ;
+  if (!oled.drawLine(31,47,63,23)) fprintf(stderr, "Failed to call drawLine for OLED\n") ;
   oled.display() ;
 
   printf("Sleeping...\n") ;
@@ -121,24 +121,58 @@ int main(int argc, char **argv)
     // Open all images for display
 
     char strPercent[5] ;
-    DisplayImage imgBar ;
-    
-    imgBar.createImage(64,48,1);
-    imgBar.drawRect(5,5,54,34) ;
+    GlyphCache glyphs ;
+
+    // Expand the font once rather than making an image for every string
+    if (!glyphs.load(fnt2)) fprintf(stderr, "Failed to load glyphs\n") ;
     
+    oled.clearImage() ;
+    oled.drawRect(5,5,54,34) ;
+
+    // Send from a background thread so drawing carries on during the transfer
+    if (!oled.startPresenter()) fprintf(stderr, "Failed to start OLED presenter\n") ;
+
     for (int percent=0; percent <= 100; percent++){
 
-      imgBar.drawRect(7,7,(50*percent)/100,30, true) ;
-      oled.writeImage(imgBar,SDD1306OLED::overwrite);
+      // Clear inside the frame and draw the bar straight into the buffer
+      oled.setClip(7,7,50,30) ;
+      oled.clearImage() ;
+      oled.clearClip() ;
+      oled.drawRect(7,7,(50*percent)/100,30, true) ;
 
       // Overlay with text progress
       sprintf(strPercent, "%d%%", percent) ;
-      DisplayImage *txtimg = fnt2.createText(strPercent) ;
-      oled.writeImage(*txtimg, SDD1306OLED::exclusive, 20,16) ;
-      delete txtimg ;
-      oled.display() ;
+      oled.writeText(glyphs, strPercent, SDD1306OLED::exclusive, 20,16) ;
+      oled.present() ;
       pi.milliSleep(100) ;
     }
+
+    oled.stopPresenter() ;
+    FramePresenter::PresenterStats stats ;
+    oled.getPresenterStats(stats) ;
+    printf("Presented %u of %u frames, %u dropped, max latency %u us\n",
+	   stats.presented, stats.published, stats.dropped, stats.maxLatency) ;
+
+    // The same progress with widgets, which only send what changes
+    printf("Widget progress test...\n") ;
+    WidgetScreen screen ;
+    ProgressWidget bar(5, 40, 118, 12) ;
+    LabelWidget label(fnt2, 20, 8, 88, 24) ;
+
+    screen.add(bar) ;
+    screen.add(label) ;
+    screen.setDisplay(oled) ;
+
+    uint32_t pixels = 0 ;
+    for (int percent=0; percent <= 100; percent++){
+      sprintf(strPercent, "%d%%", percent) ;
+      bar.setValue(percent) ;
+      label.setText(strPercent) ;
+      if (!screen.update()) fprintf(stderr, "Widget update failed\n") ;
+      pixels += screen.getLastPixels() ;
+      pi.milliSleep(100) ;
+    }
+    printf("Redrew %u pixels for 101 updates\n", pixels) ;
   }
 
   printf("Sleeping...\n") ;
@@ -159,6 +193,16 @@ int main(int argc, char **argv)
   printf("Sleeping...\n") ;
   pi.milliSleep(5000) ; // keep display on for 5 sec
 
+  // Photos are box filtered down to the display and dithered
+  printf("Scaling JPEG image...\n") ;
+  DisplayImage photo ;
+  if (!photo.loadJPG("images/test2.jpg")){
+    fprintf(stderr, "Failed to load JPEG, skipping this test\n") ;
+  }else{
+    if (!oled.writeScaled(photo, ImageScale::box, 0, 0, oled.getWidth(), oled.getHeight())) fprintf(stderr, "Cannot scale image\n") ;
+    if (!oled.display()) fprintf(stderr, "OLED display write failed\n") ;
+    pi.milliSleep(5000) ; // keep display on for 5 sec
+  }
   
   printf("Loading test binary image...\n") ;
   int testfile = 0;
@@ -181,23 +225,32 @@ int main(int argc, char **argv)
     fprintf(stdout, "Cannot open test files, skipping this test\n") ;
   }else{
     DisplayImage img2 ;
+    FrameCache cache ;
     if (!img2.loadFile(testfile2)) fprintf(stderr, "Failed to load test file 2 into image object\n") ;
+
+    // Frames are only drawn into the display buffer the first time
+    oled.setFrameCache(&cache) ;
     for (int i=0; i < 25; i++){ // iterate 25 loops of animation
-      if (!oled.writeImage(img2, SDD1306OLED::overwrite)){
-	fprintf(stderr, "Failed to write image 2 to OLED object\n") ;
+      if (!oled.displayImage(img2)){
+	fprintf(stderr, "Failed to display image 2 on OLED\n") ;
 	break ;
       }
-      if (!oled.display()) fprintf(stderr, "OLED display write failed\n") ;
       pi.milliSleep(200) ;
-      if (!oled.writeImage(img, SDD1306OLED::overwrite)){
-	fprintf(stderr, "Failed to write image 1 to OLED object\n") ;
+      if (!oled.displayImage(img)){
+	fprintf(stderr, "Failed to display image 1 on OLED\n") ;
 	break ;
       }
-      if (!oled.display()) fprintf(stderr, "OLED display write failed\n") ;
       pi.milliSleep(200) ;
     }
+    oled.setFrameCache(NULL) ;
+    printf("Frame cache hits %u, misses %u\n", cache.getHits(), cache.getMisses()) ;
   }
 
+  // Fade out before turning off
+  FramePacer pacer(pi, 30) ;
+  oled.fadeContrast(0, 1500) ;
+  while (oled.stepEffect(pacer.wait())) ;
+
   oled.turnOff() ; // Turn off the display. 
 
   return 1 ;
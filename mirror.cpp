@@ -0,0 +1,94 @@
+#include "hardware.hpp"
+#include "wpihardware.hpp"
+#include "spihardware.hpp"
+#include "pcf8833lcd.hpp"
+#include "sdd1306oled.hpp"
+#include "fanoutpresenter.hpp"
+#include "panelsequencer.hpp"
+#include "displayimage.hpp"
+#include <stdio.h>
+
+///////////////////////////////////////////////////
+//
+// Mirrors an image to the Nokia 6100 LCD and the
+// SDD1306 OLED together. Each display is scaled on
+// its own thread. Both are on SPI bus 0 so they take
+// turns to send, with one scaling while the other
+// sends.
+//
+// The LCD is on CS0 as in nokia6100.cpp. The OLED is
+// on CS1 and needs its own reset line
+//
+///////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+  // BCM pins
+  const int lcd_reset_pin = 25 ;
+  const int oled_dc_pin = 24 ;
+  const int oled_reset_pin = 23 ;
+  const char *szFile = argc > 1?argv[1]:"images/test2.jpg" ;
+
+  wPi pi ; // init GPIO
+
+  // One spidev instance per chip select so each display keeps its own speed
+  spiHw spiLCD, spiOLED ;
+
+  if (!spiLCD.spiopen(0,0) || !spiOLED.spiopen(0,1)){
+    fprintf(stderr, "Cannot Open SPI\n") ;
+    return 0;
+  }
+  spiLCD.setSpeed(6000000) ;
+
+  PCF8833LCD lcd ;
+  SDD1306OLED oled ;
+
+  lcd.setGPIO(pi) ;
+  lcd.setSPI(spiLCD) ;
+  lcd.setTime(pi) ;
+  oled.setGPIO(pi) ;
+  oled.setSPI(spiOLED) ;
+  oled.setTime(pi) ;
+
+  if (!lcd.setup(132,132, lcd_reset_pin) || !oled.setup(64,48, oled_dc_pin, oled_reset_pin)){
+    fprintf(stderr,"Failed to set up displays\n") ;
+    return -1 ;
+  }
+
+  // The OLED initialises during the LCD reset delays
+  PanelSequencer sequencer ;
+  sequencer.add(lcd, IDisplay::sequenceInitialise) ;
+  sequencer.add(oled, IDisplay::sequenceInitialise) ;
+  if (!sequencer.run(pi)){
+    fprintf(stderr,"Failed to initialise %s\n", sequencer.isOK(0)?"OLED":"LCD") ;
+    return -1 ;
+  }
+
+  DisplayImage img ;
+  if (!img.loadJPG(szFile)){
+    fprintf(stderr, "Cannot load %s\n", szFile) ;
+    return -1 ;
+  }
+
+  // CS0 and CS1 share SPI bus 0 so the sends take turns
+  FanoutPresenter presenter ;
+  presenter.addDisplay(lcd, 0) ;
+  presenter.addDisplay(oled, 0) ;
+  if (!presenter.start()) return -1 ;
+
+  // The LCD only sends changes after the first frame, so alternate
+  // the orientation to time full frames
+  for (int i=0; i < 8; i++){
+    lcd.setRotation((i % 2) * 180) ;
+    oled.setRotation((i % 2) * 180) ;
+    if (!presenter.present(img)) fprintf(stderr, "Failed to present frame %d\n", i) ;
+    printf("Frame %d: %u us, LCD %u us, OLED %u us, in turn %u us\n", i,
+	   presenter.getLastMicros(), presenter.getDisplayMicros(0),
+	   presenter.getDisplayMicros(1), presenter.getSerialMicros()) ;
+    pi.milliSleep(1000) ;
+  }
+
+  presenter.stop() ;
+
+  return 0 ;
+}
@@ -2,6 +2,11 @@
 #include "wpihardware.hpp"
 #include "spihardware.hpp"
 #include "pcf8833lcd.hpp"
+#include "lcdconsole.hpp"
+#include "framepacer.hpp"
+#include "spriteanimation.hpp"
+#include "jpegloader.hpp"
+#include "slideshow.hpp"
 #include "displayimage.hpp"
 #include <stdio.h>
 #include <sys/types.h>
@@ -44,6 +49,63 @@ bool textTest(PCF8833LCD &lcd)
   return true ;
 }
 
+bool consoleTest(PCF8833LCD &lcd)
+{
+  DisplayFont fnt ;
+  LCDConsole console ;
+  int fontfile = 0;
+  char szLine[32] ;
+
+  if ((fontfile=open("fonts/6x9.fnt", O_RDONLY)) < 0) return false ;
+  if (!fnt.loadFile(fontfile)) return false ;
+
+  lcd.setBackground(0x00, 0x00, 0x00) ;
+  lcd.setForeground(0x00, 0x0F, 0x00) ;
+
+  // 6x9 font, 9 pixel lines
+  if (!console.open(lcd, fnt, 9)) return false ;
+
+  for (int i=0; i < 40; i++){
+    sprintf(szLine, "Log line %d", i) ;
+    if (!console.print(szLine)) return false ;
+  }
+
+  return console.close() ;
+}
+
+bool freetypeTest(PCF8833LCD &lcd, IHardwareTimer &pi)
+{
+  FontAtlas atlas ;
+  char szLine[32] ;
+  int face = atlas.loadFace("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf") ;
+
+  if (face < 0){
+    fprintf(stdout, "Cannot open TrueType font, skipping this test\n") ;
+    return true ;
+  }
+
+  lcd.setBackground(0x00, 0x00, 0x04) ;
+  lcd.setForeground(0x0F, 0x0F, 0x00) ;
+  lcd.clearImage() ;
+  lcd.writeText(atlas, face, 20, "Anti-aliased", 4, 4) ;
+  lcd.writeText(atlas, face, 12, "FreeType text 21\xC2\xB0" "C", 4, 32) ;
+
+  // Glyphs are only rasterised for the first frame
+  for (int i=0; i < 100; i++){
+    sprintf(szLine, "Count %d", i) ;
+    lcd.setClip(0, 60, lcd.getWidth(), 30) ;
+    lcd.clearImage() ;
+    lcd.writeText(atlas, face, 24, szLine, 4, 60) ;
+    lcd.clearClip() ;
+    if (!lcd.display()) return false ;
+    pi.milliSleep(20) ;
+  }
+  printf("Glyph atlas: %u glyphs, %u bytes, %u hits, %u misses\n",
+	 atlas.getGlyphs(), atlas.getBytes(), atlas.getHits(), atlas.getMisses()) ;
+
+  return true ;
+}
+
 bool resTest(PCF8833LCD &lcd)
 {
   DisplayImage img ;
@@ -63,6 +125,32 @@ bool resTest(PCF8833LCD &lcd)
   return true ;
 }
 
+bool scaleTest(PCF8833LCD &lcd, IHardwareTimer &pi)
+{
+  DisplayImage img ;
+  const ImageScale::enFilter filters[3] = {ImageScale::nearest, ImageScale::bilinear, ImageScale::box} ;
+  unsigned int height = (lcd.getWidth() * Xbitmap_height) / Xbitmap_width ;
+
+  if (!img.loadXBM(Xbitmap_width, Xbitmap_height, Xbitmap_bits)) return false ;
+
+  // Fill the width keeping the shape, then shrink back down
+  lcd.clearImage() ;
+  for (int i=0; i < 3; i++){
+    if (!lcd.writeScaled(img, filters[i], 0, (lcd.getHeight() - height) / 2, lcd.getWidth(), height)) return false ;
+    if (!lcd.display()) return false ;
+    pi.milliSleep(1500) ;
+  }
+
+  lcd.clearImage() ;
+  for (int i=0; i < 3; i++){
+    if (!lcd.writeScaled(img, filters[i], i * 44, 50, 44, 33)) return false ;
+  }
+  if (!lcd.display()) return false ;
+  pi.milliSleep(1500) ;
+
+  return true ;
+}
+
 bool aniTest(PCF8833LCD &lcd, IHardwareTimer &pi)
 {
   DisplayImage img ;
@@ -74,45 +162,89 @@ bool aniTest(PCF8833LCD &lcd, IHardwareTimer &pi)
     return false ;
   }else{
     DisplayImage img2 ;
+    FrameCache cache ;
     if (!img.loadFile(testfile)) fprintf(stderr, "Failed to load test file 1 into image object\n") ;
     if (!img2.loadFile(testfile2)) fprintf(stderr, "Failed to load test file 2 into image object\n") ;
+
+    // Each frame is only converted and encoded the first time it is shown
+    lcd.setFrameCache(&cache) ;
     for (int i=0; i < 5; i++){ // iterate loops of animation
-      if (!lcd.writeImage(img2, PCF8833LCD::overwrite)){
-	fprintf(stderr, "Failed to write image 2 to LCD object\n") ;
-	return false ;
-      }
-      if (!lcd.display()) fprintf(stderr, "LCD display write failed\n") ;
+      if (!lcd.displayImage(img2)) fprintf(stderr, "Failed to display image 2\n") ;
       pi.milliSleep(200) ;
-      if (!lcd.writeImage(img, PCF8833LCD::overwrite)){
-	fprintf(stderr, "Failed to write image 1 to LCD object\n") ;
-	return false ;
-      }
-      if (!lcd.display()) fprintf(stderr, "LCD display write failed\n") ;
+      if (!lcd.displayImage(img)) fprintf(stderr, "Failed to display image 1\n") ;
       pi.milliSleep(200) ;
     }
+    lcd.setFrameCache(NULL) ;
+    printf("Frame cache hits %u, misses %u\n", cache.getHits(), cache.getMisses()) ;
   }
 
   return true ;
 }
 
-bool jpgTest(PCF8833LCD &lcd, const char szFile[])
+bool spriteTest(PCF8833LCD &lcd, IHardwareTimer &pi)
 {
-  DisplayImage img ;
+  DisplayImage img, img2 ;
+  SpriteAnimation ani ;
+  FramePacer pacer(pi, 10) ;
+  int testfile = 0, testfile2 = 0 ;
 
-  if (!img.loadJPG(szFile)){
+  if ((testfile=open("images/gear1.bin", O_RDONLY)) < 0 || (testfile2=open("images/gear2.bin", O_RDONLY)) < 0){
+    fprintf(stdout, "Cannot open test files, skipping this test\n") ;
+    return false ;
+  }
+  if (!img.loadFile(testfile) || !img2.loadFile(testfile2)){
+    fprintf(stderr, "Failed to load sprite frames\n") ;
     return false ;
   }
 
-  if (!lcd.writeImage(img, PCF8833LCD::overwrite)){
-    fprintf(stderr, "Failed to write image to LCD image buffer\n") ;
+  // Frames are encoded once. Playing only sends the gear window
+  ani.open(lcd, 34, 42) ;
+  if (!ani.addFrame(img) || !ani.addFrame(img2)) return false ;
+  if (!ani.play(pacer, 20)) return false ;
+
+  return ani.close() ;
+}
+
+bool jpgTest(PCF8833LCD &lcd, const char szFile[])
+{
+  JPEGTimings t ;
+
+  // Decodes at a reduced scale with bands sent to the LCD as they are ready
+  if (!JPEGLoader::loadPipelined(lcd, szFile, &t)){
+    fprintf(stderr, "Failed to load JPEG %s\n", szFile) ;
     return false ;
   }
 
-  if (!lcd.display()) fprintf(stderr, "LCD display write failed\n") ;
+  printf("%s first pixel %.1fms, total %.1fms, decode %.1fms, convert %.1fms, send %.1fms\n",
+	 szFile, t.firstPixel / 1000.0, t.total / 1000.0,
+	 t.decode / 1000.0, t.convert / 1000.0, t.send / 1000.0) ;
   
   return true ;
 }
 
+bool slideTest(PCF8833LCD &lcd, wPi &pi)
+{
+  Slideshow show ;
+  Slideshow::SlideshowStats stats ;
+
+  // Converted frames are kept so a second run maps them from disk
+  show.setCacheDir("/tmp/nokia6100-cache") ;
+  if (!show.open(lcd, "images")) return false ;
+
+  for (unsigned int i=0; i < show.getImages(); i++){
+    if (!show.next()) fprintf(stderr, "Failed to show %s\n", show.getImagePath(i)) ;
+    pi.milliSleep(1500) ;
+  }
+
+  show.getStats(stats) ;
+  printf("Slideshow %u shown, %u ready, %u decoded, %u from cache, wait %.1fms, decode %.1fms, map %.1fms\n",
+	 stats.shown, stats.ready, stats.decoded, stats.cacheHits,
+	 stats.waitMicros / 1000.0, stats.decodeMicros / 1000.0, stats.mapMicros / 1000.0) ;
+  show.close() ;
+
+  return true ;
+}
+
 int main(int argc, char **argv)
 {
   // BCM pin
@@ -159,17 +291,33 @@ int main(int argc, char **argv)
   
   printf("Animating display...\n") ;
 
+  // Animation frames are smaller in 8 bit colour
+  lcd.setColourMode(PCF8833LCD::colour8bit) ;
   aniTest(lcd, pi) ;
+  lcd.setColourMode(PCF8833LCD::colour12bit) ;
+
+  printf("Sprite animation...\n") ;
+  if (!spriteTest(lcd, pi)) fprintf(stderr, "Failed to run sprite test\n") ;
   
   pi.milliSleep(1000) ;
 
   if (!textTest(lcd)) fprintf(stderr, "Failed to run text test\n") ;
 
+  pi.milliSleep(2000) ;
+
+  if (!consoleTest(lcd)) fprintf(stderr, "Failed to run console test\n") ;
+
+  pi.milliSleep(2000) ;
+
+  if (!freetypeTest(lcd, pi)) fprintf(stderr, "Failed to run FreeType test\n") ;
+
   pi.milliSleep(2000) ;
   
   resTest(lcd) ;
 
   pi.milliSleep(2000) ;
+
+  if (!scaleTest(lcd, pi)) fprintf(stderr, "Failed to run scale test\n") ;
   
 
   printf("Loading testing JPEG file\n") ;
@@ -183,7 +331,17 @@ int main(int argc, char **argv)
   pi.milliSleep(3000) ;
   jpgTest(lcd, "images/test4.jpg") ;
 
-  pi.milliSleep(5000) ;
+  pi.milliSleep(2000) ;
+
+  printf("Slideshow of images\n") ;
+  if (!slideTest(lcd, pi)) fprintf(stderr, "Failed to run slideshow\n") ;
+
+  // Flash then fade out without resending the picture
+  FramePacer pacer(pi, 30) ;
+  lcd.flash(3, 300) ;
+  while (lcd.stepEffect(pacer.wait())) ;
+  lcd.fadeContrast(-20, 2000) ;
+  while (lcd.stepEffect(pacer.wait())) ;
   
   lcd.turnOff();
   
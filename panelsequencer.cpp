@@ -0,0 +1,86 @@
+#include "panelsequencer.hpp"
+#include "framepacer.hpp"
+#include <stdio.h>
+
+PanelSequencer::PanelSequencer()
+{
+  m_nPanels = 0 ;
+  m_nLastPanels = 0 ;
+  m_nRunMicros = 0 ;
+}
+
+bool PanelSequencer::add(IDisplay &panel, IDisplay::enSequence eSequence)
+{
+  if (m_nPanels >= SEQUENCER_MAX_PANELS){
+    fprintf(stderr, "add: limited to %d panels\n", SEQUENCER_MAX_PANELS) ;
+    return false ;
+  }
+  for (unsigned int i=0; i < m_nPanels; i++){
+    if (m_panels[i].pPanel == &panel){
+      fprintf(stderr, "add: panel already queued\n") ;
+      return false ;
+    }
+  }
+
+  m_panels[m_nPanels].pPanel = &panel ;
+  m_panels[m_nPanels].eSequence = eSequence ;
+  m_panels[m_nPanels].due = 0 ;
+  m_panels[m_nPanels].bRunning = false ;
+  m_panels[m_nPanels].bOK = false ;
+  m_nPanels++ ;
+
+  return true ;
+}
+
+bool PanelSequencer::run(IHardwareTimer &timer)
+{
+  uint64_t start = FramePacer::timeMicros(), now = start, next = 0 ;
+  unsigned int i = 0, nRunning = 0 ;
+  int delay = 0 ;
+  bool bOK = true ;
+
+  for (i=0; i < m_nPanels; i++){
+    m_panels[i].bRunning = m_panels[i].pPanel->startSequence(m_panels[i].eSequence) ;
+    m_panels[i].bOK = m_panels[i].bRunning ;
+    m_panels[i].due = start ;
+    if (m_panels[i].bRunning) nRunning++ ;
+  }
+
+  while (nRunning > 0){
+    // Step every panel which is due
+    next = 0 ;
+    for (i=0; i < m_nPanels; i++){
+      SequencePanel &panel = m_panels[i] ;
+
+      if (!panel.bRunning) continue ;
+      if (panel.due <= now){
+	delay = panel.pPanel->stepSequence() ;
+	if (delay <= 0){
+	  panel.bRunning = false ;
+	  panel.bOK = delay == 0 ;
+	  nRunning-- ;
+	  continue ;
+	}
+	panel.due = FramePacer::timeMicros() + ((uint64_t)delay * 1000) ;
+      }
+      if (next == 0 || panel.due < next) next = panel.due ;
+    }
+
+    // Sleep until the next panel is due
+    now = FramePacer::timeMicros() ;
+    if (nRunning > 0 && next > now){
+      // microSleep is only accurate for short waits on some timers
+      if (next - now >= 1000) timer.milliSleep((unsigned int)((next - now) / 1000)) ;
+      else timer.microSleep((unsigned int)(next - now)) ;
+      now = FramePacer::timeMicros() ;
+    }
+  }
+
+  for (i=0; i < m_nPanels; i++) bOK = bOK && m_panels[i].bOK ;
+
+  m_nRunMicros = (uint32_t)(FramePacer::timeMicros() - start) ;
+  m_nLastPanels = m_nPanels ;
+  m_nPanels = 0 ;
+
+  return bOK ;
+}
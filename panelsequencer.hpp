@@ -0,0 +1,52 @@
+#ifndef __PANEL_SEQUENCER_HPP
+#define __PANEL_SEQUENCER_HPP
+
+#include "idisplay.hpp"
+#include "hardware.hpp"
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// Runs power sequences for several panels on one
+// thread. Each panel is stepped when its delay is
+// over and the thread only sleeps until the next
+// panel is due, so the delays overlap. Bringing up
+// several LCDs takes about as long as one
+//
+///////////////////////////////////////////////////
+
+#define SEQUENCER_MAX_PANELS 16
+
+class PanelSequencer{
+public:
+  PanelSequencer() ;
+
+  // Queue a sequence for a set up panel. A panel can only be queued once
+  bool add(IDisplay &panel, IDisplay::enSequence eSequence) ;
+
+  // Run every queued sequence to the end, sleeping on timer between
+  // steps. Returns false if any sequence failed. The queue is cleared
+  bool run(IHardwareTimer &timer) ;
+
+  // Result of a panel from the last run
+  bool isOK(unsigned int n){return n < m_nLastPanels && m_panels[n].bOK;}
+
+  // Time the last run took in microseconds
+  uint32_t getRunMicros(){return m_nRunMicros;}
+
+protected:
+  struct SequencePanel{
+    IDisplay *pPanel ;
+    IDisplay::enSequence eSequence ;
+    uint64_t due ; // time of the next step
+    bool bRunning ;
+    bool bOK ;
+  };
+
+  SequencePanel m_panels[SEQUENCER_MAX_PANELS] ;
+  unsigned int m_nPanels ;
+  unsigned int m_nLastPanels ;
+  uint32_t m_nRunMicros ;
+};
+
+#endif // __PANEL_SEQUENCER_HPP
@@ -1,4 +1,7 @@
 #include "pcf8833lcd.hpp"
+#include "colourconvert.hpp"
+#include "blit.hpp"
+#include "raster.hpp"
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -14,14 +17,42 @@ PCF8833LCD::PCF8833LCD()
   m_height = 132 ;
   m_pDisplay = 0 ;
   m_nDisplaySize = 0;
+  m_eColour = colour12bit ;
+  m_nBytesPerPixel = 3 ;
+  m_bDither = false ;
+  m_pPrevious = 0 ;
+  m_bPreviousValid = false ;
+  m_pWire = 0 ;
+  m_nWireSize = 0 ;
+  m_bWireValid = false ;
+  m_pScaled = NULL ;
+  m_nScaledSize = 0 ;
+  m_pCache = NULL ;
+  m_nDirty = 0 ;
+  resetStats() ;
   m_nMADCTL = 0x10 ; // no mirroring for x and y. line progression top to bottom. RGB colour
+  m_bYTop = false ;
+  m_nRotation = 0 ;
+  m_nContrast = 0x3F ;
+  m_bInverse = false ;
+  m_bDisplayOn = false ;
+  m_effect.setApply(applyEffect, this) ;
+  m_eSequence = sequenceInitialise ;
+  m_nStep = 0 ;
+  m_bSequence = false ;
   m_nBGCol = 0x0F00 ; // Red
   m_nFGCol = 0x0FFF ; // White
+  updateColours() ;
 }
 
 PCF8833LCD::~PCF8833LCD()
 {
+  // The present thread uses the buffers
+  stopPresenter() ;
   if (m_pDisplay) delete[] m_pDisplay ;
+  if (m_pPrevious) delete[] m_pPrevious ;
+  if (m_pWire) delete[] m_pWire ;
+  if (m_pScaled) delete[] m_pScaled ;
 }
 
 void PCF8833LCD::setGPIO(IHardwareGPIO &gpio)
@@ -50,10 +81,20 @@ bool PCF8833LCD::setup(unsigned int width, unsigned int height, unsigned int res
   // Allocate memory
   m_nDisplaySize = width * height * 3 ;
   m_pDisplay = new uint8_t[m_nDisplaySize] ;
-  if (!m_pDisplay){
+  m_pPrevious = new uint8_t[m_nDisplaySize] ;
+
+  // Wire image is sized for 12 bit colour. Window commands, 3 bytes for
+  // every 2 pixels and NOOP padding to complete the last 9 byte group
+  m_nWireSize = ((PCF8833_WINDOW_OVERHEAD + (((width * height) + 1) / 2) * 3 + 7) / 8) * 9 ;
+  m_pWire = new uint8_t[m_nWireSize] ;
+  m_bWireValid = false ;
+
+  if (!m_pDisplay || !m_pPrevious || !m_pWire){
     fprintf(stderr, "setup: Memory error\n") ; 
     return false ;
   }
+  invalidate() ;
+  clearClip() ;
 
   m_pGPIO->setup(m_resetpin, IHardwareGPIO::gpio_output) ;
   
@@ -86,243 +127,1860 @@ bool PCF8833LCD::writeData(uint8_t byte)
 
 bool PCF8833LCD::turnOff()
 {
-  if (!writeCmd(0x28)) return false ;
-  if (!writeCmd(0x10)) return false ;
+  return runSequence(sequenceTurnOff) ;
+}
+
+bool PCF8833LCD::turnOn()
+{
+  return runSequence(sequenceTurnOn) ;
+}
+
+bool PCF8833LCD::initialise()
+{
+  return runSequence(sequenceInitialise) ;
+}
+
+bool PCF8833LCD::runSequence(enSequence eSequence)
+{
+  int delay = 0 ;
+
+  if (!startSequence(eSequence)) return false ;
+  while ((delay = stepSequence()) > 0) m_pTime->milliSleep(delay) ;
+
+  return delay == 0 ;
+}
+
+bool PCF8833LCD::startSequence(enSequence eSequence)
+{
+  if (!verify()) return false ;
+
+  m_eSequence = eSequence ;
+  m_nStep = 0 ;
+  m_bSequence = true ;
 
-  m_pSPI->flush9bit(0, 0x00) ;
   return true ;
 }
 
-bool PCF8833LCD::turnOn()
+int PCF8833LCD::stepSequence()
+{
+  int delay = -1 ;
+
+  if (!m_bSequence) return 0 ;
+
+  switch (m_eSequence){
+  case sequenceInitialise: delay = stepInitialise(m_nStep) ; break ;
+  case sequenceTurnOn: delay = stepTurnOn(m_nStep) ; break ;
+  case sequenceTurnOff: delay = stepTurnOff(m_nStep) ; break ;
+  }
+  m_nStep++ ;
+
+  if (delay <= 0) m_bSequence = false ;
+
+  return delay ;
+}
+
+int PCF8833LCD::stepTurnOff(int step)
 {
-  if (!writeCmd(0x11)) return false ;
-  if (!writeCmd(0x03)) return false ;
-  m_pTime->milliSleep(1000) ;
-  if (!writeCmd(0x29)) return false ;
+  if (step > 0) return -1 ;
+
+  if (!writeCmd(0x28)) return -1 ;
+  if (!writeCmd(0x10)) return -1 ;
 
   m_pSPI->flush9bit(0, 0x00) ;
-  return true ;
+  m_bDisplayOn = false ;
+  return 0 ;
 }
 
-bool PCF8833LCD::initialise()
+int PCF8833LCD::stepTurnOn(int step)
+{
+  switch (step){
+  case 0:
+    if (!writeCmd(0x11)) return -1 ;
+    if (!writeCmd(0x03)) return -1 ;
+    m_pSPI->flush9bit(0, 0x00) ;
+    return 1000 ;
+
+  case 1:
+    if (!writeCmd(0x29)) return -1 ;
+    m_pSPI->flush9bit(0, 0x00) ;
+    m_bDisplayOn = true ;
+    return 0 ;
+  }
+
+  return -1 ;
+}
+
+int PCF8833LCD::stepInitialise(int step)
+{
+  switch (step){
+  case 0:
+    m_pSPI->setMode(0) ; // CPOL = 0, CPHA = 0
+    m_pSPI->setCSHigh(false) ; // CS is low for writing data
+
+    m_pGPIO->setup(m_resetpin, IHardwareGPIO::gpio_output) ;
+
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
+    return 2000 ;
+
+  case 1:
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::high) ;
+    return 2000 ;
+
+  case 2:
+    // SLEEPOUT - turn on booster circuits
+    if (!writeCmd(0x11)) return -1 ;
+
+    // turn on booster voltage
+    writeCmd(0x03) ;
+
+    // Inversion off - not sure why it needs to be on
+    writeCmd(0x20) ;
+    m_bInverse = false ;
+
+    // Colour pixel format 12 or 8 bits
+    sendColourMode() ;
+
+    // Set up memory access controller. MADCTL 0x36
+    // Data is 0xX8 - BGR
+    // 0xX0 - RGB
+    // 0x1X - no mirror x or y. RAM write in x direction. Line addressing top to bottom
+    // 0x9X - mirror y. x not mirrored. RAM write in x direction. Line addressing top to bottom
+    // 0xCX - mirror x and y. RAM write in x direction. Line addressing top to bottom
+    // 0x0X - no mirror x or y. RAM write in x direction. Line addressing bottom to top.
+    writeCmd(0x36) ;
+    writeData(m_nMADCTL) ;
+
+    // Set contrast
+    writeCmd(0x25) ;
+    //writeData(0x30) ;
+    writeData(0x3F) ; // Increased a bit more for images
+    m_nContrast = 0x3F ;
+
+    m_pSPI->flush9bit(0, 0x00) ;
+    return 2000 ;
+
+  case 3:
+    // display on
+    writeCmd(0x29) ;
+    m_bDisplayOn = true ;
+
+    // Flush out NOOP command to bus
+    m_pSPI->flush9bit(0, 0x00) ;
+
+    // LCD RAM is undefined after reset
+    invalidate() ;
+    return 0 ;
+  }
+
+  return -1 ;
+}
+
+void PCF8833LCD::updateMADCTL()
+{
+  // Mirror y (MY 0x80), mirror x (MX 0x40) and exchange x and y (MV 0x20)
+  // bits for each rotation. setYOrigin flips MY on top of the rotation
+  const uint8_t rotation[4] = {0x00, 0x60, 0xC0, 0xA0} ;
+
+  m_nMADCTL = 0x10 ^ rotation[m_nRotation / 90] ;
+  if (m_bYTop) m_nMADCTL ^= 0x80 ;
+}
+
+bool PCF8833LCD::setYOrigin(bool bTop)
 {
   if (!verify()) return false ;
 
-  m_pSPI->setMode(0) ; // CPOL = 0, CPHA = 0
-  m_pSPI->setCSHigh(false) ; // CS is low for writing data
+  writeCmd(0x36) ;
+  // COM scan mapping (ascending or descending)
+  m_bYTop = bTop ;
+  updateMADCTL() ;
+
+  writeData(m_nMADCTL) ; 
 
-  m_pGPIO->setup(m_resetpin, IHardwareGPIO::gpio_output) ;
-  
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
-  m_pTime->milliSleep(2000) ; 
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::high) ;
-  m_pTime->milliSleep(2000) ;
+  // Flush out NOOP command to bus
+  m_pSPI->flush9bit(0, 0x00) ;
+
+  // Existing RAM content is now mirrored so redraw everything
+  invalidate() ;
 
-  // SLEEPOUT - turn on booster circuits
-  if (!writeCmd(0x11)) return false ;
+  return true ;
+}
+
+bool PCF8833LCD::setRotation(unsigned int degrees)
+{
+  unsigned int swap = 0 ;
 
-  // turn on booster voltage
-  writeCmd(0x03) ;
+  if (!verify()) return false ;
 
-  // Inversion off - not sure why it needs to be on
-  writeCmd(0x20) ;
+  if (degrees % 90 || degrees > 270){
+    fprintf(stderr, "setRotation: only 0, 90, 180 and 270 are supported\n") ;
+    return false ;
+  }
+
+  // Width and height swap when moving between landscape and portrait.
+  // The display buffer is the same size either way
+  if ((degrees / 90) % 2 != (m_nRotation / 90) % 2){
+    swap = m_width ;
+    m_width = m_height ;
+    m_height = swap ;
+  }
+  m_nRotation = degrees ;
+  m_bWireValid = false ; // row length may have changed
+  updateMADCTL() ;
 
-  // Colour pixel format 12 bits
-  writeCmd(0x3A) ;
-  writeData(0x03) ;
-
-  // Set up memory access controller. MADCTL 0x36
-  // Data is 0xX8 - BGR
-  // 0xX0 - RGB
-  // 0x1X - no mirror x or y. RAM write in x direction. Line addressing top to bottom
-  // 0x9X - mirror y. x not mirrored. RAM write in x direction. Line addressing top to bottom
-  // 0xCX - mirror x and y. RAM write in x direction. Line addressing top to bottom
-  // 0x0X - no mirror x or y. RAM write in x direction. Line addressing bottom to top.
   writeCmd(0x36) ;
-  writeData(m_nMADCTL) ;
+  if (!writeData(m_nMADCTL)) return false ;
+
+  // Flush out NOOP command to bus
+  m_pSPI->flush9bit(0, 0x00) ;
+
+  // Windows are now in rotated coordinates
+  clearClip() ;
+  invalidate() ;
+
+  return true ;
+}
+
+bool PCF8833LCD::setContrast(int contrast)
+{
+  if (!verify()) return false ;
 
-  // Set contrast
+  if (contrast < -64) contrast = -64 ;
+  if (contrast > 63) contrast = 63 ;
+
+  // Set contrast (command 0x25). 7 bit two's complement
   writeCmd(0x25) ;
-  //writeData(0x30) ;
-  writeData(0x3F) ; // Increased a bit more for images
+  if (!writeData(contrast & 0x7F)) return false ;
+
+  m_pSPI->flush9bit(0, 0x00) ;
+  m_nContrast = contrast ;
+  return true ;
+}
 
-  m_pTime->milliSleep(2000) ;
+bool PCF8833LCD::setInverse(bool bInverse)
+{
+  if (!verify()) return false ;
 
-  // display on
-  writeCmd(0x29) ;
+  // Inversion on (command 0x21) or off (command 0x20)
+  if (!writeCmd(bInverse?0x21:0x20)) return false ;
 
-  // Flush out NOOP command to bus
   m_pSPI->flush9bit(0, 0x00) ;
-  
+  m_bInverse = bInverse ;
   return true ;
 }
 
-bool PCF8833LCD::setYOrigin(bool bTop)
+bool PCF8833LCD::setDisplayOn(bool bOn)
 {
   if (!verify()) return false ;
 
-  writeCmd(0x36) ;
-  // COM scan mapping (ascending or descending)
-  if (bTop) m_nMADCTL |= 0x80 ; 
-  else m_nMADCTL &= ~0x80 ;
+  // Display on (command 0x29) or off (command 0x28). LCD RAM is kept
+  if (!writeCmd(bOn?0x29:0x28)) return false ;
 
-  writeData(m_nMADCTL) ; 
+  m_pSPI->flush9bit(0, 0x00) ;
+  m_bDisplayOn = bOn ;
+  return true ;
+}
+
+bool PCF8833LCD::fadeContrast(int to, unsigned int duration)
+{
+  if (!verify()) return false ;
+
+  m_effect.startFade(m_nContrast, to, duration) ;
+  return true ;
+}
+
+bool PCF8833LCD::blink(unsigned int count, unsigned int period)
+{
+  if (!verify()) return false ;
+
+  m_effect.startBlink(count, period) ;
+  return true ;
+}
+
+bool PCF8833LCD::flash(unsigned int count, unsigned int period)
+{
+  if (!verify()) return false ;
+
+  m_effect.startFlash(count, period) ;
+  return true ;
+}
+
+bool PCF8833LCD::stepEffect(unsigned int elapsed)
+{
+  return m_effect.step(elapsed) ;
+}
+
+void PCF8833LCD::stopEffect()
+{
+  m_effect.stop() ;
+}
+
+void PCF8833LCD::applyEffect(void *pContext, DisplayEffect &effect, DisplayEffect::enEffect eEffect)
+{
+  PCF8833LCD *pLCD = (PCF8833LCD *)pContext ;
+
+  // Only the register used by the effect is changed and only
+  // when the value is different to the panel
+  switch(eEffect){
+  case DisplayEffect::fade:
+    if (effect.getContrast() != pLCD->m_nContrast) pLCD->setContrast(effect.getContrast()) ;
+    break ;
+  case DisplayEffect::blink:
+    if (effect.isOn() != pLCD->m_bDisplayOn) pLCD->setDisplayOn(effect.isOn()) ;
+    break ;
+  case DisplayEffect::flash:
+    if (effect.isInverted() != pLCD->m_bInverse) pLCD->setInverse(effect.isInverted()) ;
+    break ;
+  default:
+    break ;
+  }
+}
+
+bool PCF8833LCD::sendColourMode()
+{
+  writeCmd(0x3A) ;
+  if (m_eColour == colour12bit){
+    return writeData(0x03) ;
+  }
+
+  writeData(0x02) ;
+
+  // RGBSET colour table maps 8 bit pixels to 12 bit colour
+  writeCmd(0x2D) ;
+  for (int i=0; i < 20; i++){
+    if (!writeData(ColourConvert::s_lut332[i])) return false ;
+  }
+  return true ;
+}
+
+bool PCF8833LCD::setColourMode(enColour eColour)
+{
+  if (!verify()) return false ;
+
+  if (eColour == m_eColour) return true ;
+
+  if (m_pDisplay){
+    if (eColour == colour8bit){
+      ColourConvert::rgb444ToRGB332(m_pDisplay, m_pDisplay, m_width * m_height) ;
+    }else{
+      ColourConvert::rgb332ToRGB444(m_pDisplay, m_pDisplay, m_width * m_height) ;
+    }
+  }
+
+  m_eColour = eColour ;
+  m_nBytesPerPixel = eColour == colour8bit?1:3 ;
+  m_bWireValid = false ;
+  updateColours() ;
+
+  if (!sendColourMode()) return false ;
 
   // Flush out NOOP command to bus
   m_pSPI->flush9bit(0, 0x00) ;
 
+  // Previous frame copy is in the old format
+  invalidate() ;
+
   return true ;
 }
 
-bool PCF8833LCD::clearImage()
+void PCF8833LCD::updateColours()
+{
+  uint16_t cols[2] = {m_nBGCol, m_nFGCol} ;
+  uint8_t *pixels[2] = {m_bgPixel, m_fgPixel} ;
+  uint8_t *pEntry = NULL, *pMask = NULL ;
+  int set = 0 ;
+
+  for (int i=0; i < 2; i++){
+    pixels[i][0] = 0x0F & (cols[i] >> 8) ; // red
+    pixels[i][1] = 0x0F & (cols[i] >> 4) ; // green
+    pixels[i][2] = 0x0F & cols[i] ; // blue
+    if (m_eColour == colour8bit){
+      pixels[i][0] = ColourConvert::packRGB332(pixels[i][0], pixels[i][1], pixels[i][2]) ;
+    }
+  }
+
+  // Bits are in pixel order from the least significant bit
+  for (int b=0; b < 256; b++){
+    pEntry = m_lut1bpp[b] ;
+    pMask = m_lutMask[b] ;
+    for (int bit=0; bit < 8; bit++){
+      set = b & (1 << bit) ;
+      for (int c=0; c < m_nBytesPerPixel; c++){
+	*pEntry++ = set?m_fgPixel[c]:m_bgPixel[c] ;
+	*pMask++ = set?0xFF:0x00 ;
+      }
+    }
+  }
+}
+
+void PCF8833LCD::fillSpan(uint8_t *pDst, int nPixels, const uint8_t *pColour)
+{
+  int done = 1, n = 0 ;
+
+  if (nPixels <= 0) return ;
+
+  if (m_eColour == colour8bit){
+    memset(pDst, pColour[0], nPixels) ;
+    return ;
+  }
+
+  // Copy the pixels already written so each copy doubles the span
+  memcpy(pDst, pColour, 3) ;
+  for (; done < nPixels; done += n){
+    n = done < nPixels - done?done:nPixels - done ;
+    memcpy(pDst + (done * 3), pDst, n * 3) ;
+  }
+}
+
+void PCF8833LCD::xorSpan(uint8_t *pDst, int nPixels, const uint8_t *pColour)
+{
+  uint8_t pattern[12] ;
+  uint32_t words[3], d = 0 ;
+
+  if (m_eColour == colour8bit){
+    for (int i=0; i < nPixels; i++) pDst[i] ^= pColour[0] ;
+    return ;
+  }
+
+  // 4 pixels are 3 whole words
+  for (int k=0; k < 12; k++) pattern[k] = pColour[k % 3] ;
+  memcpy(words, pattern, 12) ;
+  for (; nPixels >= 4; nPixels -= 4, pDst += 12){
+    for (int w=0; w < 3; w++){
+      memcpy(&d, pDst + (w * 4), 4) ;
+      d ^= words[w] ;
+      memcpy(pDst + (w * 4), &d, 4) ;
+    }
+  }
+  for (int i=0; i < nPixels * 3; i++) pDst[i] ^= pattern[i] ;
+}
+
+void PCF8833LCD::fillClipped(int x0, int y0, int x1, int y1, bool bInvert)
+{
+  uint8_t *pRow = NULL ;
+
+  if (x0 < m_clip.x0) x0 = m_clip.x0 ;
+  if (y0 < m_clip.y0) y0 = m_clip.y0 ;
+  if (x1 > m_clip.x1) x1 = m_clip.x1 ;
+  if (y1 > m_clip.y1) y1 = m_clip.y1 ;
+  if (x0 > x1 || y0 > y1) return ;
+
+  for (int y=y0; y <= y1; y++){
+    pRow = m_pDisplay + ((x0 + (y * m_width)) * m_nBytesPerPixel) ;
+    if (bInvert) xorSpan(pRow, x1 - x0 + 1, m_fgPixel) ;
+    else fillSpan(pRow, x1 - x0 + 1, m_fgPixel) ;
+    if (m_bWireValid) encodeWire(m_pDisplay, m_pWire, y, x0, x1) ;
+  }
+}
+
+void PCF8833LCD::rasterSpan(void *pContext, int x0, int x1, int y)
+{
+  SpanContext *pSpan = (SpanContext *)pContext ;
+  pSpan->pLCD->fillClipped(x0, y, x1, y, pSpan->bInvert) ;
+}
+
+void PCF8833LCD::markClipped(int x0, int y0, int x1, int y1)
+{
+  markDirty(x0 < m_clip.x0?m_clip.x0:x0, y0 < m_clip.y0?m_clip.y0:y0,
+	    x1 > m_clip.x1?m_clip.x1:x1, y1 > m_clip.y1?m_clip.y1:y1) ;
+}
+
+bool PCF8833LCD::drawHLine(int x, int y, unsigned int width, enum enMode eMode)
+{
+  return drawRect(x, y, width, 1, true, eMode) ;
+}
+
+bool PCF8833LCD::drawVLine(int x, int y, unsigned int height, enum enMode eMode)
+{
+  return drawRect(x, y, 1, height, true, eMode) ;
+}
+
+bool PCF8833LCD::drawRect(int x, int y, unsigned int width, unsigned int height, bool bFill, enum enMode eMode)
 {
+  bool bInvert = eMode == exclusive ;
+  int x1 = x + (int)width - 1, y1 = y + (int)height - 1 ;
+
   if (!verify()) return false ;
 
-  uint32_t i = 0 ;
-  while (i < m_nDisplaySize){
-    m_pDisplay[i++] = 0x0F & (m_nBGCol >> 8) ; // red
-    m_pDisplay[i++] = 0x0F & (m_nBGCol >> 4) ; // green    
-    m_pDisplay[i++] = 0x0F & (m_nBGCol) ; // blue
+  if (!m_pDisplay){
+    fprintf(stderr, "drawRect: display not setup\n") ;
+    return false ;
   }
-  
+
+  if (width == 0 || height == 0) return true ;
+
+  if (bFill || width <= 2 || height <= 2){
+    fillClipped(x, y, x1, y1, bInvert) ;
+    markClipped(x, y, x1, y1) ;
+    return true ;
+  }
+
+  // Outline sides don't overlap so exclusive xors each pixel once. Each
+  // side is marked on its own so the middle isn't sent
+  fillClipped(x, y, x1, y, bInvert) ;
+  fillClipped(x, y1, x1, y1, bInvert) ;
+  fillClipped(x, y + 1, x, y1 - 1, bInvert) ;
+  fillClipped(x1, y + 1, x1, y1 - 1, bInvert) ;
+  markClipped(x, y, x1, y) ;
+  markClipped(x, y1, x1, y1) ;
+  markClipped(x, y + 1, x, y1 - 1) ;
+  markClipped(x1, y + 1, x1, y1 - 1) ;
+
   return true ;
 }
 
-bool PCF8833LCD::writeImage(DisplayImage &img, enum enMode eMode, int xoffset, int yoffset)
+bool PCF8833LCD::drawLine(int x0, int y0, int x1, int y1, enum enMode eMode)
 {
-  int val = 0;
-  int imgx=0, imgy =0;
-  uint32_t pixel =0, srcpixel = 0;
+  SpanContext span ;
 
   if (!verify()) return false ;
 
-  if (img.m_colourbitdepth != 1 && img.m_colourbitdepth != 32){
-    fprintf(stderr, "Unsupported colour bit depth\n") ;
+  if (!m_pDisplay){
+    fprintf(stderr, "drawLine: display not setup\n") ;
     return false ;
   }
 
+  span.pLCD = this ;
+  span.bInvert = eMode == exclusive ;
+  Raster::line(x0, y0, x1, y1, rasterSpan, &span) ;
+  markClipped(x0 < x1?x0:x1, y0 < y1?y0:y1, x0 < x1?x1:x0, y0 < y1?y1:y0) ;
+
+  return true ;
+}
+
+bool PCF8833LCD::drawCircle(int cx, int cy, unsigned int radius, bool bFill, enum enMode eMode)
+{
+  SpanContext span ;
+  int r = (int)radius ;
+
+  if (!verify()) return false ;
+
   if (!m_pDisplay){
-    fprintf(stderr, "writeImage: display not setup\n") ;
+    fprintf(stderr, "drawCircle: display not setup\n") ;
     return false ;
   }
 
-  // iterate through the display buffer not the image buffer being written.
-  // This should auto clip any parts of the image outside of the buffer region
-  for (int cy=0; cy < (int)m_height; cy++){
-    for (int cx=0; cx < (int)m_width; cx++){
-      imgx = cx - xoffset ;
-      imgy = cy - yoffset ;
-      if (imgx < 0 || imgx >= (int)img.m_width || imgy < 0 || imgy >= (int)img.m_height){
-	val = -1; // outside of image
-      }
-      else{
-	if (img.m_colourbitdepth == 1){
-	  // Image buffer is a bit array with bytes assigned along rows
-	  val = img.m_img[imgx/8+(imgy*img.m_stride)] & (1 << (imgx % 8)) ;
-	}else{
-	  val = 1 ;
-	}
-      }
+  span.pLCD = this ;
+  span.bInvert = eMode == exclusive ;
+  Raster::circle(cx, cy, radius, bFill, rasterSpan, &span) ;
+  markClipped(cx - r, cy - r, cx + r, cy + r) ;
 
-      pixel += 3 ;
-
-      if (img.m_colourbitdepth == 1){
-	// val is greater than zero is set or zero if unset pixel
-	if (val > 0){
-	  if(eMode == exclusive){
-	    m_pDisplay[pixel] ^= 0x0F & (m_nFGCol >> 8) ;
-	    m_pDisplay[pixel+1] ^= 0x0F & (m_nFGCol >> 4) ;
-	    m_pDisplay[pixel+2] ^= 0x0F & (m_nFGCol) ;
-	  }else{
-	    m_pDisplay[pixel] = 0x0F & (m_nFGCol >> 8) ;
-	    m_pDisplay[pixel+1] = 0x0F & (m_nFGCol >> 4) ;
-	    m_pDisplay[pixel+2] = 0x0F & (m_nFGCol) ;
-	  }
-	}else if (eMode == overwrite){
-	  // If this is an overwrite of the display and not additive (overlayed) 
-	  // then remove the pixel setting
-	  // Use background colour
-	  m_pDisplay[pixel] = 0x0F & (m_nBGCol >> 8); // red
-	  m_pDisplay[pixel+1] = 0x0F & (m_nBGCol >> 4); // green
-	  m_pDisplay[pixel+2] = 0x0F & (m_nBGCol); // blue
-	}
-	// else retain the pixels as they were in m_pDisplay
-      }else if (img.m_colourbitdepth == 32){
-	if (val > 0){
-	  srcpixel = (imgx*4) + (imgy*img.m_stride) ;
-	  if(eMode == exclusive){
-	    m_pDisplay[pixel] ^= DisplayImage::to4bit(img.m_img[srcpixel]) ; // to 4 bit
-	    m_pDisplay[pixel+1] ^= DisplayImage::to4bit(img.m_img[srcpixel+1]); // to 4 bit
-	    m_pDisplay[pixel+2] ^= DisplayImage::to4bit(img.m_img[srcpixel+2]); // to 4 bit
-	  }else{ // overwrite (not overlay written here yet)
-	    m_pDisplay[pixel] = DisplayImage::to4bit(img.m_img[srcpixel]) ; // to 4 bit
-	    m_pDisplay[pixel+1] = DisplayImage::to4bit(img.m_img[srcpixel+1]) ; // to 4 bit
-	    m_pDisplay[pixel+2] = DisplayImage::to4bit(img.m_img[srcpixel+2]) ; // to 4 bit
-	  }
-	}else if (eMode == overwrite){
-	  // If this is an overwrite of the display and not additive (overlayed)
-	  // then remove the pixel setting
-	  // Use background colour
-	  m_pDisplay[pixel] = 0x0F & (m_nBGCol >> 8); // red
-	  m_pDisplay[pixel+1] = 0x0F & (m_nBGCol >> 4); // green
-	  m_pDisplay[pixel+2] = 0x0F & (m_nBGCol); // blue
-	}
-	// else retain the pixels as they were in m_pDisplay
-	
-      }
-    }
+  return true ;
+}
+
+bool PCF8833LCD::clearImage()
+{
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "clearImage: display not setup\n") ;
+    return false ;
+  }
+
+  for (int y=m_clip.y0; y <= m_clip.y1; y++){
+    fillSpan(m_pDisplay + ((m_clip.x0 + (y * m_width)) * m_nBytesPerPixel), m_clip.x1 - m_clip.x0 + 1, m_bgPixel) ;
+    if (m_bWireValid) encodeWire(m_pDisplay, m_pWire, y, m_clip.x0, m_clip.x1) ;
   }
 
+  markDirty(m_clip.x0, m_clip.y0, m_clip.x1, m_clip.y1) ;
   
   return true ;
 }
 
-bool PCF8833LCD::display()
+bool PCF8833LCD::setClip(int x, int y, unsigned int width, unsigned int height)
 {
-  uint32_t j =0;
-  
-  // Display OFF
-  //writeCmd(0x28);
+  DirtyRect rc ;
 
-  // Column address set (command 0x2A)
-  writeCmd(0x2A);
-  writeData(0);
-  writeData(m_width - 1);
-  
-  // Page address set (command 0x2B)
-  writeCmd(0x2B);
-  writeData(0);
-  writeData(m_height - 1);
+  rc.x0 = x < 0?0:x ;
+  rc.y0 = y < 0?0:y ;
+  rc.x1 = x + (int)width - 1 ;
+  rc.y1 = y + (int)height - 1 ;
+  if (rc.x1 >= (int)m_width) rc.x1 = m_width - 1 ;
+  if (rc.y1 >= (int)m_height) rc.y1 = m_height - 1 ;
 
-  // WRITE MEMORY
-  writeCmd(0x2C) ;
-
-  j= 0 ;
-  uint8_t byteout = 0x00 ;
-  while (j < m_nDisplaySize) {
-    byteout = 0x00 ;
-    byteout = m_pDisplay[j++] << 4 ; // 
-    if (j < m_nDisplaySize){
-      byteout |= m_pDisplay[j++] & 0x0F ; //
-    }else{
-      byteout &= 0xF0 ;
-    }
-    writeData(byteout);
+  if (width == 0 || height == 0 || rc.x0 > rc.x1 || rc.y0 > rc.y1){
+    fprintf(stderr, "setClip: region is outside of the display\n") ;
+    return false ;
   }
 
-  // Display On
-  //writeCmd(0x29);
+  m_clip = rc ;
+  return true ;
+}
 
+void PCF8833LCD::clearClip()
+{
+  m_clip.x0 = 0 ;
+  m_clip.y0 = 0 ;
+  m_clip.x1 = m_width - 1 ;
+  m_clip.y1 = m_height - 1 ;
+}
+
+template <int BPP, int DEPTH, enum IDisplay::enMode MODE>
+void PCF8833LCD::blitRows(DisplayImage &img, int xoffset, int yoffset, int x0, int y0, int x1, int y1)
+{
+  uint8_t pattern[4] ;
+  const uint8_t *pSrc = NULL ;
+  uint8_t *pDst = NULL ;
+
+  for (int cy=y0; cy < y1; cy++){
+    pSrc = img.m_img + ((cy - yoffset) * img.m_stride) ;
+    pDst = m_pDisplay + ((x0 + (cy * m_width)) * BPP) ;
+    if (DEPTH == 1){
+      Blit::span1bpp<BPP, MODE>(pSrc, x0 - xoffset, pDst, x1 - x0, m_fgPixel, m_bgPixel, m_lut1bpp, m_lutMask) ;
+    }else{
+      if (BPP == 3 && m_bDither) ColourConvert::ditherPattern(x0, cy, pattern) ;
+      Blit::span32bpp<BPP, MODE>(pSrc + ((x0 - xoffset) * 4), pDst, x1 - x0, BPP == 3 && m_bDither?pattern:NULL) ;
+    }
+  }
+}
+
+template <int BPP, int DEPTH>
+void PCF8833LCD::blitMode(enum enMode eMode, DisplayImage &img, int xoffset, int yoffset, int x0, int y0, int x1, int y1)
+{
+  switch (eMode){
+  case overwrite:
+    blitRows<BPP, DEPTH, overwrite>(img, xoffset, yoffset, x0, y0, x1, y1) ;
+    break ;
+  case overlay:
+    blitRows<BPP, DEPTH, overlay>(img, xoffset, yoffset, x0, y0, x1, y1) ;
+    break ;
+  case exclusive:
+    blitRows<BPP, DEPTH, exclusive>(img, xoffset, yoffset, x0, y0, x1, y1) ;
+    break ;
+  }
+}
+
+bool PCF8833LCD::writeImage(DisplayImage &img, enum enMode eMode, int xoffset, int yoffset)
+{
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0 ;
+  uint8_t *pRow = NULL ;
+  bool bImage = false ;
+
+  if (!verify()) return false ;
+
+  if (img.m_colourbitdepth != 1 && img.m_colourbitdepth != 32){
+    fprintf(stderr, "Unsupported colour bit depth\n") ;
+    return false ;
+  }
+
+  if (!m_pDisplay){
+    fprintf(stderr, "writeImage: display not setup\n") ;
+    return false ;
+  }
+
+  // Clip the image to the display buffer. x1 and y1 are exclusive
+  x0 = xoffset < m_clip.x0?m_clip.x0:xoffset ;
+  y0 = yoffset < m_clip.y0?m_clip.y0:yoffset ;
+  x1 = xoffset + (int)img.m_width ;
+  y1 = yoffset + (int)img.m_height ;
+  if (x1 > m_clip.x1 + 1) x1 = m_clip.x1 + 1 ;
+  if (y1 > m_clip.y1 + 1) y1 = m_clip.y1 + 1 ;
+  bImage = x0 < x1 && y0 < y1 ;
+
+  // Overwrite sets the clip region outside of the image to the background
+  if (eMode == overwrite){
+    for (int cy=m_clip.y0; cy <= m_clip.y1; cy++){
+      pRow = m_pDisplay + (cy * m_width * m_nBytesPerPixel) ;
+      if (!bImage || cy < y0 || cy >= y1){
+	fillSpan(pRow + (m_clip.x0 * m_nBytesPerPixel), m_clip.x1 - m_clip.x0 + 1, m_bgPixel) ;
+      }else{
+	fillSpan(pRow + (m_clip.x0 * m_nBytesPerPixel), x0 - m_clip.x0, m_bgPixel) ;
+	fillSpan(pRow + (x1 * m_nBytesPerPixel), m_clip.x1 + 1 - x1, m_bgPixel) ;
+      }
+    }
+  }
+
+  // Pick the span loops once for the whole image
+  if (bImage){
+    if (m_eColour == colour8bit){
+      if (img.m_colourbitdepth == 1) blitMode<1, 1>(eMode, img, xoffset, yoffset, x0, y0, x1, y1) ;
+      else blitMode<1, 32>(eMode, img, xoffset, yoffset, x0, y0, x1, y1) ;
+    }else{
+      if (img.m_colourbitdepth == 1) blitMode<3, 1>(eMode, img, xoffset, yoffset, x0, y0, x1, y1) ;
+      else blitMode<3, 32>(eMode, img, xoffset, yoffset, x0, y0, x1, y1) ;
+    }
+  }
+
+  // Overwrite sets everything outside of the image to the background
+  if (eMode == overwrite){
+    if (m_bWireValid){
+      for (int cy=m_clip.y0; cy <= m_clip.y1; cy++) encodeWire(m_pDisplay, m_pWire, cy, m_clip.x0, m_clip.x1) ;
+    }
+    markDirty(m_clip.x0, m_clip.y0, m_clip.x1, m_clip.y1) ;
+  }else if (bImage){
+    if (m_bWireValid){
+      for (int cy=y0; cy < y1; cy++) encodeWire(m_pDisplay, m_pWire, cy, x0, x1 - 1) ;
+    }
+    markDirty(x0, y0, x1 - 1, y1 - 1) ;
+  }
+  
+  return true ;
+}
+
+template <int BPP, enum IDisplay::enMode MODE>
+int PCF8833LCD::textRun(GlyphCache &glyphs, const char *szText, int x, int y)
+{
+  uint8_t row[(PCF8833_TEXT_RUN / 8) + 8] ;
+  const char *pEnd = NULL ;
+  int c0 = 0, c1 = 0, r0 = 0, r1 = 0, width = 0, pos = 0, w = 0 ;
+  uint64_t v = 0 ;
+
+  // Rows of the glyphs inside the clip region
+  r0 = y < m_clip.y0?m_clip.y0 - y:0 ;
+  r1 = y + (int)glyphs.m_height - 1 > m_clip.y1?m_clip.y1 - y:glyphs.m_height - 1 ;
+  if (r0 > r1) return x ;
+
+  while (*szText && x <= m_clip.x1){
+    // Glyphs up to the clip edge or a full run
+    width = 0 ;
+    for (pEnd=szText; *pEnd && x + width <= m_clip.x1; pEnd++){
+      w = glyphs.glyph(*pEnd).width ;
+      if (width + w > PCF8833_TEXT_RUN) break ;
+      width += w ;
+    }
+
+    // Each glyph row is joined into one 1 bit row so every display
+    // row of the run is a single span through the expansion tables
+    c0 = x < m_clip.x0?m_clip.x0 - x:0 ;
+    c1 = x + width - 1 > m_clip.x1?m_clip.x1 - x:width - 1 ;
+    for (int r=r0; r <= r1 && c0 <= c1; r++){
+      memset(row, 0, ((width + 7) / 8) + 5) ;
+      pos = 0 ;
+      for (const char *p=szText; p < pEnd; p++){
+	const GlyphCache::Glyph &g = glyphs.glyph(*p) ;
+	v = (uint64_t)(g.rows[r][0] | (g.rows[r][1] << 8) | (g.rows[r][2] << 16) | ((uint32_t)g.rows[r][3] << 24)) << (pos % 8) ;
+	for (int b=0; b < 5; b++) row[(pos / 8) + b] |= (uint8_t)(v >> (b * 8)) ;
+	pos += g.width ;
+      }
+      Blit::span1bpp<BPP, MODE>(row, c0, m_pDisplay + ((x + c0 + ((y + r) * m_width)) * BPP), c1 - c0 + 1,
+				m_fgPixel, m_bgPixel, m_lut1bpp, m_lutMask) ;
+    }
+
+    x += width ;
+    szText = pEnd ;
+  }
+
+  return x ;
+}
+
+bool PCF8833LCD::writeText(GlyphCache &glyphs, const char *szText, enum enMode eMode, int xoffset, int yoffset)
+{
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0 ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "writeText: display not setup\n") ;
+    return false ;
+  }
+
+  if (!glyphs.isLoaded()){
+    fprintf(stderr, "writeText: no glyphs loaded\n") ;
+    return false ;
+  }
+
+  // Pick the glyph loop once for the whole string
+  switch (eMode){
+  case overwrite:
+    x1 = m_eColour == colour8bit?textRun<1, overwrite>(glyphs, szText, xoffset, yoffset):textRun<3, overwrite>(glyphs, szText, xoffset, yoffset) ;
+    break ;
+  case overlay:
+    x1 = m_eColour == colour8bit?textRun<1, overlay>(glyphs, szText, xoffset, yoffset):textRun<3, overlay>(glyphs, szText, xoffset, yoffset) ;
+    break ;
+  case exclusive:
+    x1 = m_eColour == colour8bit?textRun<1, exclusive>(glyphs, szText, xoffset, yoffset):textRun<3, exclusive>(glyphs, szText, xoffset, yoffset) ;
+    break ;
+  }
+
+  // Area written, inclusive
+  x0 = xoffset < m_clip.x0?m_clip.x0:xoffset ;
+  y0 = yoffset < m_clip.y0?m_clip.y0:yoffset ;
+  x1 = x1 - 1 > m_clip.x1?m_clip.x1:x1 - 1 ;
+  y1 = yoffset + (int)glyphs.m_height - 1 > m_clip.y1?m_clip.y1:yoffset + (int)glyphs.m_height - 1 ;
+  if (x0 > x1 || y0 > y1) return true ; // nothing on the display
+
+  if (m_bWireValid){
+    for (int cy=y0; cy <= y1; cy++) encodeWire(m_pDisplay, m_pWire, cy, x0, x1) ;
+  }
+  markDirty(x0, y0, x1, y1) ;
+
+  return true ;
+}
+
+bool PCF8833LCD::writeText(FontAtlas &atlas, int face, unsigned int size, const char *szText, int xoffset, int yoffset)
+{
+  const FontAtlas::Glyph *pGlyph = NULL ;
+  uint8_t colour[3] ;
+  int pen = xoffset, baseline = 0, gx = 0, gy = 0, c0 = 0, c1 = 0, r0 = 0, r1 = 0 ;
+  int x0 = m_clip.x1 + 1, y0 = m_clip.y1 + 1, x1 = m_clip.x0 - 1, y1 = m_clip.y0 - 1 ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "writeText: display not setup\n") ;
+    return false ;
+  }
+
+  baseline = yoffset + atlas.getAscender(face, size) ;
+
+  // Blend at 8 bits from the 4 bit foreground
+  for (int i=0; i < 3; i++) colour[i] = ((m_nFGCol >> (8 - (i * 4))) & 0x0F) * 17 ;
+
+  while (*szText && pen <= m_clip.x1){
+    pGlyph = atlas.getGlyph(face, size, FontAtlas::nextCodepoint(szText)) ;
+    if (!pGlyph) continue ;
+
+    gx = pen + pGlyph->left ;
+    gy = baseline - pGlyph->top ;
+    pen += pGlyph->advance ;
+
+    // Part of the glyph inside the clip region
+    c0 = gx < m_clip.x0?m_clip.x0 - gx:0 ;
+    c1 = gx + (int)pGlyph->width - 1 > m_clip.x1?m_clip.x1 - gx:pGlyph->width - 1 ;
+    r0 = gy < m_clip.y0?m_clip.y0 - gy:0 ;
+    r1 = gy + (int)pGlyph->height - 1 > m_clip.y1?m_clip.y1 - gy:pGlyph->height - 1 ;
+    if (c0 > c1 || r0 > r1) continue ;
+
+    for (int r=r0; r <= r1; r++){
+      const uint8_t *pSrc = pGlyph->pCoverage + (r * pGlyph->width) + c0 ;
+      uint8_t *pDst = m_pDisplay + ((gx + c0 + ((gy + r) * m_width)) * m_nBytesPerPixel) ;
+      if (m_eColour == colour8bit) ColourConvert::blendCoverageRGB332(pSrc, colour, pDst, c1 - c0 + 1) ;
+      else ColourConvert::blendCoverageRGB444(pSrc, colour, pDst, c1 - c0 + 1) ;
+    }
+
+    if (gx + c0 < x0) x0 = gx + c0 ;
+    if (gx + c1 > x1) x1 = gx + c1 ;
+    if (gy + r0 < y0) y0 = gy + r0 ;
+    if (gy + r1 > y1) y1 = gy + r1 ;
+  }
+
+  if (x0 > x1 || y0 > y1) return true ; // nothing on the display
+
+  if (m_bWireValid){
+    for (int cy=y0; cy <= y1; cy++) encodeWire(m_pDisplay, m_pWire, cy, x0, x1) ;
+  }
+  markDirty(x0, y0, x1, y1) ;
+
+  return true ;
+}
+
+bool PCF8833LCD::writeRaw(const uint8_t *pSrc, enRaw eFormat, unsigned int width, unsigned int height, int xoffset, int yoffset)
+{
+  const int rawBytes[3] = {3, 4, 2} ; // bytes per pixel for each enRaw
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0 ;
+  const uint8_t *pRow = NULL ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "writeRaw: display not setup\n") ;
+    return false ;
+  }
+
+  // Clip to the clip region. x1 and y1 are exclusive
+  x0 = xoffset < m_clip.x0?m_clip.x0:xoffset ;
+  y0 = yoffset < m_clip.y0?m_clip.y0:yoffset ;
+  x1 = xoffset + (int)width ;
+  y1 = yoffset + (int)height ;
+  if (x1 > m_clip.x1 + 1) x1 = m_clip.x1 + 1 ;
+  if (y1 > m_clip.y1 + 1) y1 = m_clip.y1 + 1 ;
+  if (x0 >= x1 || y0 >= y1) return true ; // nothing on the display
+
+  for (int cy=y0; cy < y1; cy++){
+    pRow = pSrc + ((((cy - yoffset) * width) + (x0 - xoffset)) * rawBytes[eFormat]) ;
+    convertRaw(pRow, eFormat, m_pDisplay + ((x0 + (cy * m_width)) * m_nBytesPerPixel), x0, cy, x1 - x0) ;
+    if (m_bWireValid) encodeWire(m_pDisplay, m_pWire, cy, x0, x1 - 1) ;
+  }
+
+  markDirty(x0, y0, x1 - 1, y1 - 1) ;
+
+  return true ;
+}
+
+bool PCF8833LCD::writeScaled(DisplayImage &img, ImageScale::enFilter eFilter, int xoffset, int yoffset,
+			     unsigned int width, unsigned int height)
+{
+  ImageScale scale ;
+  uint8_t rgb[132*3], bg[3], fg[3] ;
+  uint8_t *pRow = NULL, *pDst = NULL ;
+  const uint8_t *pSrc = NULL ;
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0 ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "writeScaled: display not setup\n") ;
+    return false ;
+  }
+
+  if (!scale.setSource(img.m_img, img.m_width, img.m_height, img.m_stride, img.m_colourbitdepth) ||
+      !scale.setTarget(width, height, eFilter)){
+    fprintf(stderr, "writeScaled: cannot scale image\n") ;
+    return false ;
+  }
+
+  // Clip to the clip region. x1 and y1 are exclusive
+  x0 = xoffset < m_clip.x0?m_clip.x0:xoffset ;
+  y0 = yoffset < m_clip.y0?m_clip.y0:yoffset ;
+  x1 = xoffset + (int)width ;
+  y1 = yoffset + (int)height ;
+  if (x1 > m_clip.x1 + 1) x1 = m_clip.x1 + 1 ;
+  if (y1 > m_clip.y1 + 1) y1 = m_clip.y1 + 1 ;
+  if (x0 >= x1 || y0 >= y1) return true ; // nothing on the display
+
+  // Colours as 8 bit channels for coverage blending
+  for (int i=0; i < 3; i++){
+    bg[i] = ((m_nBGCol >> (8 - (i * 4))) & 0x0F) * 17 ;
+    fg[i] = ((m_nFGCol >> (8 - (i * 4))) & 0x0F) * 17 ;
+  }
+
+  if (width * scale.getChannels() > m_nScaledSize){
+    if (m_pScaled) delete[] m_pScaled ;
+    m_nScaledSize = width * scale.getChannels() ;
+    m_pScaled = new uint8_t[m_nScaledSize] ;
+  }
+  pRow = m_pScaled ;
+  for (int cy=y0; cy < y1; cy++){
+    scale.scaleRow(cy - yoffset, pRow) ;
+    pSrc = pRow + ((x0 - xoffset) * scale.getChannels()) ;
+    pDst = m_pDisplay + ((x0 + (cy * m_width)) * m_nBytesPerPixel) ;
+
+    if (scale.getChannels() == 4){
+      convertRaw(pSrc, rawRGBA, pDst, x0, cy, x1 - x0) ;
+    }else{
+      // Colours are whole 4 bit levels so skip dithering
+      for (int i=0; i < x1 - x0; i++){
+	rgb[i*3] = ColourConvert::blend8(fg[0], bg[0], pSrc[i]) ;
+	rgb[(i*3)+1] = ColourConvert::blend8(fg[1], bg[1], pSrc[i]) ;
+	rgb[(i*3)+2] = ColourConvert::blend8(fg[2], bg[2], pSrc[i]) ;
+      }
+      if (m_eColour == colour8bit) ColourConvert::rgbToRGB332(rgb, pDst, x1 - x0) ;
+      else ColourConvert::rgbToRGB444(rgb, pDst, x1 - x0) ;
+    }
+
+    if (m_bWireValid) encodeWire(m_pDisplay, m_pWire, cy, x0, x1 - 1) ;
+  }
+
+  markDirty(x0, y0, x1 - 1, y1 - 1) ;
+
+  return true ;
+}
+
+void PCF8833LCD::convertRaw(const uint8_t *pSrc, enRaw eFormat, uint8_t *pDst, int x, int y, int nPixels)
+{
+  uint8_t row[132*3] ;
+  uint8_t pattern[4] ;
+
+  if (m_eColour == colour8bit){
+    switch(eFormat){
+    case rawRGB24:
+      ColourConvert::rgbToRGB332(pSrc, pDst, nPixels) ;
+      break ;
+    case rawRGBA:
+      ColourConvert::rgbaToRGB332(pSrc, pDst, nPixels) ;
+      break ;
+    default:
+      ColourConvert::unpackRGB444(pSrc, row, nPixels) ;
+      ColourConvert::rgb444ToRGB332(row, pDst, nPixels) ;
+      break ;
+    }
+  }else{
+    if (m_bDither) ColourConvert::ditherPattern(x, y, pattern) ;
+    switch(eFormat){
+    case rawRGB24:
+      ColourConvert::rgbToRGB444(pSrc, pDst, nPixels, m_bDither?pattern:NULL) ;
+      break ;
+    case rawRGBA:
+      ColourConvert::rgbaToRGB444(pSrc, pDst, nPixels, m_bDither?pattern:NULL) ;
+      break ;
+    default:
+      ColourConvert::unpackRGB444(pSrc, pDst, nPixels) ;
+      break ;
+    }
+  }
+}
+
+uint32_t PCF8833LCD::getFrame(uint8_t *pBuffer, uint32_t len)
+{
+  uint32_t size = 0 ;
+
+  if (!m_pDisplay) return 0 ;
+
+  if (!m_bWireValid) encodeWireAll() ;
+  size = m_width * m_height * m_nBytesPerPixel ;
+  if (!pBuffer) return size + m_nWireSize ;
+  if (len < size + m_nWireSize){
+    fprintf(stderr, "getFrame: buffer too small\n") ;
+    return 0 ;
+  }
+
+  memcpy(pBuffer, m_pDisplay, size) ;
+  memcpy(pBuffer + size, m_pWire, m_nWireSize) ;
+
+  return size + m_nWireSize ;
+}
+
+bool PCF8833LCD::setFrame(const uint8_t *pFrame, uint32_t len)
+{
+  uint32_t size = 0 ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "setFrame: display not setup\n") ;
+    return false ;
+  }
+
+  // Frames from another size or colour mode have a different length
+  size = m_width * m_height * m_nBytesPerPixel ;
+  if (len != size + wireSize()){
+    fprintf(stderr, "setFrame: frame doesn't match the display settings\n") ;
+    return false ;
+  }
+
+  memcpy(m_pDisplay, pFrame, size) ;
+  memcpy(m_pWire, pFrame + size, len - size) ;
+  m_nWireSize = len - size ;
+  m_bWireValid = true ;
+  markDirty(0, 0, m_width - 1, m_height - 1) ;
+
+  return true ;
+}
+
+uint32_t PCF8833LCD::convertFrame(const uint8_t *pSrc, enRaw eFormat, uint8_t *pBuffer, uint32_t len)
+{
+  const int rawBytes[3] = {3, 4, 2} ; // bytes per pixel for each enRaw
+  uint32_t size = 0 ;
+
+  if (!m_pDisplay) return 0 ;
+
+  size = m_width * m_height * m_nBytesPerPixel ;
+  if (!pBuffer) return size + wireSize() ;
+  if (len < size + wireSize()){
+    fprintf(stderr, "convertFrame: buffer too small\n") ;
+    return 0 ;
+  }
+
+  for (unsigned int y=0; y < m_height; y++){
+    convertRaw(pSrc + (y * m_width * rawBytes[eFormat]), eFormat, pBuffer + (y * m_width * m_nBytesPerPixel), 0, y, m_width) ;
+  }
+
+  return size + encodeWireFrame(pBuffer, pBuffer + size) ;
+}
+
+uint64_t PCF8833LCD::frameKey(DisplayImage &img, int xoffset, int yoffset)
+{
+  // Everything which changes the display buffer for an overwrite
+  int32_t params[9] = {(int32_t)m_width, (int32_t)m_height, m_eColour, m_bDither, xoffset, yoffset,
+		       (int32_t)img.m_width, (int32_t)img.m_height, (int32_t)img.m_colourbitdepth} ;
+  uint64_t key = FrameCache::hash(params, sizeof(params)) ;
+
+  key = FrameCache::hash(m_bgPixel, sizeof(m_bgPixel), key) ;
+  key = FrameCache::hash(m_fgPixel, sizeof(m_fgPixel), key) ;
+  return FrameCache::hash(img.m_img, img.m_stride * img.m_height, key) ;
+}
+
+bool PCF8833LCD::displayImage(DisplayImage &img, int xoffset, int yoffset)
+{
+  uint32_t size = 0, len = 0 ;
+  uint64_t key = 0 ;
+  const uint8_t *pFrame = NULL ;
+  uint8_t *pEntry = NULL ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "displayImage: display not setup\n") ;
+    return false ;
+  }
+
+  // Cached frames are the whole display buffer so pixels outside
+  // of a clip region would be lost
+  if (!m_pCache || m_clip.x0 > 0 || m_clip.y0 > 0 ||
+      m_clip.x1 < (int)m_width - 1 || m_clip.y1 < (int)m_height - 1){
+    if (!writeImage(img, overwrite, xoffset, yoffset)) return false ;
+    return display() ;
+  }
+
+  // Frame is the display buffer followed by the wire image
+  key = frameKey(img, xoffset, yoffset) ;
+  pFrame = m_pCache->find(key, len) ;
+  if (pFrame && setFrame(pFrame, len)) return display() ;
+
+  if (!writeImage(img, overwrite, xoffset, yoffset)) return false ;
+  if (!display()) return false ;
+
+  size = getFrame(NULL, 0) ;
+  pEntry = m_pCache->add(key, size) ;
+  if (pEntry) getFrame(pEntry, size) ;
+
+  return true ;
+}
+
+uint32_t PCF8833LCD::encodeImage(DisplayImage &img, int xoffset, int yoffset, uint8_t *pBuffer, uint32_t len)
+{
+  uint8_t row[132 * 3] ; // setup limits displays to 132 pixels wide
+  uint8_t first[3] = {0, 0, 0}, pattern[4] ;
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0, n = 0, nibble = -1 ;
+  uint32_t pixels = 0, symbol = PCF8833_WINDOW_OVERHEAD, size = 0 ;
+  const uint8_t *pSrc = NULL ;
+
+  if (!verify()) return 0 ;
+
+  if (img.m_colourbitdepth != 1 && img.m_colourbitdepth != 32){
+    fprintf(stderr, "encodeImage: Unsupported colour bit depth\n") ;
+    return 0 ;
+  }
+
+  // Inclusive window clipped to the display
+  x0 = xoffset < 0?0:xoffset ;
+  y0 = yoffset < 0?0:yoffset ;
+  x1 = xoffset + (int)img.m_width - 1 ;
+  y1 = yoffset + (int)img.m_height - 1 ;
+  if (x1 >= (int)m_width) x1 = m_width - 1 ;
+  if (y1 >= (int)m_height) y1 = m_height - 1 ;
+  if (x0 > x1 || y0 > y1) return 0 ; // nothing on the display
+
+  n = x1 - x0 + 1 ;
+  pixels = n * (y1 - y0 + 1) ;
+  if (m_eColour == colour8bit) size = PCF8833_WINDOW_OVERHEAD + pixels ;
+  else size = PCF8833_WINDOW_OVERHEAD + ((pixels + 1) / 2) * 3 ;
+  size = ((size + 7) / 8) * 9 ;
+
+  if (!pBuffer) return size ;
+  if (len < size){
+    fprintf(stderr, "encodeImage: buffer too small\n") ;
+    return 0 ;
+  }
+
+  putSymbol(pBuffer, 0, 0x2A) ;
+  putSymbol(pBuffer, 1, 0x100 | x0) ;
+  putSymbol(pBuffer, 2, 0x100 | x1) ;
+  putSymbol(pBuffer, 3, 0x2B) ;
+  putSymbol(pBuffer, 4, 0x100 | y0) ;
+  putSymbol(pBuffer, 5, 0x100 | y1) ;
+  putSymbol(pBuffer, 6, 0x2C) ;
+
+  for (int cy=y0; cy <= y1; cy++){
+    // Convert a row to display buffer format then pack as writeWindow does
+    pSrc = img.m_img + ((cy - yoffset) * img.m_stride) ;
+    if (img.m_colourbitdepth == 1){
+      if (m_eColour == colour8bit) Blit::span1bpp<1, overwrite>(pSrc, x0 - xoffset, row, n, m_fgPixel, m_bgPixel, m_lut1bpp, m_lutMask) ;
+      else Blit::span1bpp<3, overwrite>(pSrc, x0 - xoffset, row, n, m_fgPixel, m_bgPixel, m_lut1bpp, m_lutMask) ;
+    }else if (m_eColour == colour8bit){
+      Blit::span32bpp<1, overwrite>(pSrc + ((x0 - xoffset) * 4), row, n, NULL) ;
+    }else{
+      if (m_bDither) ColourConvert::ditherPattern(x0, cy, pattern) ;
+      Blit::span32bpp<3, overwrite>(pSrc + ((x0 - xoffset) * 4), row, n, m_bDither?pattern:NULL) ;
+    }
+    if (cy == y0) memcpy(first, row, 3) ;
+
+    if (m_eColour == colour8bit){
+      for (int i=0; i < n; i++) putSymbol(pBuffer, symbol++, 0x100 | row[i]) ;
+    }else{
+      for (int i=0; i < n * 3; i++){
+	if (nibble < 0){
+	  nibble = row[i] & 0x0F ;
+	}else{
+	  putSymbol(pBuffer, symbol++, 0x100 | (uint8_t)((nibble << 4) | (row[i] & 0x0F))) ;
+	  nibble = -1 ;
+	}
+      }
+    }
+  }
+  if (nibble >= 0){
+    // Odd number of pixels. Finish the pair with the first pixel as the address wraps
+    putSymbol(pBuffer, symbol++, 0x100 | (uint8_t)((nibble << 4) | first[0])) ;
+    putSymbol(pBuffer, symbol++, 0x100 | (uint8_t)((first[1] << 4) | first[2])) ;
+  }
+
+  // NOOP to the end of the last 9 byte group
+  for (; symbol % 8; symbol++) putSymbol(pBuffer, symbol, 0x000) ;
+
+  return size ;
+}
+
+uint32_t PCF8833LCD::encodeRows(int y0, int y1, uint8_t *pBuffer, uint32_t len)
+{
+  uint32_t p0 = 0, p1 = 0, data = 0, first = 0, last = 0, pad = 0 ;
+  uint32_t symbol = 0, size = 0, aligned = 0, end = 0, s = 0 ;
+  const uint8_t *pPixel = NULL ;
+  int nibble = -1 ;
+  bool bWire = true ;
+
+  if (!verify()) return 0 ;
+
+  if (!m_pDisplay || y0 < 0 || y1 >= (int)m_height || y0 > y1){
+    fprintf(stderr, "encodeRows: rows not in the display\n") ;
+    return 0 ;
+  }
+
+  p0 = y0 * m_width ;
+  p1 = (y1 + 1) * m_width ;
+  if (m_eColour == colour8bit){
+    data = p1 - p0 ;
+    first = PCF8833_WINDOW_OVERHEAD + p0 ;
+  }else{
+    // Odd width rows may not start on a pixel pair in the wire image
+    data = ((p1 - p0 + 1) / 2) * 3 ;
+    first = PCF8833_WINDOW_OVERHEAD + ((p0 / 2) * 3) ;
+    bWire = ((p0 | p1) & 1) == 0 ;
+  }
+  last = first + data ;
+
+  // NOOP padding places the window commands so that the row data
+  // falls in the same position of a 9 byte group as in the wire image
+  if (bWire) pad = (first - PCF8833_WINDOW_OVERHEAD) % 8 ;
+  size = ((pad + PCF8833_WINDOW_OVERHEAD + data + 7) / 8) * 9 ;
+
+  if (!pBuffer) return size ;
+  if (len < size){
+    fprintf(stderr, "encodeRows: buffer too small\n") ;
+    return 0 ;
+  }
+
+  for (; symbol < pad; symbol++) putSymbol(pBuffer, symbol, 0x000) ;
+  putSymbol(pBuffer, symbol++, 0x2A) ;
+  putSymbol(pBuffer, symbol++, 0x100 | 0) ;
+  putSymbol(pBuffer, symbol++, 0x100 | (m_width - 1)) ;
+  putSymbol(pBuffer, symbol++, 0x2B) ;
+  putSymbol(pBuffer, symbol++, 0x100 | y0) ;
+  putSymbol(pBuffer, symbol++, 0x100 | y1) ;
+  putSymbol(pBuffer, symbol++, 0x2C) ;
+
+  if (bWire){
+    if (!m_bWireValid) encodeWireAll() ;
+
+    // Partial groups at either end are copied a symbol at a time
+    aligned = (first + 7) & ~7 ;
+    end = last & ~7 ;
+    for (s=first; s < last && s < aligned; s++){
+      putSymbol(pBuffer, symbol++, 0x100 | getWireData(m_pWire, s)) ;
+    }
+    if (aligned < end){
+      memcpy(pBuffer + ((symbol / 8) * 9), m_pWire + ((aligned / 8) * 9), ((end - aligned) / 8) * 9) ;
+      symbol += end - aligned ;
+      s = end ;
+    }
+    for (; s < last; s++){
+      putSymbol(pBuffer, symbol++, 0x100 | getWireData(m_pWire, s)) ;
+    }
+  }else{
+    // Pack 12 bit pixels from the display buffer as writeWindow does
+    pPixel = m_pDisplay + (p0 * 3) ;
+    for (uint32_t i=0; i < (p1 - p0) * 3; i++){
+      if (nibble < 0){
+	nibble = pPixel[i] & 0x0F ;
+      }else{
+	putSymbol(pBuffer, symbol++, 0x100 | (uint8_t)((nibble << 4) | (pPixel[i] & 0x0F))) ;
+	nibble = -1 ;
+      }
+    }
+    if (nibble >= 0){
+      // Odd number of pixels. Finish the pair with the first pixel as the address wraps
+      putSymbol(pBuffer, symbol++, 0x100 | (uint8_t)((nibble << 4) | (pPixel[0] & 0x0F))) ;
+      putSymbol(pBuffer, symbol++, 0x100 | (uint8_t)((pPixel[1] << 4) | (pPixel[2] & 0x0F))) ;
+    }
+  }
+
+  // NOOP to the end of the last 9 byte group
+  for (; symbol % 8; symbol++) putSymbol(pBuffer, symbol, 0x000) ;
+
+  return size ;
+}
+
+bool PCF8833LCD::writeEncoded(uint8_t *pBuffer, uint32_t len)
+{
+  uint32_t n = 0 ;
+
+  if (!verify()) return false ;
+
+  // Encoded data starts a new 9 byte group
+  if (!m_pSPI->flush9bit(0, 0x00)) return false ;
+
+  while (len > 0){
+    n = len > PCF8833_WIRE_CHUNK?PCF8833_WIRE_CHUNK:len ;
+    if (!m_pSPI->write(pBuffer, n)) return false ;
+    pBuffer += n ;
+    len -= n ;
+  }
+
+  return true ;
+}
+
+bool PCF8833LCD::setScrollArea(unsigned int top, unsigned int bottom)
+{
+  if (!verify()) return false ;
+
+  if (top + bottom >= m_height){
+    fprintf(stderr, "setScrollArea: no rows left to scroll\n") ;
+    return false ;
+  }
+
+  // Vertical scrolling definition (command 0x33)
+  // top fixed area, scroll area, bottom fixed area
+  writeCmd(0x33) ;
+  writeData(top) ;
+  writeData(m_height - top - bottom) ;
+  if (!writeData(bottom)) return false ;
+
+  // Flush out NOOP command to bus
+  m_pSPI->flush9bit(0, 0x00) ;
+  return true ;
+}
+
+bool PCF8833LCD::setScrollStart(unsigned int start)
+{
+  if (!verify()) return false ;
+
+  // Vertical scroll start address (command 0x37)
+  writeCmd(0x37) ;
+  if (!writeData(start)) return false ;
+
+  // Flush out NOOP command to bus
+  m_pSPI->flush9bit(0, 0x00) ;
+  return true ;
+}
+
+bool PCF8833LCD::endScroll()
+{
+  if (!verify()) return false ;
+
+  writeCmd(0x37) ;
+  writeData(0) ;
+  
+  // Normal display mode on (command 0x13)
+  if (!writeCmd(0x13)) return false ;
+
+  // Flush out NOOP command to bus
+  m_pSPI->flush9bit(0, 0x00) ;
+  return true ;
+}
+
+void PCF8833LCD::invalidate()
+{
+  m_bPreviousValid = false ;
+  m_nDirty = 0 ;
+}
+
+void PCF8833LCD::validate()
+{
+  if (!m_pDisplay) return ;
+
+  memcpy(m_pPrevious, m_pDisplay, m_width * m_height * m_nBytesPerPixel) ;
+  m_bPreviousValid = true ;
+  m_nDirty = 0 ;
+}
+
+void PCF8833LCD::resetStats()
+{
+  memset(&m_stats, 0, sizeof(m_stats)) ;
+}
+
+uint32_t PCF8833LCD::windowCost(const DirtyRect &rc)
+{
+  uint32_t pixels = (rc.x1 - rc.x0 + 1) * (rc.y1 - rc.y0 + 1) ;
+
+  if (m_eColour == colour8bit) return PCF8833_WINDOW_OVERHEAD + pixels ;
+
+  // 12 bit colour packs 2 pixels into 3 bytes
+  return PCF8833_WINDOW_OVERHEAD + ((pixels + 1) / 2) * 3 ;
+}
+
+void PCF8833LCD::markDirty(int x0, int y0, int x1, int y1)
+{
+  DirtyRect rc ;
+
+  if (x0 < 0) x0 = 0 ;
+  if (y0 < 0) y0 = 0 ;
+  if (x1 >= (int)m_width) x1 = m_width - 1 ;
+  if (y1 >= (int)m_height) y1 = m_height - 1 ;
+  if (x0 > x1 || y0 > y1) return ; // nothing on the display
+
+  rc.x0 = x0 ; rc.y0 = y0 ; rc.x1 = x1 ; rc.y1 = y1 ;
+  addDirty(m_dirty, m_nDirty, rc) ;
+}
+
+PCF8833LCD::DirtyRect PCF8833LCD::unionRect(const DirtyRect &a, const DirtyRect &b)
+{
+  DirtyRect u ;
+  u.x0 = a.x0 < b.x0?a.x0:b.x0 ;
+  u.y0 = a.y0 < b.y0?a.y0:b.y0 ;
+  u.x1 = a.x1 > b.x1?a.x1:b.x1 ;
+  u.y1 = a.y1 > b.y1?a.y1:b.y1 ;
+  return u ;
+}
+
+void PCF8833LCD::addDirty(DirtyRect *pList, int &nCount, DirtyRect rc)
+{
+  int best = -1 ;
+  uint32_t bestcost = 0, cost = 0 ;
+
+  // Merge with any window where sending the combined area costs no more
+  // than opening both windows. The merged window may now merge with others
+  // so start again
+  for (int i=0; i < nCount; i++){
+    DirtyRect u = unionRect(pList[i], rc) ;
+    if (windowCost(u) <= windowCost(pList[i]) + windowCost(rc)){
+      rc = u ;
+      pList[i] = pList[--nCount] ;
+      i = -1 ;
+    }
+  }
+
+  if (nCount < PCF8833_MAX_DIRTY){
+    pList[nCount++] = rc ;
+    return ;
+  }
+
+  // No room left. Merge with the window that adds the least to the cost
+  for (int i=0; i < nCount; i++){
+    DirtyRect u = unionRect(pList[i], rc) ;
+    cost = windowCost(u) - windowCost(pList[i]) ;
+    if (best < 0 || cost < bestcost){
+      best = i ;
+      bestcost = cost ;
+    }
+  }
+  rc = unionRect(pList[best], rc) ;
+  pList[best] = pList[--nCount] ;
+  addDirty(pList, nCount, rc) ;
+}
+
+// Compare spans a 32 bit word at a time. Returns the offset of the
+// first differing byte or -1 if the spans match
+static int firstDifference(const uint8_t *a, const uint8_t *b, int len)
+{
+  uint32_t wa, wb ;
+  int i = 0 ;
+
+  for (; i + 4 <= len; i += 4){
+    memcpy(&wa, a+i, 4) ;
+    memcpy(&wb, b+i, 4) ;
+    if (wa != wb) break ;
+  }
+  for (; i < len; i++){
+    if (a[i] != b[i]) return i ;
+  }
+  return -1 ;
+}
+
+// As firstDifference but searching from the end of the spans
+static int lastDifference(const uint8_t *a, const uint8_t *b, int len)
+{
+  uint32_t wa, wb ;
+  int i = len ;
+
+  for (; i - 4 >= 0; i -= 4){
+    memcpy(&wa, a+i-4, 4) ;
+    memcpy(&wb, b+i-4, 4) ;
+    if (wa != wb) break ;
+  }
+  for (; i > 0; i--){
+    if (a[i-1] != b[i-1]) return i-1 ;
+  }
+  return -1 ;
+}
+
+bool PCF8833LCD::trimUnchanged(const uint8_t *pDisplay, DirtyRect &rc)
+{
+  int left = -1, right = -1, top = -1, bottom = -1, first = 0, last = 0 ;
+  uint32_t offset = 0 ;
+  int len = (rc.x1 - rc.x0 + 1) * m_nBytesPerPixel ;
+
+  for (int y=rc.y0; y <= rc.y1; y++){
+    offset = (rc.x0 + (y*m_width)) * m_nBytesPerPixel ;
+    first = firstDifference(pDisplay + offset, m_pPrevious + offset, len) ;
+    if (first < 0) continue ; // row unchanged
+
+    last = lastDifference(pDisplay + offset, m_pPrevious + offset, len) ;
+    if (top < 0) top = y ;
+    bottom = y ;
+    if (left < 0 || first/m_nBytesPerPixel < left) left = first/m_nBytesPerPixel ;
+    if (last/m_nBytesPerPixel > right) right = last/m_nBytesPerPixel ;
+  }
+
+  if (top < 0) return false ; // nothing changed
+
+  rc.y0 = top ;
+  rc.y1 = bottom ;
+  rc.x1 = rc.x0 + right ;
+  rc.x0 += left ;
+  return true ;
+}
+
+bool PCF8833LCD::writeWindow(const uint8_t *pDisplay, const DirtyRect &rc)
+{
+  int nibble = -1 ;
+  uint32_t offset = 0 ;
+  int len = (rc.x1 - rc.x0 + 1) * m_nBytesPerPixel ;
+
+  // Column address set (command 0x2A)
+  writeCmd(0x2A);
+  writeData(rc.x0);
+  writeData(rc.x1);
+  
+  // Page address set (command 0x2B)
+  writeCmd(0x2B);
+  writeData(rc.y0);
+  writeData(rc.y1);
+
+  // WRITE MEMORY
+  if (!writeCmd(0x2C)) return false ;
+
+  for (int y=rc.y0; y <= rc.y1; y++){
+    offset = (rc.x0 + (y*m_width)) * m_nBytesPerPixel ;
+    if (m_eColour == colour8bit){
+      // 1 byte per pixel
+      for (int i=0; i < len; i++){
+	if (!writeData(pDisplay[offset+i])) return false ;
+      }
+    }else{
+      // 2 pixels pack into 3 bytes. Window rows follow on from each
+      // other so a spare nibble carries over to the next row
+      for (int i=0; i < len; i++){
+	if (nibble < 0){
+	  nibble = pDisplay[offset+i] & 0x0F ;
+	}else{
+	  if (!writeData((nibble << 4) | (pDisplay[offset+i] & 0x0F))) return false ;
+	  nibble = -1 ;
+	}
+      }
+    }
+    memcpy(m_pPrevious + offset, pDisplay + offset, len) ;
+  }
+  if (nibble >= 0){
+    // Odd number of pixels. The LCD only writes complete pairs so finish with
+    // the first pixel again as the address wraps back to the window start
+    offset = (rc.x0 + (rc.y0*m_width)) * 3 ;
+    if (!writeData((nibble << 4) | pDisplay[offset])) return false ;
+    if (!writeData((pDisplay[offset+1] << 4) | pDisplay[offset+2])) return false ;
+  }
+
+  return true ;
+}
+
+void PCF8833LCD::putSymbol(uint8_t *pBuffer, uint32_t symbol, uint16_t value)
+{
+  // Symbols are 9 bits, most significant bit first, and always
+  // cover 2 bytes of the stream
+  uint32_t bit = symbol * 9 ;
+  uint8_t *p = pBuffer + (bit >> 3) ;
+  int shift = 7 - (bit & 7) ;
+  uint16_t mask = 0x1FF << shift ;
+  uint16_t val = (value & 0x1FF) << shift ;
+
+  p[0] = (p[0] & ~(mask >> 8)) | (val >> 8) ;
+  p[1] = (p[1] & ~(mask & 0xFF)) | (val & 0xFF) ;
+}
+
+uint8_t PCF8833LCD::getWireData(const uint8_t *pWire, uint32_t symbol)
+{
+  uint32_t bit = symbol * 9 ;
+  const uint8_t *p = pWire + (bit >> 3) ;
+
+  return (((p[0] << 8) | p[1]) >> (7 - (bit & 7))) & 0xFF ;
+}
+
+void PCF8833LCD::encodeWire(const uint8_t *pDisplay, uint8_t *pWire, int y, int x0, int x1)
+{
+  uint32_t p = x0 + (y * m_width), end = x1 + (y * m_width), pixels = m_width * m_height ;
+  uint32_t symbol = 0 ;
+  const uint8_t *a = NULL, *b = NULL ;
+
+  if (m_eColour == colour8bit){
+    for (; p <= end; p++){
+      putSymbol(pWire, PCF8833_WINDOW_OVERHEAD + p, 0x100 | pDisplay[p]) ;
+    }
+    return ;
+  }
+
+  // 12 bit colour. Pixel pairs share the middle byte so encode whole pairs.
+  // An odd last pixel is paired with the first pixel as the RAM address
+  // wraps, so a change to the first pixel also changes the last pair
+  if (p == 0 && (pixels & 1) && end < pixels - 1) encodeWire(pDisplay, pWire, m_height - 1, m_width - 1, m_width - 1) ;
+  for (p &= ~1; p <= end; p += 2){
+    a = pDisplay + (p * 3) ;
+    b = (p + 1 < pixels)?a + 3:pDisplay ;
+    symbol = PCF8833_WINDOW_OVERHEAD + ((p / 2) * 3) ;
+    putSymbol(pWire, symbol, 0x100 | (uint8_t)((a[0] << 4) | (a[1] & 0x0F))) ;
+    putSymbol(pWire, symbol + 1, 0x100 | (uint8_t)((a[2] << 4) | (b[0] & 0x0F))) ;
+    putSymbol(pWire, symbol + 2, 0x100 | (uint8_t)((b[1] << 4) | (b[2] & 0x0F))) ;
+  }
+}
+
+uint32_t PCF8833LCD::wireSize()
+{
+  uint32_t symbols = PCF8833_WINDOW_OVERHEAD ;
+
+  if (m_eColour == colour8bit) symbols += m_width * m_height ;
+  else symbols += (((m_width * m_height) + 1) / 2) * 3 ;
+
+  return ((symbols + 7) / 8) * 9 ;
+}
+
+void PCF8833LCD::encodeWireAll()
+{
+  m_nWireSize = encodeWireFrame(m_pDisplay, m_pWire) ;
+  m_bWireValid = true ;
+}
+
+uint32_t PCF8833LCD::encodeWireFrame(const uint8_t *pDisplay, uint8_t *pWire)
+{
+  uint32_t pixels = m_width * m_height ;
+  uint32_t symbols = PCF8833_WINDOW_OVERHEAD ;
+
+  // Full frame window commands
+  putSymbol(pWire, 0, 0x2A) ;
+  putSymbol(pWire, 1, 0x100 | 0) ;
+  putSymbol(pWire, 2, 0x100 | (m_width - 1)) ;
+  putSymbol(pWire, 3, 0x2B) ;
+  putSymbol(pWire, 4, 0x100 | 0) ;
+  putSymbol(pWire, 5, 0x100 | (m_height - 1)) ;
+  putSymbol(pWire, 6, 0x2C) ;
+
+  for (unsigned int y=0; y < m_height; y++) encodeWire(pDisplay, pWire, y, 0, m_width - 1) ;
+
+  if (m_eColour == colour8bit) symbols += pixels ;
+  else symbols += ((pixels + 1) / 2) * 3 ;
+
+  // NOOP to the end of the last 9 byte group
+  for (; symbols % 8; symbols++) putSymbol(pWire, symbols, 0x000) ;
+
+  return (symbols / 8) * 9 ;
+}
+
+bool PCF8833LCD::writeRows(const uint8_t *pDisplay, uint8_t *pWire, int y0, int y1)
+{
+  uint32_t p0 = y0 * m_width, p1 = (y1 + 1) * m_width ;
+  uint32_t first = 0, last = 0, aligned = 0, end = 0, s = 0 ;
+  DirtyRect rc = {0, y0, (int)m_width - 1, y1} ;
+
+  if (m_eColour == colour8bit){
+    first = PCF8833_WINDOW_OVERHEAD + p0 ;
+    last = PCF8833_WINDOW_OVERHEAD + p1 ;
+  }else if (y0 > 0 || y1 < (int)m_height - 1){
+    // Rows can only be cut from the wire image on pixel pair boundaries
+    if ((p0 | p1) & 1) return writeWindow(pDisplay, rc) ;
+    first = PCF8833_WINDOW_OVERHEAD + ((p0 / 2) * 3) ;
+    last = PCF8833_WINDOW_OVERHEAD + ((p1 / 2) * 3) ;
+  }
+
+  // Empty the 9 bit buffer so the stream starts on a group boundary
+  if (!m_pSPI->flush9bit(0, 0x00)) return false ;
+
+  if (y0 == 0 && y1 == (int)m_height - 1){
+    // Whole frame. The wire image is sent as is
+    if (!writeEncoded(pWire, wireSize())) return false ;
+  }else{
+    // NOOP padding places the window commands so that the row data
+    // falls in the same position of a 9 byte group as in the wire image
+    for (s=0; s < (first - PCF8833_WINDOW_OVERHEAD) % 8; s++) writeCmd(0x00) ;
+
+    writeCmd(0x2A) ;
+    writeData(0) ;
+    writeData(m_width - 1) ;
+    writeCmd(0x2B) ;
+    writeData(y0) ;
+    writeData(y1) ;
+    if (!writeCmd(0x2C)) return false ;
+
+    // Partial groups at either end are re-sent through the 9 bit buffer
+    aligned = (first + 7) & ~7 ;
+    end = last & ~7 ;
+    for (s=first; s < last && s < aligned; s++){
+      if (!writeData(getWireData(pWire, s))) return false ;
+    }
+    if (aligned < end){
+      if (!writeEncoded(pWire + ((aligned / 8) * 9), ((end - aligned) / 8) * 9)) return false ;
+    }
+    for (s=(end > s?end:s); s < last; s++){
+      if (!writeData(getWireData(pWire, s))) return false ;
+    }
+  }
+
+  memcpy(m_pPrevious + (p0 * m_nBytesPerPixel), pDisplay + (p0 * m_nBytesPerPixel), (p1 - p0) * m_nBytesPerPixel) ;
+
+  return true ;
+}
+
+bool PCF8833LCD::startPresenter()
+{
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "startPresenter: display not setup\n") ;
+    return false ;
+  }
+
+  // Frames are the display buffer followed by the wire image
+  return m_presenter.start(getFrame(NULL, 0), sendPresented, this) ;
+}
+
+bool PCF8833LCD::present()
+{
+  uint32_t len = m_presenter.getFrameSize() ;
+
+  if (!m_presenter.isRunning()){
+    fprintf(stderr, "present: call startPresenter first\n") ;
+    return false ;
+  }
+
+  if (getFrame(NULL, 0) != len){
+    fprintf(stderr, "present: display settings changed since startPresenter\n") ;
+    return false ;
+  }
+
+  getFrame(m_presenter.getBack(), len) ;
+  m_presenter.publish() ;
+  m_nDirty = 0 ;
+
+  return true ;
+}
+
+void PCF8833LCD::stopPresenter()
+{
+  if (!m_presenter.isRunning()) return ;
+
+  m_presenter.stop() ;
+
+  // The LCD shows the last frame sent. display() compares everything
+  // against it to send any drawing since
+  markDirty(0, 0, m_width - 1, m_height - 1) ;
+}
+
+bool PCF8833LCD::sendPresented(void *pContext, uint8_t *pFrame)
+{
+  return ((PCF8833LCD *)pContext)->sendFrame(pFrame) ;
+}
+
+bool PCF8833LCD::sendFrame(uint8_t *pFrame)
+{
+  DirtyRect full = {0, 0, (int)m_width - 1, (int)m_height - 1} ;
+  DirtyRect rc = full ;
+  uint8_t *pWire = pFrame + (m_width * m_height * m_nBytesPerPixel) ;
+  uint32_t cost = windowCost(full), fullcost = cost, area = m_width * m_height, pixels = area ;
+  bool bRet = true ;
+
+  // Counted as display() does with the whole frame as the dirty region.
+  // Only the present thread writes the stats while it runs
+  m_stats.frames++ ;
+
+  // One window around everything that changed since the last frame sent.
+  // Dirty regions of dropped frames are lost so the whole frame is compared
+  if (m_bPreviousValid){
+    if (!trimUnchanged(pFrame, rc)){
+      // nothing changed
+      m_stats.pixelsUnchanged += area ;
+      m_stats.pixelsSaved += area ;
+      m_stats.bytesSaved += fullcost ;
+      return true ;
+    }
+    pixels = (rc.x1 - rc.x0 + 1) * (rc.y1 - rc.y0 + 1) ;
+    m_stats.pixelsUnchanged += area - pixels ;
+    cost = windowCost(rc) ;
+  }
+  if (!m_bPreviousValid || cost >= fullcost){
+    rc = full ;
+    pixels = area ;
+    cost = fullcost ;
+    m_stats.fullframes++ ;
+  }
+
+  if (rc.x0 == 0 && rc.x1 == (int)m_width - 1) bRet = writeRows(pFrame, pWire, rc.y0, rc.y1) ;
+  else bRet = writeWindow(pFrame, rc) ;
   m_pSPI->flush9bit(0,0x00) ;
+
+  m_stats.windows++ ;
+  m_stats.pixelsSent += pixels ;
+  m_stats.pixelsSaved += area - pixels ;
+  m_stats.bytesSent += cost ;
+  m_stats.bytesSaved += fullcost - cost ;
+
+  // LCD RAM may be partly written on failure
+  m_bPreviousValid = bRet ;
+
+  return bRet ;
+}
+
+bool PCF8833LCD::display()
+{
+  DirtyRect windows[PCF8833_MAX_DIRTY] ;
+  DirtyRect full = {0, 0, (int)m_width - 1, (int)m_height - 1} ;
+  DirtyRect rc ;
+  int nWindows = 0 ;
+  uint32_t cost = 0, fullcost = windowCost(full), area = 0, pixels = 0 ;
+  bool bRet = true ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "display: display not setup\n") ;
+    return false ;
+  }
+
+  m_stats.frames++ ;
+
+  // Only needed after the buffer layout changes
+  if (!m_bWireValid) encodeWireAll() ;
+
+  if (m_bPreviousValid){
+    // Drop any pixels that match what is already on the LCD and then
+    // rebuild the window list as trimmed windows may merge differently
+    for (int i=0; i < m_nDirty; i++){
+      rc = m_dirty[i] ;
+      area = (rc.x1 - rc.x0 + 1) * (rc.y1 - rc.y0 + 1) ;
+      if (trimUnchanged(m_pDisplay, rc)){
+	m_stats.pixelsUnchanged += area - ((rc.x1 - rc.x0 + 1) * (rc.y1 - rc.y0 + 1)) ;
+	addDirty(windows, nWindows, rc) ;
+      }else{
+	m_stats.pixelsUnchanged += area ;
+      }
+    }
+    for (int i=0; i < nWindows; i++) cost += windowCost(windows[i]) ;
+  }
+
+  // Fall back to a full refresh if the windows cost more than the whole display
+  if (!m_bPreviousValid || cost >= fullcost){
+    windows[0] = full ;
+    nWindows = 1 ;
+    cost = fullcost ;
+    m_stats.fullframes++ ;
+  }
+  m_nDirty = 0 ;
+
+  for (int i=0; i < nWindows && bRet; i++){
+    // Full width windows are contiguous in the wire image
+    if (windows[i].x0 == 0 && windows[i].x1 == (int)m_width - 1) bRet = writeRows(m_pDisplay, m_pWire, windows[i].y0, windows[i].y1) ;
+    else bRet = writeWindow(m_pDisplay, windows[i]) ;
+    pixels += (windows[i].x1 - windows[i].x0 + 1) * (windows[i].y1 - windows[i].y0 + 1) ;
+  }
+
+  m_stats.windows += nWindows ;
+  m_stats.pixelsSent += pixels ;
+  m_stats.pixelsSaved += (m_width * m_height) - pixels ;
+  m_stats.bytesSent += cost ;
+  m_stats.bytesSaved += fullcost - cost ;
+
+  m_pSPI->flush9bit(0,0x00) ;
+
+  if (!bRet){
+    // LCD RAM may be partly written
+    invalidate() ;
+    return false ;
+  }
+  m_bPreviousValid = true ;
+
   return true ;
 }
 
 void PCF8833LCD::setBackground(uint8_t red, uint8_t green, uint8_t blue)
 {
   m_nBGCol = 0x0FFF & (red << 8 | green << 4 | blue) ; 
+  updateColours() ;
 }
 
 void PCF8833LCD::setForeground(uint8_t red, uint8_t green, uint8_t blue)
 {
   m_nFGCol = 0x0FFF & (red << 8 | green << 4 | blue) ; 
+  updateColours() ;
 }
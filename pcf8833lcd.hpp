@@ -6,6 +6,13 @@
 
 #include "hardware.hpp"
 #include "displayimage.hpp"
+#include "displayeffect.hpp"
+#include "framecache.hpp"
+#include "imagescale.hpp"
+#include "idisplay.hpp"
+#include "framepresenter.hpp"
+#include "glyphcache.hpp"
+#include "fontatlas.hpp"
 #include <stdint.h>
 
 ///////////////////////////////////////////////////
@@ -21,12 +28,46 @@
 // Generous 10MB image limit for single image files
 #define XMB_LOAD_MAX_SIZE 10485760
 
-class PCF8833LCD{
+// Number of separate dirty windows tracked between calls to display().
+// Further updates are merged into the cheapest existing window
+#define PCF8833_MAX_DIRTY 8
+
+// Bytes sent to open a RAM window. CASET and PASET with 2 data bytes each
+// and the RAMWR command
+#define PCF8833_WINDOW_OVERHEAD 7
+
+// Largest single SPI transfer from the wire image. Whole 9 byte groups
+// so each transfer ends on a symbol boundary. spidev defaults to 4096
+#define PCF8833_WIRE_CHUNK 4095
+
+// Pixels of glyph rows joined into one span by writeText
+#define PCF8833_TEXT_RUN 256
+
+class PCF8833LCD : public IDisplay{
 public:
   PCF8833LCD() ;
   ~PCF8833LCD() ;
 
-  enum enMode{overwrite, overlay, exclusive} ;
+  // Packed pixel formats for writeRaw. RGB24 is 3 bytes per pixel, RGBA
+  // is 4 and RGB444 is 2 bytes per pixel as big endian 0x0RGB
+  enum enRaw{rawRGB24, rawRGBA, rawRGB444} ;
+
+  // LCD RAM pixel formats. 12 bit is RGB444 and 8 bit is RGB332
+  // mapped to 12 bit colour by the LCD colour table
+  enum enColour{colour12bit, colour8bit} ;
+
+  // Counters for display() updates. Bytes are the 9 bit command and data
+  // bytes sent on the bus. Savings are against sending a full frame on every call
+  struct DisplayStats{
+    uint32_t frames ; // calls to display() and frames sent by the presenter
+    uint32_t fullframes ; // updates sent as a full frame
+    uint32_t windows ; // RAM windows written
+    uint32_t pixelsSent ;
+    uint32_t pixelsSaved ;
+    uint32_t pixelsUnchanged ; // dirty pixels found to match the previous frame
+    uint32_t bytesSent ;
+    uint32_t bytesSaved ;
+  };
   
   // GPIO and SPI interfaces must be configured and set 
   // prior to the LCD object using them. This means initialised
@@ -40,6 +81,9 @@ public:
              unsigned int height, 
 	     unsigned int reset_pin);
 
+  unsigned int getWidth(){return m_width;}
+  unsigned int getHeight(){return m_height;}
+
   // Initialise and turn on the LCD display.
   // Call after setup
   bool initialise(); // Call after setting interfaces
@@ -54,21 +98,174 @@ public:
   // Turn on the display.
   bool turnOn() ;
 
+  // Stepped versions of initialise, turnOn and turnOff. Commands are
+  // flushed before each delay so they reach the LCD before the wait
+  bool startSequence(enSequence eSequence) ;
+  int stepSequence() ;
+
   // Set image to background colour
   bool clearImage() ;
 
+  // Limit clearImage and writeImage to a region of the display. Pixels
+  // outside of the region are left unchanged, including by overwrite
+  bool setClip(int x, int y, unsigned int width, unsigned int height) ;
+  void clearClip() ;
+
+  // Change the pixel format used for the display buffer and LCD RAM.
+  // Can be changed at any time and the display buffer is converted
+  // to the new format. 8 bit mode sends 1 byte per pixel instead of 1.5
+  bool setColourMode(enColour eColour) ;
+  enColour getColourMode(){return m_eColour;}
+
+  // Ordered dithering for 32 bit images written in 12 bit colour.
+  // Reduces banding from truncating each colour to 4 bits
+  void setDither(bool bDither){m_bDither = bDither;}
+  bool getDither(){return m_bDither;}
+
   // Set where the 0 row origin is on the display
   // bottom is defined as where the connector ribbon is situated
   bool setYOrigin(bool bTop) ;
 
+  // Rotate the display by 0, 90, 180 or 270 degrees using the LCD memory
+  // access control so drawing costs nothing extra. Width and height swap
+  // for 90 and 270. Redraw the display buffer after changing
+  bool setRotation(unsigned int degrees) ;
+  unsigned int getRotation(){return m_nRotation;}
+
+  // Panel registers. These don't change the display buffer.
+  // Contrast is -64 to 63
+  bool setContrast(int contrast) ;
+  int getContrast(){return m_nContrast;}
+  bool setInverse(bool bInverse) ;
+  bool setDisplayOn(bool bOn) ;
+
+  // Timed effects which only send register commands. Call stepEffect
+  // every frame with the elapsed milliseconds, such as the value from
+  // FramePacer::wait(). stepEffect returns true while an effect runs.
+  // Starting an effect replaces any running effect
+  bool fadeContrast(int to, unsigned int duration) ;
+  bool blink(unsigned int count, unsigned int period) ;
+  bool flash(unsigned int count, unsigned int period) ;
+  bool stepEffect(unsigned int elapsed) ;
+  void stopEffect() ;
+
   // Load an image object into the display buffer
   // The image can add extra pixels, overwrite or xor pixels already set.
+  // Overlay of 32 bit images blends using the image alpha channel.
   // Call display() to send image to LCD
   bool writeImage(DisplayImage &img, enum enMode eMode, int xoffset=0, int yoffset=0);
 
-  // Write display buffer to the LCD
+  // Draw text in the foreground colour with the top left at xoffset,
+  // yoffset. Glyph rows go through the 1 bit expansion tables straight
+  // into the display buffer so no text image is made. Overwrite fills the
+  // rest of the glyph cells with the background. Clipped to the clip
+  // region. Call display() to send to the LCD
+  bool writeText(GlyphCache &glyphs, const char *szText, enum enMode eMode, int xoffset=0, int yoffset=0) ;
+
+  // Draw anti-aliased UTF-8 text from a FreeType face at a pixel size,
+  // with the top of the line at xoffset, yoffset. Glyph coverage blends
+  // the foreground colour over the display buffer. Glyphs come from the
+  // atlas so are only rasterised the first time they are used. Clipped
+  // to the clip region. Call display() to send to the LCD
+  bool writeText(FontAtlas &atlas, int face, unsigned int size, const char *szText, int xoffset=0, int yoffset=0) ;
+
+  // Vector drawing in the foreground colour straight into the display
+  // buffer. Shapes have no unset pixels so overwrite and overlay both draw
+  // the foreground and exclusive xors it. Rows are filled with word copies.
+  // Clipped to the clip region. Call display() to send to the LCD
+  bool drawHLine(int x, int y, unsigned int width, enum enMode eMode = overlay) ;
+  bool drawVLine(int x, int y, unsigned int height, enum enMode eMode = overlay) ;
+  bool drawLine(int x0, int y0, int x1, int y1, enum enMode eMode = overlay) ;
+  bool drawRect(int x, int y, unsigned int width, unsigned int height, bool bFill = false, enum enMode eMode = overlay) ;
+  bool drawCircle(int cx, int cy, unsigned int radius, bool bFill = false, enum enMode eMode = overlay) ;
+
+  // Overwrite a region of the display buffer with packed pixels such as
+  // decoded video frames. Saves building a DisplayImage for every frame.
+  // Clipped to the clip region. Call display() to send to the LCD
+  bool writeRaw(const uint8_t *pSrc, enRaw eFormat, unsigned int width, unsigned int height, int xoffset=0, int yoffset=0) ;
+
+  // A frame is a copy of the display buffer and its wire image, such as
+  // for keeping converted images in files to show later. Frames only
+  // suit the size, colour mode and colours they were made with.
+  // getFrame copies the display buffer. Pass a NULL buffer to get the size
+  uint32_t getFrame(uint8_t *pBuffer, uint32_t len) ;
+
+  // Replace the display buffer with a frame. Call display() to send to the LCD
+  bool setFrame(const uint8_t *pFrame, uint32_t len) ;
+
+  // Convert packed pixels the size of the display into a frame without
+  // changing the display buffer. Only reads the display settings so it can
+  // run on another thread while they are left alone
+  uint32_t convertFrame(const uint8_t *pSrc, enRaw eFormat, uint8_t *pBuffer, uint32_t len) ;
+
+  // Scale an image to width x height and overwrite the display buffer at
+  // xoffset, yoffset. 32 bit images convert as for writeRaw and alpha is
+  // ignored. 1 bit images blend the background and foreground colours by
+  // coverage, which smooths edges when filtered. Clipped to the clip
+  // region. Call display() to send to the LCD
+  bool writeScaled(DisplayImage &img, ImageScale::enFilter eFilter, int xoffset, int yoffset,
+		   unsigned int width, unsigned int height) ;
+
+  // Write display buffer to the LCD. Only regions changed since the
+  // last call are written unless a full frame is cheaper to send
   bool display() ;
 
+  // Frames shown with displayImage are kept in the cache so showing an
+  // image again skips conversion and encoding. The cache belongs to the
+  // caller and can be shared with other code. NULL stops caching
+  void setFrameCache(FrameCache *pCache){m_pCache = pCache;}
+
+  // Overwrite the display buffer with an image and display it. The same as
+  // writeImage with overwrite followed by display() but uses the frame cache.
+  // Frames are only cached when there is no clip region
+  bool displayImage(DisplayImage &img, int xoffset=0, int yoffset=0) ;
+
+  // Send frames from a background thread. present() copies the display
+  // buffer and returns at once, and the thread sends the newest copy with
+  // only the changed pixels. Frames drawn faster than they are sent are
+  // dropped. While it runs only draw into the display buffer. Leave the
+  // settings, registers, effects and display() until stopPresenter
+  bool startPresenter() ;
+  bool present() ;
+  void stopPresenter() ;
+  void getPresenterStats(FramePresenter::PresenterStats &stats){m_presenter.getStats(stats);}
+
+  // Encode an image as a RAM window at xoffset, yoffset ready to send with
+  // writeEncoded. Uses the current colours and colour mode and the image
+  // replaces the window as for overwrite. Returns the encoded size or 0 on
+  // error. Pass a NULL buffer to get the size required
+  uint32_t encodeImage(DisplayImage &img, int xoffset, int yoffset, uint8_t *pBuffer, uint32_t len) ;
+
+  // Encode complete display buffer rows y0 to y1 as a RAM window ready to
+  // send with writeEncoded. Data is cut from the wire image where rows
+  // start on a pixel pair. Returns the encoded size or 0 on error. Pass a
+  // NULL buffer to get the size required
+  uint32_t encodeRows(int y0, int y1, uint8_t *pBuffer, uint32_t len) ;
+
+  // Send an encoded buffer straight to the LCD. This bypasses the display
+  // buffer so call invalidate() before display() writes over the window
+  bool writeEncoded(uint8_t *pBuffer, uint32_t len) ;
+
+  // Hardware vertical scrolling. Rows above top and below bottom are fixed
+  // and the LCD shows the scroll area starting from RAM row start. Drawing
+  // still uses RAM rows
+  bool setScrollArea(unsigned int top, unsigned int bottom) ;
+  bool setScrollStart(unsigned int start) ;
+
+  // Return to normal display mode with no scrolling
+  bool endScroll() ;
+
+  // Force the next display() to write the complete display buffer
+  void invalidate() ;
+
+  // Record that the LCD RAM matches the display buffer, such as after
+  // sending every row with encodeRows. Clears the dirty regions
+  void validate() ;
+
+  // Read and reset the counters for display() and presented frames
+  void getStats(DisplayStats &stats){stats = m_stats;}
+  void resetStats() ;
+
   // Change background colour. This is used where no known colour is available or
   // for 2 bit images
   void setBackground(uint8_t red, uint8_t green, uint8_t blue);
@@ -78,22 +275,176 @@ public:
   void setForeground(uint8_t red, uint8_t green, uint8_t blue);
   
 protected:
+  // Inclusive display coordinates as used by CASET and PASET
+  struct DirtyRect{
+    int x0, y0, x1, y1 ;
+  };
+
   bool verify() ;
 
+  // Start a sequence and sleep through its delays
+  bool runSequence(enSequence eSequence) ;
+
+  // Steps of each sequence. Return as for stepSequence
+  int stepInitialise(int step) ;
+  int stepTurnOn(int step) ;
+  int stepTurnOff(int step) ;
+
+  // Frame cache key for an overwrite of img with the current settings
+  uint64_t frameKey(DisplayImage &img, int xoffset, int yoffset) ;
+
+  // DisplayEffect apply function. pContext is the driver
+  static void applyEffect(void *pContext, DisplayEffect &effect, DisplayEffect::enEffect eEffect) ;
+
+  // Set m_nMADCTL from the rotation and y origin
+  void updateMADCTL() ;
+
+  // Add a region to the dirty list. Coordinates are clipped to the display
+  void markDirty(int x0, int y0, int x1, int y1) ;
+  void addDirty(DirtyRect *pList, int &nCount, DirtyRect rc) ;
+  static DirtyRect unionRect(const DirtyRect &a, const DirtyRect &b) ;
+
+  // Bytes required to send a window of pixels
+  uint32_t windowCost(const DirtyRect &rc) ;
+
+  // Shrink a region of a display buffer to the pixels which differ from the
+  // previous frame. Returns false if nothing has changed
+  bool trimUnchanged(const uint8_t *pDisplay, DirtyRect &rc) ;
+
+  // Write a RAM window from a display buffer and copy the pixels to the
+  // previous frame buffer
+  bool writeWindow(const uint8_t *pDisplay, const DirtyRect &rc) ;
+
+  // Convert a row of packed pixels to display buffer format. x and y
+  // position the dither pattern
+  void convertRaw(const uint8_t *pSrc, enRaw eFormat, uint8_t *pDst, int x, int y, int nPixels) ;
+
+  // Encode a span of display buffer pixels into a wire image
+  void encodeWire(const uint8_t *pDisplay, uint8_t *pWire, int y, int x0, int x1) ;
+
+  // Build the complete wire image including the window commands
+  void encodeWireAll() ;
+
+  // Encode a full display buffer into a wire image. Returns the size
+  uint32_t encodeWireFrame(const uint8_t *pDisplay, uint8_t *pWire) ;
+
+  // Wire image size for the current colour mode
+  uint32_t wireSize() ;
+
+  // Write a 9 bit symbol to a buffer of 9 byte groups by symbol index
+  static void putSymbol(uint8_t *pBuffer, uint32_t symbol, uint16_t value) ;
+
+  // Read the data byte of a symbol in a wire image
+  static uint8_t getWireData(const uint8_t *pWire, uint32_t symbol) ;
+
+  // Send a frame copied by present(). Called on the present thread
+  static bool sendPresented(void *pContext, uint8_t *pFrame) ;
+  bool sendFrame(uint8_t *pFrame) ;
+
+  // Write complete rows of a display buffer, copying ready encoded data
+  // from its wire image. Also copies the rows to the previous frame buffer
+  bool writeRows(const uint8_t *pDisplay, uint8_t *pWire, int y0, int y1) ;
+
+  // Send COLMOD and the colour table for the current colour mode
+  bool sendColourMode() ;
+
+  // Update the display buffer format versions of the colours
+  void updateColours() ;
+
+  // Write a colour in display buffer format to a span of pixels
+  void fillSpan(uint8_t *pDst, int nPixels, const uint8_t *pColour) ;
+
+  // Xor a colour in display buffer format into a span of pixels
+  void xorSpan(uint8_t *pDst, int nPixels, const uint8_t *pColour) ;
+
+  // Fill or xor a region with the foreground clipped to the clip region
+  void fillClipped(int x0, int y0, int x1, int y1, bool bInvert) ;
+
+  // Raster span callback. pContext is a SpanContext
+  struct SpanContext{
+    PCF8833LCD *pLCD ;
+    bool bInvert ;
+  };
+  static void rasterSpan(void *pContext, int x0, int x1, int y) ;
+
+  // Mark a region clipped to the clip region
+  void markClipped(int x0, int y0, int x1, int y1) ;
+
+  // Write image rows y0 to y1 - 1 between columns x0 and x1 - 1 to the display
+  // buffer. Compiled for each bytes per pixel, image bit depth and mode.
+  // writeImage picks the instance once so the spans have no mode tests
+  template <int BPP, int DEPTH, enum enMode MODE>
+  void blitRows(DisplayImage &img, int xoffset, int yoffset, int x0, int y0, int x1, int y1) ;
+  // Switch on the mode to call blitRows
+  template <int BPP, int DEPTH>
+  void blitMode(enum enMode eMode, DisplayImage &img, int xoffset, int yoffset, int x0, int y0, int x1, int y1) ;
+
+  // Write the glyphs of a string to the display buffer from x, y. Compiled
+  // for each bytes per pixel and mode as for blitRows. Returns the end x
+  template <int BPP, enum enMode MODE>
+  int textRun(GlyphCache &glyphs, const char *szText, int x, int y) ;
+
   IHardwareGPIO *m_pGPIO ;
   IHardwareSPI *m_pSPI ;
   IHardwareTimer *m_pTime ;
   unsigned int m_resetpin, m_width, m_height ;
 
-  // 3 colours with 1 colour per byte
-  // Use unpacked bytes for data
+  // 12 bit colour uses 3 colours with 1 colour per byte. Use unpacked bytes for data
+  // 8 bit colour uses 1 byte per pixel. The buffer is always allocated for 12 bit
   uint8_t *m_pDisplay ;
   unsigned int m_nDisplaySize ;
+  enColour m_eColour ;
+  int m_nBytesPerPixel ;
+  bool m_bDither ;
+
+  // Copy of the pixels last sent to the LCD RAM. Used to
+  // skip writing pixels which haven't changed
+  uint8_t *m_pPrevious ;
+  bool m_bPreviousValid ;
+
+  // The display buffer as a full frame 9 bit SPI stream. The window
+  // commands are followed by pixel data and padded with NOOP to a
+  // 9 byte group. Kept up to date as the display buffer is written
+  uint8_t *m_pWire ;
+  uint32_t m_nWireSize ;
+  bool m_bWireValid ;
+
+  // Scaled row for writeScaled. Grown when a wider row is scaled
+  uint8_t *m_pScaled ;
+  uint32_t m_nScaledSize ;
+
+  FrameCache *m_pCache ;
+
+  DirtyRect m_clip ;
+  DirtyRect m_dirty[PCF8833_MAX_DIRTY] ;
+  int m_nDirty ;
+
+  DisplayStats m_stats ;
+
+  // Owns m_pPrevious while it runs
+  FramePresenter m_presenter ;
 
   // Specific to driver
   uint8_t m_nMADCTL ; // Memory address control
+  int m_nContrast ;
+  bool m_bInverse ;
+  bool m_bDisplayOn ;
+  DisplayEffect m_effect ;
+  enSequence m_eSequence ;
+  int m_nStep ; // next step of m_eSequence
+  bool m_bSequence ; // running
+  bool m_bYTop ; // setYOrigin mirror
+  unsigned int m_nRotation ;
   uint16_t m_nBGCol ; // Default background colour
   uint16_t m_nFGCol ; // Default foreground colour
+  uint8_t m_bgPixel[3] ; // Background in display buffer format
+  uint8_t m_fgPixel[3] ; // Foreground in display buffer format
+
+  // Expansion of 1 bit image bytes to 8 display buffer pixels. Updated when
+  // the colours or colour mode change. The mask table sets every byte of a
+  // pixel with a set bit and is used for overlay and exclusive writes
+  uint8_t m_lut1bpp[256][24] ;
+  uint8_t m_lutMask[256][24] ;
 };
 
 
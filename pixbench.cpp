@@ -0,0 +1,319 @@
+#include "colourconvert.hpp"
+#include "imagescale.hpp"
+#include "blit.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+///////////////////////////////////////////////////
+//
+// Micro-benchmark for the pixel conversion, blit and
+// scaling kernels.
+// Needs no display hardware. Run with an optional
+// iteration count, default 1000 frames
+//
+///////////////////////////////////////////////////
+
+#define BENCH_WIDTH 132
+#define BENCH_HEIGHT 132
+
+// SDD1306 display size for the page blits
+#define OLED_WIDTH 64
+#define OLED_HEIGHT 48
+
+// Image size scaled down to the frame size
+#define SCALE_SRC_WIDTH 640
+#define SCALE_SRC_HEIGHT 480
+
+static double timeNow()
+{
+  struct timespec ts ;
+  clock_gettime(CLOCK_MONOTONIC, &ts) ;
+  return ts.tv_sec + (ts.tv_nsec / 1000000000.0) ;
+}
+
+static void report(const char *szName, double secs, int frames, int frameSize = BENCH_WIDTH * BENCH_HEIGHT)
+{
+  double pixels = (double)frameSize * frames ;
+  printf("%-34s %8.1f us/frame %8.1f Mpixel/s\n", szName, (secs * 1000000.0) / frames, pixels / (secs * 1000000.0)) ;
+}
+
+// Per pixel conversion as previously used by PCF8833LCD::writeImage
+static void referenceRGB444(const uint8_t *pSrc, uint8_t *pDst, int nPixels)
+{
+  for (int i=0; i < nPixels; i++){
+    pDst[i*3] = pSrc[i*4] >> 4 ;
+    pDst[(i*3)+1] = pSrc[(i*4)+1] >> 4 ;
+    pDst[(i*3)+2] = pSrc[(i*4)+2] >> 4 ;
+  }
+}
+
+// 1 bit span write as previously used by PCF8833LCD::writeImage, with the
+// mode and pixel size tested at run time. Whole bytes use the tables
+static void reference1bpp(const uint8_t *pSrc, int srcx, uint8_t *pDst, int nPixels, int nBytesPerPixel,
+			  IDisplay::enMode eMode, const uint8_t *pFG, const uint8_t *pBG,
+			  const uint8_t (*pLUT)[24], const uint8_t (*pMask)[24])
+{
+  int head = (8 - (srcx % 8)) % 8, len = 8 * nBytesPerPixel, nBytes = 0, end = 0 ;
+  uint32_t d, e, m ;
+
+  if (head > nPixels) head = nPixels ;
+  nBytes = (nPixels - head) / 8 ;
+  end = srcx + nPixels ;
+  for (int x=srcx; x < end; x++){
+    if (x == srcx + head && nBytes > 0){
+      // Whole image bytes through the tables
+      for (int i=0; i < nBytes; i++, x += 8, pDst += len){
+	const uint8_t b = pSrc[x/8] ;
+	if (eMode == IDisplay::overwrite){
+	  memcpy(pDst, pLUT[b], len) ;
+	  continue ;
+	}
+	if (b == 0x00) continue ;
+	for (int w=0; w < len; w += 4){
+	  memcpy(&d, pDst + w, 4) ;
+	  memcpy(&e, pLUT[b] + w, 4) ;
+	  memcpy(&m, pMask[b] + w, 4) ;
+	  if (eMode == IDisplay::overlay) d = (d & ~m) | (e & m) ;
+	  else d ^= e & m ;
+	  memcpy(pDst + w, &d, 4) ;
+	}
+      }
+      if (x >= end) break ;
+    }
+    if (pSrc[x/8] & (1 << (x % 8))){
+      for (int b=0; b < nBytesPerPixel; b++){
+	if (eMode == IDisplay::exclusive) pDst[b] ^= pFG[b] ;
+	else pDst[b] = pFG[b] ;
+      }
+    }else if (eMode == IDisplay::overwrite){
+      for (int b=0; b < nBytesPerPixel; b++) pDst[b] = pBG[b] ;
+    }
+    pDst += nBytesPerPixel ;
+  }
+}
+
+// Per pixel page write as previously used by SDD1306OLED::writeImage
+static void referencePages(const uint8_t *pImg, int stride, uint8_t *pDisplay, bool bTranspose, IDisplay::enMode eMode)
+{
+  int width = bTranspose?OLED_HEIGHT:OLED_WIDTH, height = bTranspose?OLED_WIDTH:OLED_HEIGHT ;
+  int px = 0, py = 0 ;
+
+  for (int cy=0; cy < height; cy++){
+    for (int cx=0; cx < width; cx++){
+      px = bTranspose?OLED_WIDTH - 1 - cy:cx ;
+      py = bTranspose?cx:cy ;
+      if (pImg[cx/8+(cy*stride)] & (1 << (cx % 8))){
+	if (eMode == IDisplay::exclusive) pDisplay[px+(py/8)*OLED_WIDTH] ^= 1 << (py%8) ;
+	else pDisplay[px+(py/8)*OLED_WIDTH] |= 1 << (py%8) ;
+      }else if (eMode == IDisplay::overwrite){
+	pDisplay[px+(py/8)*OLED_WIDTH] &= ~(1 << (py%8)) ;
+      }
+    }
+  }
+}
+
+// Time the blit instances for one destination format against the previous code
+template <int BPP, IDisplay::enMode MODE>
+static void benchBlit(const char *szMode, const uint8_t *pBits, const uint8_t *pSrc, uint8_t *pDst, int frames,
+		      const uint8_t (*pLUT)[24], const uint8_t (*pMask)[24])
+{
+  const uint8_t fg[3] = {0x0F, 0x0C, 0x01}, bg[3] = {0x03, 0x05, 0x09} ;
+  const int stride1 = (BENCH_WIDTH + 7) / 8 ;
+  char szName[40] ;
+  double start = 0 ;
+
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      reference1bpp(pBits + (y*stride1), 1, pDst + (y*BENCH_WIDTH*BPP), BENCH_WIDTH - 1, BPP, MODE, fg, bg, pLUT, pMask) ;
+    }
+  }
+  snprintf(szName, sizeof(szName), "%s 1bpp %s previous", BPP == 1?"RGB332":"RGB444", szMode) ;
+  report(szName, timeNow() - start, frames) ;
+
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      // Start a pixel in so the partial byte paths are timed too
+      Blit::span1bpp<BPP, MODE>(pBits + (y*stride1), 1, pDst + (y*BENCH_WIDTH*BPP), BENCH_WIDTH - 1, fg, bg, pLUT, pMask) ;
+    }
+  }
+  snprintf(szName, sizeof(szName), "%s 1bpp %s blit", BPP == 1?"RGB332":"RGB444", szMode) ;
+  report(szName, timeNow() - start, frames) ;
+
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      Blit::span32bpp<BPP, MODE>(pSrc + (y*BENCH_WIDTH*4), pDst + (y*BENCH_WIDTH*BPP), BENCH_WIDTH, NULL) ;
+    }
+  }
+  snprintf(szName, sizeof(szName), "%s 32bpp %s blit", BPP == 1?"RGB332":"RGB444", szMode) ;
+  report(szName, timeNow() - start, frames) ;
+}
+
+// Time a full screen page blit against the previous code
+template <IDisplay::enMode MODE>
+static void benchPages(const char *szMode, const uint8_t *pBits, uint8_t *pDisplay, int frames)
+{
+  const int stride = (OLED_WIDTH + 7) / 8 ;
+  char szName[40] ;
+  double start = 0 ;
+
+  for (int t=0; t < 2; t++){
+    start = timeNow() ;
+    for (int f=0; f < frames; f++) referencePages(pBits, stride, pDisplay, t == 1, MODE) ;
+    snprintf(szName, sizeof(szName), "Pages%s %s previous", t?" rotated":"", szMode) ;
+    report(szName, timeNow() - start, frames, OLED_WIDTH * OLED_HEIGHT) ;
+
+    start = timeNow() ;
+    for (int f=0; f < frames; f++){
+      if (t == 0){
+	for (int y=0; y < OLED_HEIGHT; y++){
+	  Blit::spanToPage<MODE>(pBits + (y*stride), 0, pDisplay + ((y/8)*OLED_WIDTH), OLED_WIDTH, 1 << (y % 8)) ;
+	}
+      }else{
+	for (int y=0; y < OLED_WIDTH; y++){
+	  Blit::spanToColumn<MODE>(pBits + (y*stride), 0, pDisplay + (OLED_WIDTH - 1 - y), 0, OLED_HEIGHT, OLED_WIDTH) ;
+	}
+      }
+    }
+    snprintf(szName, sizeof(szName), "Pages%s %s blit", t?" rotated":"", szMode) ;
+    report(szName, timeNow() - start, frames, OLED_WIDTH * OLED_HEIGHT) ;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int frames = 1000 ;
+  double start = 0 ;
+  uint8_t pattern[4] ;
+  uint8_t *pSrc = new uint8_t[BENCH_WIDTH * BENCH_HEIGHT * 4] ;
+  uint8_t *pDst = new uint8_t[BENCH_WIDTH * BENCH_HEIGHT * 3] ;
+
+  if (argc > 1) frames = atoi(argv[1]) ;
+  if (frames <= 0) frames = 1000 ;
+
+  for (int i=0; i < BENCH_WIDTH * BENCH_HEIGHT * 4; i++) pSrc[i] = rand() ;
+
+  printf("%dx%d frames, %d iterations\n", BENCH_WIDTH, BENCH_HEIGHT, frames) ;
+
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      referenceRGB444(pSrc + (y*BENCH_WIDTH*4), pDst + (y*BENCH_WIDTH*3), BENCH_WIDTH) ;
+    }
+  }
+  report("RGBA->RGB444 per pixel", timeNow() - start, frames) ;
+
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      ColourConvert::rgbaToRGB444(pSrc + (y*BENCH_WIDTH*4), pDst + (y*BENCH_WIDTH*3), BENCH_WIDTH) ;
+    }
+  }
+  report("RGBA->RGB444 span", timeNow() - start, frames) ;
+
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      ColourConvert::ditherPattern(0, y, pattern) ;
+      ColourConvert::rgbaToRGB444(pSrc + (y*BENCH_WIDTH*4), pDst + (y*BENCH_WIDTH*3), BENCH_WIDTH, pattern) ;
+    }
+  }
+  report("RGBA->RGB444 span dithered", timeNow() - start, frames) ;
+
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      ColourConvert::rgbaToRGB332(pSrc + (y*BENCH_WIDTH*4), pDst + (y*BENCH_WIDTH), BENCH_WIDTH) ;
+    }
+  }
+  report("RGBA->RGB332 span", timeNow() - start, frames) ;
+
+  // Blend with a mix of transparent, opaque and partial alpha blocks
+  for (int i=0; i < BENCH_WIDTH * BENCH_HEIGHT; i++){
+    if ((i / 16) % 3 == 0) pSrc[(i*4)+3] = 0x00 ;
+    else if ((i / 16) % 3 == 1) pSrc[(i*4)+3] = 0xFF ;
+  }
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      ColourConvert::blendRGBAToRGB444(pSrc + (y*BENCH_WIDTH*4), pDst + (y*BENCH_WIDTH*3), BENCH_WIDTH) ;
+    }
+  }
+  report("RGBA over RGB444 blend", timeNow() - start, frames) ;
+
+  // Coverage as for glyphs, using the alpha channel of the same blocks
+  uint8_t *pCoverage = new uint8_t[BENCH_WIDTH * BENCH_HEIGHT] ;
+  const uint8_t colour[3] = {0xFF, 0xC0, 0x10} ;
+  for (int i=0; i < BENCH_WIDTH * BENCH_HEIGHT; i++) pCoverage[i] = pSrc[(i*4)+3] ;
+  start = timeNow() ;
+  for (int f=0; f < frames; f++){
+    for (int y=0; y < BENCH_HEIGHT; y++){
+      ColourConvert::blendCoverageRGB444(pCoverage + (y*BENCH_WIDTH), colour, pDst + (y*BENCH_WIDTH*3), BENCH_WIDTH) ;
+    }
+  }
+  report("Coverage over RGB444 blend", timeNow() - start, frames) ;
+  delete[] pCoverage ;
+
+  // Blits for each destination format, source depth and mode. The tables
+  // are filled as PCF8833LCD::updateColours does
+  uint8_t lut[256][24], mask[256][24] ;
+  uint8_t *pBits = new uint8_t[BENCH_WIDTH * BENCH_HEIGHT / 8 + BENCH_HEIGHT] ;
+  for (int i=0; i < BENCH_WIDTH * BENCH_HEIGHT / 8 + BENCH_HEIGHT; i++) pBits[i] = rand() ;
+  for (int bpp=1; bpp <= 3; bpp += 2){
+    const uint8_t fg[3] = {0x0F, 0x0C, 0x01}, bg[3] = {0x03, 0x05, 0x09} ;
+    for (int b=0; b < 256; b++){
+      for (int bit=0; bit < 8; bit++){
+	for (int c=0; c < bpp; c++){
+	  lut[b][(bit*bpp)+c] = b & (1 << bit)?fg[c]:bg[c] ;
+	  mask[b][(bit*bpp)+c] = b & (1 << bit)?0xFF:0x00 ;
+	}
+      }
+    }
+    if (bpp == 1){
+      benchBlit<1, IDisplay::overwrite>("overwrite", pBits, pSrc, pDst, frames, lut, mask) ;
+      benchBlit<1, IDisplay::overlay>("overlay", pBits, pSrc, pDst, frames, lut, mask) ;
+      benchBlit<1, IDisplay::exclusive>("exclusive", pBits, pSrc, pDst, frames, lut, mask) ;
+    }else{
+      benchBlit<3, IDisplay::overwrite>("overwrite", pBits, pSrc, pDst, frames, lut, mask) ;
+      benchBlit<3, IDisplay::overlay>("overlay", pBits, pSrc, pDst, frames, lut, mask) ;
+      benchBlit<3, IDisplay::exclusive>("exclusive", pBits, pSrc, pDst, frames, lut, mask) ;
+    }
+  }
+  benchPages<IDisplay::overwrite>("overwrite", pBits, pDst, frames) ;
+  benchPages<IDisplay::overlay>("overlay", pBits, pDst, frames) ;
+  benchPages<IDisplay::exclusive>("exclusive", pBits, pDst, frames) ;
+  delete[] pBits ;
+
+  // Scale a larger image down to the frame size. Rates are target pixels
+  const char *szFilters[3] = {"nearest", "bilinear", "box"} ;
+  const ImageScale::enFilter filters[3] = {ImageScale::nearest, ImageScale::bilinear, ImageScale::box} ;
+  char szName[32] ;
+  ImageScale scale ;
+  uint8_t *pImg = new uint8_t[SCALE_SRC_WIDTH * SCALE_SRC_HEIGHT * 4] ;
+  for (int i=0; i < SCALE_SRC_WIDTH * SCALE_SRC_HEIGHT * 4; i++) pImg[i] = rand() ;
+
+  for (int bpp=32; bpp > 0; bpp -= 31){
+    scale.setSource(pImg, SCALE_SRC_WIDTH, SCALE_SRC_HEIGHT, bpp == 1?(SCALE_SRC_WIDTH + 7) / 8:SCALE_SRC_WIDTH * 4, bpp) ;
+    for (int n=0; n < 3; n++){
+      scale.setTarget(BENCH_WIDTH, BENCH_HEIGHT, filters[n]) ;
+      start = timeNow() ;
+      for (int f=0; f < frames; f++){
+	for (int y=0; y < BENCH_HEIGHT; y++){
+	  scale.scaleRow(y, pDst) ;
+	}
+      }
+      snprintf(szName, sizeof(szName), "Scale %dbpp %s", bpp, szFilters[n]) ;
+      report(szName, timeNow() - start, frames) ;
+    }
+  }
+
+  delete[] pImg ;
+  delete[] pSrc ;
+  delete[] pDst ;
+
+  return 0 ;
+}
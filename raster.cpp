@@ -0,0 +1,75 @@
+#include "raster.hpp"
+#include <stdlib.h>
+
+void Raster::line(int x0, int y0, int x1, int y1, SpanFn pfn, void *pContext)
+{
+  int dx = abs(x1 - x0), dy = abs(y1 - y0) ;
+  int sx = x0 < x1?1:-1, sy = y0 < y1?1:-1 ;
+  int err = dx - dy, e2 = 0, nx = 0, ny = 0 ;
+  int start = x0 ; // first x of the span on this row
+
+  for (;;){
+    if (x0 == x1 && y0 == y1) break ;
+
+    e2 = err * 2 ;
+    nx = x0 ;
+    ny = y0 ;
+    if (e2 > -dy){
+      err -= dy ;
+      nx += sx ;
+    }
+    if (e2 < dx){
+      err += dx ;
+      ny += sy ;
+    }
+
+    // Send the span when the line moves to another row
+    if (ny != y0){
+      if (start < x0) pfn(pContext, start, x0, y0) ;
+      else pfn(pContext, x0, start, y0) ;
+      start = nx ;
+    }
+    x0 = nx ;
+    y0 = ny ;
+  }
+
+  if (start < x0) pfn(pContext, start, x0, y0) ;
+  else pfn(pContext, x0, start, y0) ;
+}
+
+void Raster::circle(int cx, int cy, unsigned int radius, bool bFill, SpanFn pfn, void *pContext)
+{
+  int r = (int)radius, x = r, next = r, a = 0 ;
+  int limit = (r * r) + r ; // rounds the edge to half a pixel outside the radius
+
+  // x is the half width of each row from the middle out. Each quadrant
+  // is mirrored without repeating the middle row or column
+  for (int y=0; y <= r; y++){
+    while ((x * x) + (y * y) > limit) x-- ;
+
+    if (bFill){
+      pfn(pContext, cx - x, cx + x, cy + y) ;
+      if (y > 0) pfn(pContext, cx - x, cx + x, cy - y) ;
+      continue ;
+    }
+
+    // The outline on this row runs from the half width of the next row
+    // out to this one
+    next = x ;
+    if (y < r){
+      while ((next * next) + ((y + 1) * (y + 1)) > limit) next-- ;
+      a = next + 1 > x?x:next + 1 ;
+    }else{
+      a = 0 ;
+    }
+
+    pfn(pContext, cx + a, cx + x, cy + y) ;
+    if (y > 0) pfn(pContext, cx + a, cx + x, cy - y) ;
+    if (x > 0){
+      // Left half without the middle column
+      if (a == 0) a = 1 ;
+      pfn(pContext, cx - x, cx - a, cy + y) ;
+      if (y > 0) pfn(pContext, cx - x, cx - a, cy - y) ;
+    }
+  }
+}
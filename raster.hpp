@@ -0,0 +1,27 @@
+#ifndef __RASTER_HPP
+#define __RASTER_HPP
+
+///////////////////////////////////////////////////
+//
+// Lines and circles broken into horizontal spans for
+// the drivers to fill in their own buffer formats.
+// Every pixel of a shape is in exactly one span, so
+// exclusive drawing never inverts a pixel twice.
+// Spans are not clipped
+//
+///////////////////////////////////////////////////
+
+class Raster{
+public:
+  // Called for pixels x0 to x1 inclusive on row y
+  typedef void (*SpanFn)(void *pContext, int x0, int x1, int y) ;
+
+  // Bresenham line including both end points. Pixels on the same
+  // row are joined into one span
+  static void line(int x0, int y0, int x1, int y1, SpanFn pfn, void *pContext) ;
+
+  // Circle outline or filled circle. Radius 0 is a single pixel
+  static void circle(int cx, int cy, unsigned int radius, bool bFill, SpanFn pfn, void *pContext) ;
+};
+
+#endif // __RASTER_HPP
@@ -1,4 +1,7 @@
 #include "sdd1306oled.hpp"
+#include "colourconvert.hpp"
+#include "blit.hpp"
+#include "raster.hpp"
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -14,11 +17,34 @@ SDD1306OLED::SDD1306OLED()
   m_width = 64 ;
   m_height = 48 ;
   m_pDisplay = 0 ;
+  m_pScaled = NULL ;
+  m_nScaledSize = 0 ;
+  m_pCache = NULL ;
+  m_bYTop = false ;
+  m_nRotation = 0 ;
+  m_nContrast = 0xCF ;
+  m_bInverse = false ;
+  m_bDisplayOn = false ;
+  m_effect.setApply(applyEffect, this) ;
+  m_eSequence = sequenceInitialise ;
+  m_nStep = 0 ;
+  m_bSequence = false ;
+  m_clip.x0 = m_clip.y0 = 0 ;
+  m_clip.x1 = m_width - 1 ;
+  m_clip.y1 = m_height - 1 ;
+  for (int p=0; p < SDD1306_MAX_PAGES; p++){
+    m_dirtyCol0[p] = 1 ;
+    m_dirtyCol1[p] = 0 ;
+  }
+  m_bRAMValid = false ;
 }
 
 SDD1306OLED::~SDD1306OLED()
 {
+  // The present thread uses the buffers
+  stopPresenter() ;
   if (m_pDisplay) delete[] m_pDisplay ;
+  if (m_pScaled) delete[] m_pScaled ;
 }
 
 void SDD1306OLED::setGPIO(IHardwareGPIO &gpio)
@@ -44,6 +70,10 @@ bool SDD1306OLED::setup(unsigned int width, unsigned int height, unsigned int dc
     fprintf(stderr, "Height needs to be a multiple of 8 to fit into a memory page\n") ;
     return false ;
   }
+  if (height > SDD1306_MAX_PAGES * 8){
+    fprintf(stderr, "Height is more than the SDD has pages for\n") ;
+    return false ;
+  }
 
   // Note that there's no stride calculation as this code
   // assumes that the display height is exact multiple of 8 to fit a byte fully.
@@ -55,6 +85,9 @@ bool SDD1306OLED::setup(unsigned int width, unsigned int height, unsigned int dc
 
   m_pGPIO->setup(m_dcpin, IHardwareGPIO::gpio_output) ;
   m_pGPIO->setup(m_resetpin, IHardwareGPIO::gpio_output) ;
+
+  clearClip() ;
+  m_bRAMValid = false ;
   
   return true ;
 }
@@ -86,26 +119,89 @@ bool SDD1306OLED::writeData(uint8_t byte)
 
 bool SDD1306OLED::turnOff()
 {
-  if (!writeCmd(0xAE)) return false ;
-  m_pTime->milliSleep(100) ;
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
-
-  return true ;
+  return runSequence(sequenceTurnOff) ;
 }
 
 bool SDD1306OLED::turnOn()
 {
-  // Setting low first may be unnecessary when already turned off using the 
-  // other method in this object. This is a power on enable. 
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
-  m_pTime->microSleep(100) ; // recommended 3us
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::high) ;
+  return runSequence(sequenceTurnOn) ;
+}
+
+bool SDD1306OLED::runSequence(enSequence eSequence)
+{
+  int delay = 0 ;
+
+  if (!startSequence(eSequence)) return false ;
+  while ((delay = stepSequence()) > 0) m_pTime->milliSleep(delay) ;
+
+  return delay == 0 ;
+}
+
+bool SDD1306OLED::startSequence(enSequence eSequence)
+{
+  if (!verify()) return false ;
 
-  if (!writeCmd(0xAF)) return false ;
+  m_eSequence = eSequence ;
+  m_nStep = 0 ;
+  m_bSequence = true ;
 
   return true ;
 }
 
+int SDD1306OLED::stepSequence()
+{
+  int delay = -1 ;
+
+  if (!m_bSequence) return 0 ;
+
+  switch (m_eSequence){
+  case sequenceInitialise: delay = stepInitialise(m_nStep) ; break ;
+  case sequenceTurnOn: delay = stepTurnOn(m_nStep) ; break ;
+  case sequenceTurnOff: delay = stepTurnOff(m_nStep) ; break ;
+  }
+  m_nStep++ ;
+
+  if (delay <= 0) m_bSequence = false ;
+
+  return delay ;
+}
+
+int SDD1306OLED::stepTurnOff(int step)
+{
+  switch (step){
+  case 0:
+    if (!writeCmd(0xAE)) return -1 ;
+    return 100 ;
+
+  case 1:
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
+    m_bDisplayOn = false ;
+    return 0 ;
+  }
+
+  return -1 ;
+}
+
+int SDD1306OLED::stepTurnOn(int step)
+{
+  switch (step){
+  case 0:
+    // Setting low first may be unnecessary when already turned off using the 
+    // other method in this object. This is a power on enable. 
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
+    return 1 ; // recommended 3us
+
+  case 1:
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::high) ;
+
+    if (!writeCmd(0xAF)) return -1 ;
+    m_bDisplayOn = true ;
+    return 0 ;
+  }
+
+  return -1 ;
+}
+
 bool SDD1306OLED::setColumnAddress(uint16_t address)
 {
   if (!verify()) return false ;
@@ -118,97 +214,231 @@ bool SDD1306OLED::setColumnAddress(uint16_t address)
 
 bool SDD1306OLED::initialise()
 {
-  if (!verify()) return false ;
+  return runSequence(sequenceInitialise) ;
+}
 
-  // Set initial state for pins
-  m_pGPIO->output(m_dcpin, IHardwareGPIO::high) ;
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
-  m_pTime->milliSleep(100) ;
+int SDD1306OLED::stepInitialise(int step)
+{
+  switch (step){
+  case 0:
+    // Set initial state for pins
+    m_pGPIO->output(m_dcpin, IHardwareGPIO::high) ;
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
+    return 100 ;
+
+  case 1:
+    // Initialisation sequence and defaults copied from SparkFuns 
+    // Arduino code. Only part of the chip graphic memory is in use with this
+    // smaller display. Implementations can vary and you cannot assume a 64x48 is mapped
+    // the same as another manufacturers 64x48. 
 
+    // Enable the reset pin (disable reset essentially)
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::high) ;
+    return 5 ; // Sleep for 5ms
 
-  // Initialisation sequence and defaults copied from SparkFuns 
-  // Arduino code. Only part of the chip graphic memory is in use with this
-  // smaller display. Implementations can vary and you cannot assume a 64x48 is mapped
-  // the same as another manufacturers 64x48. 
+  case 2:
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
+    return 10 ; // Sleep for 10ms 
 
-  // Enable the reset pin (disable reset essentially)
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::high) ;
-  m_pTime->milliSleep(5) ; // Sleep for 5ms
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::low) ;
-  m_pTime->milliSleep(10) ; // Sleep for 10ms 
-  m_pGPIO->output(m_resetpin, IHardwareGPIO::high) ;
+  case 3:
+    m_pGPIO->output(m_resetpin, IHardwareGPIO::high) ;
 
-  // Send display off command
-  writeCmd(0xAE) ;
+    // Send display off command
+    writeCmd(0xAE) ;
 
-  // Set display clock div
-  writeCmd(0xD5) ;
-  writeCmd(0x80) ; // 1000 0000 seems to suggest no divide ratio and default frequency
+    // Set display clock div
+    writeCmd(0xD5) ;
+    writeCmd(0x80) ; // 1000 0000 seems to suggest no divide ratio and default frequency
 
-  // Set multiplex
-  writeCmd(0xA8) ;
-  writeCmd(0x2F) ; // Works for the SparkFun 64x48 board
+    // Set multiplex
+    writeCmd(0xA8) ;
+    writeCmd(0x2F) ; // Works for the SparkFun 64x48 board
 
-  // Set display offset
-  writeCmd(0xD3) ; 
-  writeCmd(0x00) ; // Zero offset
+    // Set display offset
+    writeCmd(0xD3) ; 
+    writeCmd(0x00) ; // Zero offset
 
-  // Set startline offset
-  writeCmd(0x40 | 0x00) ; // Zero offset
+    // Set startline offset
+    writeCmd(0x40 | 0x00) ; // Zero offset
 
-  // Charge pump
-  writeCmd(0x8D) ;
-  writeCmd(0x14) ; // Enable pump
+    // Charge pump
+    writeCmd(0x8D) ;
+    writeCmd(0x14) ; // Enable pump
 
-  // Normal display
-  writeCmd(0xA6) ;
+    // Normal display
+    writeCmd(0xA6) ;
+    m_bInverse = false ;
   
-  // Display all on resume
-  writeCmd(0xA4) ;
+    // Display all on resume
+    writeCmd(0xA4) ;
 
-  // Define memory mode
-  writeCmd(0x20) ;
-  writeCmd(0x10) ; // Page address mode (0x00 for horizontal, 0x01 for vertical)
+    // Define memory mode
+    writeCmd(0x20) ;
+    writeCmd(0x10) ; // Page address mode (0x00 for horizontal, 0x01 for vertical)
 
-  // SEG remapping
-  writeCmd(0xA0 | 0x01) ; // Map SEG so rows are left to right from display ribbon
+    // SEG remapping and COM scan mapping (ascending or descending)
+    // for the current rotation
+    sendRemap() ;
 
-  // COM scan mapping (ascending or descending)
-  writeCmd(0xC0) ; // Ascending from display ribbon connector
+    // Set com pin mapping
+    writeCmd(0xDA) ;
+    writeCmd(0x12) ; // Sequential mapping with left to right remap
+
+    // Set contrast
+    writeCmd(0x81) ;
+    writeCmd(0xCF) ; // Need to be aware of current draw when setting. 0x00 to 0xFF are valid.
+    m_nContrast = 0xCF ;
+
+    // Set precharge
+    writeCmd(0xD9) ;
+    writeCmd(0xF1) ; // Phase 1: 1 dclk (max 15), Phase 2: 15 dclks (max 15)
+
+    // Set com deselect
+    writeCmd(0xDB) ;
+    writeCmd(0x40) ; // above 0.83 x Vcc for regulator output.
+
+    // Display On
+    writeCmd(0xAF) ;
+    m_bDisplayOn = true ;
 
-  // Set com pin mapping
-  writeCmd(0xDA) ;
-  writeCmd(0x12) ; // Sequential mapping with left to right remap
+    // OLED RAM is undefined after reset
+    m_bRAMValid = false ;
+    return 100 ; // Sleep
+
+  case 4:
+    return 0 ;
+  }
+
+  return -1 ;
+}
+
+bool SDD1306OLED::setContrast(int contrast)
+{
+  if (!verify()) return false ;
+
+  if (contrast < 0) contrast = 0 ;
+  if (contrast > 0xFF) contrast = 0xFF ;
 
   // Set contrast
   writeCmd(0x81) ;
-  writeCmd(0xCF) ; // Need to be aware of current draw when setting. 0x00 to 0xFF are valid.
+  if (!writeCmd(contrast)) return false ;
+
+  m_nContrast = contrast ;
+  return true ;
+}
+
+bool SDD1306OLED::setInverse(bool bInverse)
+{
+  if (!verify()) return false ;
+
+  // Inverse (0xA7) or normal (0xA6) display
+  if (!writeCmd(bInverse?0xA7:0xA6)) return false ;
+
+  m_bInverse = bInverse ;
+  return true ;
+}
 
-  // Set precharge
-  writeCmd(0xD9) ;
-  writeCmd(0xF1) ; // Phase 1: 1 dclk (max 15), Phase 2: 15 dclks (max 15)
+bool SDD1306OLED::setDisplayOn(bool bOn)
+{
+  if (!verify()) return false ;
 
-  // Set com deselect
-  writeCmd(0xDB) ;
-  writeCmd(0x40) ; // above 0.83 x Vcc for regulator output.
+  // Display on (0xAF) or off (0xAE). GDDRAM is kept
+  if (!writeCmd(bOn?0xAF:0xAE)) return false ;
 
-  // Display On
-  writeCmd(0xAF) ;
+  m_bDisplayOn = bOn ;
+  return true ;
+}
 
-  m_pTime->milliSleep(100) ; // Sleep
+bool SDD1306OLED::fadeContrast(int to, unsigned int duration)
+{
+  if (!verify()) return false ;
 
+  m_effect.startFade(m_nContrast, to, duration) ;
   return true ;
 }
 
+bool SDD1306OLED::blink(unsigned int count, unsigned int period)
+{
+  if (!verify()) return false ;
+
+  m_effect.startBlink(count, period) ;
+  return true ;
+}
+
+bool SDD1306OLED::flash(unsigned int count, unsigned int period)
+{
+  if (!verify()) return false ;
+
+  m_effect.startFlash(count, period) ;
+  return true ;
+}
+
+bool SDD1306OLED::stepEffect(unsigned int elapsed)
+{
+  return m_effect.step(elapsed) ;
+}
+
+void SDD1306OLED::stopEffect()
+{
+  m_effect.stop() ;
+}
+
+void SDD1306OLED::applyEffect(void *pContext, DisplayEffect &effect, DisplayEffect::enEffect eEffect)
+{
+  SDD1306OLED *pOLED = (SDD1306OLED *)pContext ;
+
+  // Only the register used by the effect is changed and only
+  // when the value is different to the panel
+  switch(eEffect){
+  case DisplayEffect::fade:
+    if (effect.getContrast() != pOLED->m_nContrast) pOLED->setContrast(effect.getContrast()) ;
+    break ;
+  case DisplayEffect::blink:
+    if (effect.isOn() != pOLED->m_bDisplayOn) pOLED->setDisplayOn(effect.isOn()) ;
+    break ;
+  case DisplayEffect::flash:
+    if (effect.isInverted() != pOLED->m_bInverse) pOLED->setInverse(effect.isInverted()) ;
+    break ;
+  default:
+    break ;
+  }
+}
+
+bool SDD1306OLED::sendRemap()
+{
+  // 180 and 270 degrees flip both axes in hardware. 270 is then
+  // transposed the same way as 90 in writeImage
+  bool bFlip = m_nRotation >= 180 ;
+
+  // SEG remapping
+  if (bFlip) writeCmd(0xA0) ; // Map SEG so rows are right to left from display ribbon
+  else writeCmd(0xA0 | 0x01) ; // Map SEG so rows are left to right from display ribbon
+
+  // COM scan mapping (ascending or descending)
+  if (m_bYTop != bFlip) return writeCmd(0xC8) ; // Descending COM ordering
+  return writeCmd(0xC0) ; // Ascending from display ribbon connector
+}
+
 bool SDD1306OLED::setYOrigin(bool bTop)
 {
   if (!verify()) return false ;
   
-  // COM scan mapping (ascending or descending)
-  if (bTop) writeCmd(0xC8) ; // Descending COM ordering
-  else writeCmd(0xC0) ; // Ascending from display ribbon connector
+  m_bYTop = bTop ;
+  return sendRemap() ;
+}
 
-  return true ;
+bool SDD1306OLED::setRotation(unsigned int degrees)
+{
+  if (!verify()) return false ;
+
+  if (degrees % 90 || degrees > 270){
+    fprintf(stderr, "setRotation: only 0, 90, 180 and 270 are supported\n") ;
+    return false ;
+  }
+
+  m_nRotation = degrees ;
+  clearClip() ; // width and height may have swapped
+  return sendRemap() ;
 }
 
 bool SDD1306OLED::showAllPixels()
@@ -225,56 +455,629 @@ bool SDD1306OLED::showAllPixels()
     }
   }
 
+  // The next display() sends everything
+  m_bRAMValid = false ;
+
   return true ;
 }
 
+bool SDD1306OLED::clearImage()
+{
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "clearImage: display not setup\n") ;
+    return false ;
+  }
+
+  fillRegion(m_clip, fillClear) ;
+  markDirty(m_clip.x0, m_clip.y0, m_clip.x1, m_clip.y1) ;
+
+  return true ;
+}
+
+bool SDD1306OLED::setClip(int x, int y, unsigned int width, unsigned int height)
+{
+  Region rc ;
+
+  rc.x0 = x < 0?0:x ;
+  rc.y0 = y < 0?0:y ;
+  rc.x1 = x + (int)width - 1 ;
+  rc.y1 = y + (int)height - 1 ;
+  if (rc.x1 >= (int)getWidth()) rc.x1 = getWidth() - 1 ;
+  if (rc.y1 >= (int)getHeight()) rc.y1 = getHeight() - 1 ;
+
+  if (width == 0 || height == 0 || rc.x0 > rc.x1 || rc.y0 > rc.y1){
+    fprintf(stderr, "setClip: region is outside of the display\n") ;
+    return false ;
+  }
+
+  m_clip = rc ;
+  return true ;
+}
+
+void SDD1306OLED::clearClip()
+{
+  m_clip.x0 = 0 ;
+  m_clip.y0 = 0 ;
+  m_clip.x1 = getWidth() - 1 ;
+  m_clip.y1 = getHeight() - 1 ;
+}
+
+SDD1306OLED::Region SDD1306OLED::toPanel(const Region &rc)
+{
+  Region panel = rc ;
+
+  // Rotated displays map rows to columns as in writeImage
+  if (m_nRotation % 180){
+    panel.x0 = m_width - 1 - rc.y1 ;
+    panel.x1 = m_width - 1 - rc.y0 ;
+    panel.y0 = rc.x0 ;
+    panel.y1 = rc.x1 ;
+  }
+
+  return panel ;
+}
+
+void SDD1306OLED::fillRegion(const Region &rc, enFill eFill)
+{
+  Region panel = toPanel(rc) ;
+  int cols = panel.x1 - panel.x0 + 1 ;
+  uint8_t mask = 0, *pPage = NULL ;
+
+  // Whole pages are set in one go and the end pages are masked
+  for (int page=panel.y0 / 8; page <= panel.y1 / 8; page++){
+    mask = 0xFF ;
+    if (page == panel.y0 / 8) mask &= (uint8_t)(0xFF << (panel.y0 % 8)) ;
+    if (page == panel.y1 / 8) mask &= (uint8_t)(0xFF >> (7 - (panel.y1 % 8))) ;
+
+    pPage = m_pDisplay + panel.x0 + (page * m_width) ;
+    if (eFill == fillInvert){
+      for (int i=0; i < cols; i++) pPage[i] ^= mask ;
+    }else if (mask == 0xFF){
+      memset(pPage, eFill == fillSet?0xFF:0x00, cols) ;
+    }else if (eFill == fillSet){
+      for (int i=0; i < cols; i++) pPage[i] |= mask ;
+    }else{
+      for (int i=0; i < cols; i++) pPage[i] &= ~mask ;
+    }
+  }
+}
+
+void SDD1306OLED::markDirty(int x0, int y0, int x1, int y1)
+{
+  Region rc ;
+
+  if (x0 < 0) x0 = 0 ;
+  if (y0 < 0) y0 = 0 ;
+  if (x1 >= (int)getWidth()) x1 = getWidth() - 1 ;
+  if (y1 >= (int)getHeight()) y1 = getHeight() - 1 ;
+  if (x0 > x1 || y0 > y1) return ; // nothing on the display
+
+  rc.x0 = x0 ; rc.y0 = y0 ; rc.x1 = x1 ; rc.y1 = y1 ;
+  rc = toPanel(rc) ;
+
+  // Each page is sent as one run of columns
+  for (int p=rc.y0 / 8; p <= rc.y1 / 8; p++){
+    if (m_dirtyCol0[p] > m_dirtyCol1[p]){
+      m_dirtyCol0[p] = rc.x0 ;
+      m_dirtyCol1[p] = rc.x1 ;
+      continue ;
+    }
+    if (rc.x0 < m_dirtyCol0[p]) m_dirtyCol0[p] = rc.x0 ;
+    if (rc.x1 > m_dirtyCol1[p]) m_dirtyCol1[p] = rc.x1 ;
+  }
+}
+
+void SDD1306OLED::markClipped(int x0, int y0, int x1, int y1)
+{
+  markDirty(x0 < m_clip.x0?m_clip.x0:x0, y0 < m_clip.y0?m_clip.y0:y0,
+	    x1 > m_clip.x1?m_clip.x1:x1, y1 > m_clip.y1?m_clip.y1:y1) ;
+}
+
+void SDD1306OLED::markAllDirty()
+{
+  for (unsigned int p=0; p < m_height / 8; p++){
+    m_dirtyCol0[p] = 0 ;
+    m_dirtyCol1[p] = m_width - 1 ;
+  }
+}
+
+
+template <bool TRANSPOSE, enum IDisplay::enMode MODE>
+void SDD1306OLED::blitRows(DisplayImage &img, int xoffset, int yoffset, int x0, int y0, int x1, int y1)
+{
+  const uint8_t *pSrc = NULL ;
+
+  for (int cy=y0; cy < y1; cy++){
+    pSrc = img.m_img + ((cy - yoffset) * img.m_stride) ;
+    if (TRANSPOSE){
+      // Rotated displays map rows to columns. The hardware
+      // remapping has already flipped 270 to 90
+      Blit::spanToColumn<MODE>(pSrc, x0 - xoffset, m_pDisplay + (m_width - 1 - cy), x0, x1 - x0, m_width) ;
+    }else{
+      Blit::spanToPage<MODE>(pSrc, x0 - xoffset, m_pDisplay + x0 + ((cy / 8) * m_width), x1 - x0, 1 << (cy % 8)) ;
+    }
+  }
+}
 
 bool SDD1306OLED::writeImage(DisplayImage &img, enum enMode eMode, int xoffset, int yoffset)
 {
-  uint8_t val = 0;
-  int imgx=0, imgy =0;
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0 ;
+  bool bTranspose = m_nRotation % 180 != 0 ;
+
   if (!verify()) return false ;
 
+  if (img.m_colourbitdepth != 1){
+    fprintf(stderr, "writeImage: only 1 bit images are supported, use writeScaled\n") ;
+    return false ;
+  }
+
   if (!m_pDisplay){
     fprintf(stderr, "writeImage: display not setup\n") ;
     return false ;
   }
 
-  // iterate throught the display buffer not the image buffer being written.
-  // This should auto clip any parts of the image outside of the buffer region
-  for (int cy=0; cy < (int)m_height; cy++){
-    for (int cx=0; cx < (int)m_width; cx++){
-      imgx = cx - xoffset ;
-      imgy = cy - yoffset ;
-      if (imgx < 0 || imgx >= (int)img.m_width || imgy < 0 || imgy >= (int)img.m_height){
-	val = 0; // outside of image
+  // Overwrite clears the clip region and then sets the image pixels as
+  // overlay does
+  if (eMode == overwrite){
+    fillRegion(m_clip, fillClear) ;
+    markDirty(m_clip.x0, m_clip.y0, m_clip.x1, m_clip.y1) ;
+    eMode = overlay ;
+  }
+
+  // Clip the image to the clip region. x1 and y1 are exclusive
+  x0 = xoffset < m_clip.x0?m_clip.x0:xoffset ;
+  y0 = yoffset < m_clip.y0?m_clip.y0:yoffset ;
+  x1 = xoffset + (int)img.m_width ;
+  y1 = yoffset + (int)img.m_height ;
+  if (x1 > m_clip.x1 + 1) x1 = m_clip.x1 + 1 ;
+  if (y1 > m_clip.y1 + 1) y1 = m_clip.y1 + 1 ;
+  if (x0 >= x1 || y0 >= y1) return true ; // nothing on the display
+
+  // Pick the span loop once for the whole image
+  if (eMode == exclusive){
+    if (bTranspose) blitRows<true, exclusive>(img, xoffset, yoffset, x0, y0, x1, y1) ;
+    else blitRows<false, exclusive>(img, xoffset, yoffset, x0, y0, x1, y1) ;
+  }else{
+    if (bTranspose) blitRows<true, overlay>(img, xoffset, yoffset, x0, y0, x1, y1) ;
+    else blitRows<false, overlay>(img, xoffset, yoffset, x0, y0, x1, y1) ;
+  }
+  markDirty(x0, y0, x1 - 1, y1 - 1) ;
+
+  return true ;
+}
+
+template <bool TRANSPOSE, enum IDisplay::enMode MODE>
+int SDD1306OLED::textRun(GlyphCache &glyphs, const char *szText, int x, int y)
+{
+  int c0 = 0, c1 = 0, r0 = 0, r1 = 0 ;
+  uint32_t bits = 0 ;
+
+  // Rows of the glyphs inside the clip region
+  r0 = y < m_clip.y0?m_clip.y0 - y:0 ;
+  r1 = y + (int)glyphs.m_height - 1 > m_clip.y1?m_clip.y1 - y:glyphs.m_height - 1 ;
+  if (r0 > r1) return x ;
+
+  for (; *szText && x <= m_clip.x1; szText++){
+    const GlyphCache::Glyph &g = glyphs.glyph(*szText) ;
+
+    c0 = x < m_clip.x0?m_clip.x0 - x:0 ;
+    c1 = x + (int)g.width - 1 > m_clip.x1?m_clip.x1 - x:g.width - 1 ;
+
+    if (TRANSPOSE){
+      // Glyph rows run down the OLED columns as in blitRows
+      for (int r=r0; r <= r1 && c0 <= c1; r++){
+	bits = g.rows[r][0] | (g.rows[r][1] << 8) | (g.rows[r][2] << 16) | ((uint32_t)g.rows[r][3] << 24) ;
+	Blit::bitsToColumn<MODE>(bits >> c0, m_pDisplay + (m_width - 1 - (y + r)), x + c0, c1 - c0 + 1, m_width) ;
+      }
+    }else{
+      for (int c=c0; c <= c1; c++){
+	Blit::bitsToColumn<MODE>(g.columns[c] >> r0, m_pDisplay + x + c, y + r0, r1 - r0 + 1, m_width) ;
+      }
+    }
+    x += g.width ;
+  }
+
+  return x ;
+}
+
+bool SDD1306OLED::writeText(GlyphCache &glyphs, const char *szText, enum enMode eMode, int xoffset, int yoffset)
+{
+  int x = xoffset ;
+  bool bTranspose = m_nRotation % 180 != 0 ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "writeText: display not setup\n") ;
+    return false ;
+  }
+
+  if (!glyphs.isLoaded()){
+    fprintf(stderr, "writeText: no glyphs loaded\n") ;
+    return false ;
+  }
+
+  // Pick the glyph loop once for the whole string
+  switch (eMode){
+  case overwrite:
+    x = bTranspose?textRun<true, overwrite>(glyphs, szText, x, yoffset):textRun<false, overwrite>(glyphs, szText, x, yoffset) ;
+    break ;
+  case overlay:
+    x = bTranspose?textRun<true, overlay>(glyphs, szText, x, yoffset):textRun<false, overlay>(glyphs, szText, x, yoffset) ;
+    break ;
+  case exclusive:
+    x = bTranspose?textRun<true, exclusive>(glyphs, szText, x, yoffset):textRun<false, exclusive>(glyphs, szText, x, yoffset) ;
+    break ;
+  }
+
+  markClipped(xoffset, yoffset, x - 1, yoffset + (int)glyphs.m_height - 1) ;
+
+  return true ;
+}
+
+void SDD1306OLED::fillClipped(int x0, int y0, int x1, int y1, enFill eFill)
+{
+  Region rc ;
+
+  rc.x0 = x0 < m_clip.x0?m_clip.x0:x0 ;
+  rc.y0 = y0 < m_clip.y0?m_clip.y0:y0 ;
+  rc.x1 = x1 > m_clip.x1?m_clip.x1:x1 ;
+  rc.y1 = y1 > m_clip.y1?m_clip.y1:y1 ;
+  if (rc.x0 > rc.x1 || rc.y0 > rc.y1) return ;
+
+  fillRegion(rc, eFill) ;
+}
+
+void SDD1306OLED::rasterSpan(void *pContext, int x0, int x1, int y)
+{
+  SpanContext *pSpan = (SpanContext *)pContext ;
+  pSpan->pOLED->fillClipped(x0, y, x1, y, pSpan->eFill) ;
+}
+
+bool SDD1306OLED::drawHLine(int x, int y, unsigned int width, enum enMode eMode)
+{
+  return drawRect(x, y, width, 1, true, eMode) ;
+}
+
+bool SDD1306OLED::drawVLine(int x, int y, unsigned int height, enum enMode eMode)
+{
+  return drawRect(x, y, 1, height, true, eMode) ;
+}
+
+bool SDD1306OLED::drawRect(int x, int y, unsigned int width, unsigned int height, bool bFill, enum enMode eMode)
+{
+  enFill eFill = eMode == exclusive?fillInvert:fillSet ;
+  int x1 = x + (int)width - 1, y1 = y + (int)height - 1 ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "drawRect: display not setup\n") ;
+    return false ;
+  }
+
+  if (width == 0 || height == 0) return true ;
+
+  // Outline sides don't overlap so exclusive inverts each pixel once
+  if (bFill || width <= 2 || height <= 2){
+    fillClipped(x, y, x1, y1, eFill) ;
+  }else{
+    fillClipped(x, y, x1, y, eFill) ;
+    fillClipped(x, y1, x1, y1, eFill) ;
+    fillClipped(x, y + 1, x, y1 - 1, eFill) ;
+    fillClipped(x1, y + 1, x1, y1 - 1, eFill) ;
+  }
+  markClipped(x, y, x1, y1) ;
+
+  return true ;
+}
+
+bool SDD1306OLED::drawLine(int x0, int y0, int x1, int y1, enum enMode eMode)
+{
+  SpanContext span ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "drawLine: display not setup\n") ;
+    return false ;
+  }
+
+  span.pOLED = this ;
+  span.eFill = eMode == exclusive?fillInvert:fillSet ;
+  Raster::line(x0, y0, x1, y1, rasterSpan, &span) ;
+  markClipped(x0 < x1?x0:x1, y0 < y1?y0:y1, x0 < x1?x1:x0, y0 < y1?y1:y0) ;
+
+  return true ;
+}
+
+bool SDD1306OLED::drawCircle(int cx, int cy, unsigned int radius, bool bFill, enum enMode eMode)
+{
+  SpanContext span ;
+  int r = (int)radius ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "drawCircle: display not setup\n") ;
+    return false ;
+  }
+
+  span.pOLED = this ;
+  span.eFill = eMode == exclusive?fillInvert:fillSet ;
+  Raster::circle(cx, cy, radius, bFill, rasterSpan, &span) ;
+  markClipped(cx - r, cy - r, cx + r, cy + r) ;
+
+  return true ;
+}
+
+bool SDD1306OLED::writeScaled(DisplayImage &img, ImageScale::enFilter eFilter, int xoffset, int yoffset,
+			      unsigned int width, unsigned int height)
+{
+  ImageScale scale ;
+  uint8_t *pRow = NULL ;
+  const uint8_t *p = NULL ;
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0, px = 0, py = 0, level = 0 ;
+  bool bTranspose = m_nRotation % 180 != 0 ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "writeScaled: display not setup\n") ;
+    return false ;
+  }
+
+  if (!scale.setSource(img.m_img, img.m_width, img.m_height, img.m_stride, img.m_colourbitdepth) ||
+      !scale.setTarget(width, height, eFilter)){
+    fprintf(stderr, "writeScaled: cannot scale image\n") ;
+    return false ;
+  }
+
+  // Clip to the clip region. x1 and y1 are exclusive
+  x0 = xoffset < m_clip.x0?m_clip.x0:xoffset ;
+  y0 = yoffset < m_clip.y0?m_clip.y0:yoffset ;
+  x1 = xoffset + (int)width ;
+  y1 = yoffset + (int)height ;
+  if (x1 > m_clip.x1 + 1) x1 = m_clip.x1 + 1 ;
+  if (y1 > m_clip.y1 + 1) y1 = m_clip.y1 + 1 ;
+  if (x0 >= x1 || y0 >= y1) return true ; // nothing on the display
+  markDirty(x0, y0, x1 - 1, y1 - 1) ;
+
+  if (width * scale.getChannels() > m_nScaledSize){
+    if (m_pScaled) delete[] m_pScaled ;
+    m_nScaledSize = width * scale.getChannels() ;
+    m_pScaled = new uint8_t[m_nScaledSize] ;
+  }
+  pRow = m_pScaled ;
+  for (int cy=y0; cy < y1; cy++){
+    scale.scaleRow(cy - yoffset, pRow) ;
+    for (int cx=x0; cx < x1; cx++){
+      p = pRow + ((cx - xoffset) * scale.getChannels()) ;
+      if (scale.getChannels() == 4) level = ((p[0] * 77) + (p[1] * 150) + (p[2] * 29)) >> 8 ;
+      else level = p[0] ;
+
+      // Rotated displays map rows to columns as for writeImage
+      px = cx ;
+      py = cy ;
+      if (bTranspose){
+	px = m_width - 1 - cy ;
+	py = cx ;
       }
-      else{
-	// Image buffer is a bit array with bytes assigned along rows
-	val = img.m_img[imgx/8+(imgy*img.m_stride)] & (1 << (imgx % 8)) ;
+
+      // Thresholds run from 8 to 248 so full coverage is always on and none is off
+      if (level > (ColourConvert::s_bayer4[cy & 3][cx & 3] * 16) + 8){
+	m_pDisplay[px+ (py/8)*m_width] |= 1 << (py%8);
+      }else{
+	m_pDisplay[px+ (py/8)*m_width] &= ~(1 << (py%8));
       }
-      
-      // val is greater than zero is set or zero if unset pixel
-      if (val > 0){
-	if(eMode == exclusive){
-	  m_pDisplay[cx+ (cy/8)*m_width] ^= 1 << (cy%8);
-	}
-	else{
-	  // Display is a bit array. This combines pixels with ones already set on the display
-	  m_pDisplay[cx+ (cy/8)*m_width] |= 1 << (cy%8);
-	}
-      }else if (eMode == overwrite){
-	// If this is an overwrite of the display and not additive (overlayed) 
-	// then remove the pixel setting
-	m_pDisplay[cx+ (cy/8)*m_width] &= ~(1 << (cy%8));
+    }
+  }
+
+  return true ;
+}
+
+uint64_t SDD1306OLED::frameKey(DisplayImage &img, int xoffset, int yoffset)
+{
+  // Everything which changes the display buffer for an overwrite
+  int32_t params[8] = {(int32_t)m_width, (int32_t)m_height, (int32_t)m_nRotation, xoffset, yoffset,
+		       (int32_t)img.m_width, (int32_t)img.m_height, (int32_t)img.m_colourbitdepth} ;
+  uint64_t key = FrameCache::hash(params, sizeof(params)) ;
+
+  return FrameCache::hash(img.m_img, img.m_stride * img.m_height, key) ;
+}
+
+bool SDD1306OLED::displayImage(DisplayImage &img, int xoffset, int yoffset)
+{
+  uint32_t size = (m_width * m_height) / 8, len = 0 ;
+  uint64_t key = 0 ;
+  const uint8_t *pFrame = NULL ;
+  uint8_t *pEntry = NULL ;
+
+  if (!verify()) return false ;
+
+  // Cached frames are the whole display buffer so pixels outside
+  // of a clip region would be lost
+  if (!m_pCache || m_clip.x0 > 0 || m_clip.y0 > 0 ||
+      m_clip.x1 < (int)getWidth() - 1 || m_clip.y1 < (int)getHeight() - 1){
+    if (!writeImage(img, overwrite, xoffset, yoffset)) return false ;
+    return display() ;
+  }
+
+  // The display buffer is already in the page format sent to the SDD
+  key = frameKey(img, xoffset, yoffset) ;
+  pFrame = m_pCache->find(key, len) ;
+  if (pFrame && len == size){
+    memcpy(m_pDisplay, pFrame, size) ;
+    markAllDirty() ;
+    return display() ;
+  }
+
+  if (!writeImage(img, overwrite, xoffset, yoffset)) return false ;
+
+  pEntry = m_pCache->add(key, size) ;
+  if (pEntry) memcpy(pEntry, m_pDisplay, size) ;
+
+  return display() ;
+}
+
+uint32_t SDD1306OLED::encodeImage(DisplayImage &img, int xoffset, int yoffset, uint8_t *pBuffer, uint32_t len)
+{
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0, px = 0, py = 0 ;
+  int col0 = 0, col1 = 0, page0 = 0, page1 = 0, cols = 0, pages = 0 ;
+  int width = getWidth(), height = getHeight() ;
+  bool bTranspose = m_nRotation % 180 != 0 ;
+  uint32_t size = 0 ;
+  uint8_t *pData = NULL ;
+
+  if (!verify()) return 0 ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "encodeImage: display not setup\n") ;
+    return 0 ;
+  }
+
+  if (img.m_colourbitdepth != 1){
+    fprintf(stderr, "encodeImage: only 1 bit images are supported\n") ;
+    return 0 ;
+  }
+
+  // Image clipped to the display
+  x0 = xoffset < 0?0:xoffset ;
+  y0 = yoffset < 0?0:yoffset ;
+  x1 = xoffset + (int)img.m_width - 1 ;
+  y1 = yoffset + (int)img.m_height - 1 ;
+  if (x1 >= width) x1 = width - 1 ;
+  if (y1 >= height) y1 = height - 1 ;
+  if (x0 > x1 || y0 > y1) return 0 ; // nothing on the display
+
+  // Columns and pages covered, mapped as in writeImage
+  if (bTranspose){
+    col0 = m_width - 1 - y1 ;
+    col1 = m_width - 1 - y0 ;
+    page0 = x0 / 8 ;
+    page1 = x1 / 8 ;
+  }else{
+    col0 = x0 ;
+    col1 = x1 ;
+    page0 = y0 / 8 ;
+    page1 = y1 / 8 ;
+  }
+  cols = col1 - col0 + 1 ;
+  pages = page1 - page0 + 1 ;
+  size = SDD1306_ENCODED_HEADER + (cols * pages) ;
+
+  if (!pBuffer) return size ;
+  if (len < size){
+    fprintf(stderr, "encodeImage: buffer too small\n") ;
+    return 0 ;
+  }
+
+  pBuffer[0] = col0 ;
+  pBuffer[1] = cols ;
+  pBuffer[2] = page0 ;
+  pBuffer[3] = pages ;
+  pData = pBuffer + SDD1306_ENCODED_HEADER ;
+
+  // Start from the display buffer for the rows of partial pages
+  for (int p=0; p < pages; p++){
+    memcpy(pData + (p * cols), m_pDisplay + col0 + ((page0 + p) * m_width), cols) ;
+  }
+
+  for (int cy=y0; cy <= y1; cy++){
+    for (int cx=x0; cx <= x1; cx++){
+      px = cx ;
+      py = cy ;
+      if (bTranspose){
+	px = m_width - 1 - cy ;
+	py = cx ;
+      }
+      if (img.m_img[(cx - xoffset)/8 + ((cy - yoffset) * img.m_stride)] & (1 << ((cx - xoffset) % 8))){
+	pData[(px - col0) + ((py/8 - page0) * cols)] |= 1 << (py%8) ;
+      }else{
+	pData[(px - col0) + ((py/8 - page0) * cols)] &= ~(1 << (py%8)) ;
       }
     }
   }
 
+  return size ;
+}
+
+bool SDD1306OLED::writeEncoded(uint8_t *pBuffer, uint32_t len)
+{
+  int col0 = 0, cols = 0, page0 = 0, pages = 0 ;
+  uint8_t *pRun = NULL ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay || len < SDD1306_ENCODED_HEADER){
+    fprintf(stderr, "writeEncoded: nothing to write\n") ;
+    return false ;
+  }
+
+  col0 = pBuffer[0] ;
+  cols = pBuffer[1] ;
+  page0 = pBuffer[2] ;
+  pages = pBuffer[3] ;
+  if (len < (uint32_t)(SDD1306_ENCODED_HEADER + (cols * pages)) ||
+      col0 + cols > (int)m_width || (page0 + pages) * 8 > (int)m_height){
+    fprintf(stderr, "writeEncoded: buffer doesn't match the display\n") ;
+    return false ;
+  }
+
+  for (int p=0; p < pages; p++){
+    // Each page run is sent as a single transfer from the display buffer
+    pRun = m_pDisplay + col0 + ((page0 + p) * m_width) ;
+    memcpy(pRun, pBuffer + SDD1306_ENCODED_HEADER + (p * cols), cols) ;
+
+    setColumnAddress(col0) ;
+    writeCmd(0xB0 | (page0 + p)) ;
+    m_pGPIO->output(m_dcpin, IHardwareGPIO::high) ;
+    if (!m_pSPI->write(pRun, cols)) return false ;
+  }
+
   return true ;
 }
 
 bool SDD1306OLED::display()
+{
+  bool bRet = true ;
+
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "display: display not setup\n") ;
+    return false ;
+  }
+
+  if (!m_bRAMValid) bRet = sendPages(m_pDisplay) ;
+
+  for (unsigned int p=0; p < m_height / 8; p++){
+    if (bRet && m_bRAMValid && m_dirtyCol0[p] <= m_dirtyCol1[p]){
+      bRet = sendRun(m_pDisplay, p, m_dirtyCol0[p], m_dirtyCol1[p]) ;
+    }
+    m_dirtyCol0[p] = 1 ;
+    m_dirtyCol1[p] = 0 ;
+  }
+
+  // OLED RAM may be partly written on failure
+  m_bRAMValid = bRet ;
+
+  return bRet ;
+}
+
+bool SDD1306OLED::sendRun(const uint8_t *pPages, int page, int col0, int col1)
+{
+  // Sent as a single transfer as in writeEncoded
+  setColumnAddress(col0) ;
+  writeCmd(0xB0 | page) ;
+  m_pGPIO->output(m_dcpin, IHardwareGPIO::high) ;
+
+  return m_pSPI->write((uint8_t *)pPages + col0 + (page * m_width), col1 - col0 + 1) ;
+}
+
+bool SDD1306OLED::sendPages(const uint8_t *pPages)
 {
   uint8_t pages = m_height/8;
 
@@ -282,11 +1085,50 @@ bool SDD1306OLED::display()
     setColumnAddress(0) ; // Reset column
     writeCmd(0xB0 | p) ; // Set page
     for (unsigned int col=0; col < m_width; col++){
-      writeData(m_pDisplay[(p*m_width)+col]) ;
+      writeData(pPages[(p*m_width)+col]) ;
     }
   }
 
   return true ;
+}
+
+bool SDD1306OLED::startPresenter()
+{
+  if (!verify()) return false ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "startPresenter: display not setup\n") ;
+    return false ;
+  }
+
+  return m_presenter.start((m_width * m_height) / 8, sendPresented, this) ;
+}
+
+bool SDD1306OLED::present()
+{
+  if (!m_presenter.isRunning()){
+    fprintf(stderr, "present: call startPresenter first\n") ;
+    return false ;
+  }
+
+  memcpy(m_presenter.getBack(), m_pDisplay, m_presenter.getFrameSize()) ;
+  m_presenter.publish() ;
+
+  return true ;
+}
 
+void SDD1306OLED::stopPresenter()
+{
+  if (!m_presenter.isRunning()) return ;
+
+  m_presenter.stop() ;
+
+  // The OLED shows the last frame sent rather than the display buffer
+  markAllDirty() ;
+}
+
+bool SDD1306OLED::sendPresented(void *pContext, uint8_t *pFrame)
+{
+  return ((SDD1306OLED *)pContext)->sendPages(pFrame) ;
 }
 
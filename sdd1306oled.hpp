@@ -6,15 +6,26 @@
 
 #include "hardware.hpp"
 #include "displayimage.hpp"
+#include "displayeffect.hpp"
+#include "framecache.hpp"
+#include "imagescale.hpp"
+#include "idisplay.hpp"
+#include "framepresenter.hpp"
+#include "glyphcache.hpp"
 #include <stdint.h>
 
-class SDD1306OLED{
+// Encoded images start with the first column, column count,
+// first page and page count
+#define SDD1306_ENCODED_HEADER 4
+
+// Pages of 8 rows in the SDD RAM
+#define SDD1306_MAX_PAGES 8
+
+class SDD1306OLED : public IDisplay{
 public:
   SDD1306OLED() ;
   ~SDD1306OLED() ;
 
-  enum enMode{overwrite, overlay, exclusive} ;
-  
   // GPIO and SPI interfaces must be configured and set 
   // prior to the oled object using them. This means initialised
   // and opened. This object just drives an already configured interface
@@ -42,37 +53,229 @@ public:
   // Turn on the display.
   bool turnOn() ;
 
+  // Stepped versions of initialise, turnOn and turnOff
+  bool startSequence(enSequence eSequence) ;
+  int stepSequence() ;
+
   // Test function which writes directly to the OLED bypassing
   // the display buffer. Sets all pixels ON
   bool showAllPixels() ;
 
+  // Clear the display buffer to off pixels
+  bool clearImage() ;
+
+  // Limit clearImage, writeImage and writeScaled to a region of the
+  // display. Pixels outside of the region are left unchanged, including
+  // by overwrite. setRotation clears the clip region
+  bool setClip(int x, int y, unsigned int width, unsigned int height) ;
+  void clearClip() ;
+
   // Set where the 0 row origin is on the display
   // bottom is defined as where the connector ribbion is situated
   bool setYOrigin(bool bTop) ;
 
+  // Rotate the display by 0, 90, 180 or 270 degrees. 180 uses the segment
+  // and COM remapping so costs nothing. The SDD cannot exchange rows and
+  // columns so 90 and 270 transpose pixels in writeImage. Width and height
+  // swap for 90 and 270. Redraw the display buffer after changing
+  bool setRotation(unsigned int degrees) ;
+  unsigned int getRotation(){return m_nRotation;}
+
+  // Size of the display after rotation
+  unsigned int getWidth(){return m_nRotation % 180?m_height:m_width;}
+  unsigned int getHeight(){return m_nRotation % 180?m_width:m_height;}
+
+  // Panel registers. These don't change the display buffer.
+  // Contrast is 0 to 255
+  bool setContrast(int contrast) ;
+  int getContrast(){return m_nContrast;}
+  bool setInverse(bool bInverse) ;
+  bool setDisplayOn(bool bOn) ;
+
+  // Timed effects which only send register commands. Call stepEffect
+  // every frame with the elapsed milliseconds, such as the value from
+  // FramePacer::wait(). stepEffect returns true while an effect runs.
+  // Starting an effect replaces any running effect
+  bool fadeContrast(int to, unsigned int duration) ;
+  bool blink(unsigned int count, unsigned int period) ;
+  bool flash(unsigned int count, unsigned int period) ;
+  bool stepEffect(unsigned int elapsed) ;
+  void stopEffect() ;
+
   // Load an image object into the display buffer
   // The image can add extra pixels, overwrite or xor pixels already set.
+  // Images must be 1 bit, 32 bit images go through writeScaled.
   // Call display() to send image to OLED
   bool writeImage(DisplayImage &img, enum enMode eMode, int xoffset=0, int yoffset=0);
 
-  // Write display buffer to the OLED
+  // Draw text into the display buffer with the top left at xoffset,
+  // yoffset. Glyph columns are ORed, xored or replaced straight into the
+  // pages so no text image is made. Overwrite only replaces the glyph
+  // cells. Clipped to the clip region. Call display() to send to OLED
+  bool writeText(GlyphCache &glyphs, const char *szText, enum enMode eMode, int xoffset=0, int yoffset=0) ;
+
+  // Vector drawing straight into the display buffer. Shapes have no unset
+  // pixels so overwrite and overlay both set pixels and exclusive inverts
+  // them. Fills are masked byte operations on whole pages. Clipped to the
+  // clip region. Call display() to send to OLED
+  bool drawHLine(int x, int y, unsigned int width, enum enMode eMode = overlay) ;
+  bool drawVLine(int x, int y, unsigned int height, enum enMode eMode = overlay) ;
+  bool drawLine(int x0, int y0, int x1, int y1, enum enMode eMode = overlay) ;
+  bool drawRect(int x, int y, unsigned int width, unsigned int height, bool bFill = false, enum enMode eMode = overlay) ;
+  bool drawCircle(int cx, int cy, unsigned int radius, bool bFill = false, enum enMode eMode = overlay) ;
+
+  // Scale an image to width x height and overwrite the display buffer at
+  // xoffset, yoffset. 32 bit images use the brightness of each pixel.
+  // Filtered pixels are ordered dithered to on and off so grey levels and
+  // smoothed edges show as a pattern
+  bool writeScaled(DisplayImage &img, ImageScale::enFilter eFilter, int xoffset, int yoffset,
+		   unsigned int width, unsigned int height) ;
+
+  // Write display buffer to the OLED. Only the pages and columns changed
+  // since the last display() are sent once the OLED RAM is known
   bool display() ;
 
+  // Send frames from a background thread. present() copies the display
+  // buffer and returns at once, and the thread sends the newest copy.
+  // Frames drawn faster than they are sent are dropped. While it runs only
+  // draw into the display buffer. Leave the settings, registers, effects
+  // and display() until stopPresenter
+  bool startPresenter() ;
+  bool present() ;
+  void stopPresenter() ;
+  void getPresenterStats(FramePresenter::PresenterStats &stats){m_presenter.getStats(stats);}
+
+  // Encode an image at xoffset, yoffset as page and column runs ready to
+  // send with writeEncoded. Pixels in the same pages but outside of the
+  // image are taken from the display buffer. Returns the encoded size or
+  // 0 on error. Pass a NULL buffer to get the size required
+  uint32_t encodeImage(DisplayImage &img, int xoffset, int yoffset, uint8_t *pBuffer, uint32_t len) ;
+
+  // Send an encoded buffer to the OLED. The runs are also copied
+  // to the display buffer
+  bool writeEncoded(uint8_t *pBuffer, uint32_t len) ;
+
+  // Frames shown with displayImage are kept in the cache so showing an
+  // image again skips writeImage. The cache belongs to the caller.
+  // NULL stops caching
+  void setFrameCache(FrameCache *pCache){m_pCache = pCache;}
+
+  // Overwrite the display buffer with an image and display it. The same as
+  // writeImage with overwrite followed by display() but uses the frame cache
+  bool displayImage(DisplayImage &img, int xoffset=0, int yoffset=0) ;
+
 protected:
+  // Inclusive coordinates
+  struct Region{
+    int x0, y0, x1, y1 ;
+  };
+
   bool verify() ;
+
+  // Map a region of display coordinates to OLED columns and rows
+  Region toPanel(const Region &rc) ;
+
+  enum enFill{fillClear, fillSet, fillInvert} ;
+
+  // Set, clear or invert the pixels of a region in display coordinates
+  void fillRegion(const Region &rc, enFill eFill) ;
+
+  // Fill a region in display coordinates clipped to the clip region
+  void fillClipped(int x0, int y0, int x1, int y1, enFill eFill) ;
+
+  // Raster span callback. pContext is a SpanContext
+  struct SpanContext{
+    SDD1306OLED *pOLED ;
+    enFill eFill ;
+  };
+  static void rasterSpan(void *pContext, int x0, int x1, int y) ;
+
+  // Mark a region clipped to the clip region
+  void markClipped(int x0, int y0, int x1, int y1) ;
+
+  // Add a region in display coordinates to the area sent by display()
+  void markDirty(int x0, int y0, int x1, int y1) ;
+  void markAllDirty() ;
+
+  // Start a sequence and sleep through its delays
+  bool runSequence(enSequence eSequence) ;
+
+  // Steps of each sequence. Return as for stepSequence
+  int stepInitialise(int step) ;
+  int stepTurnOn(int step) ;
+  int stepTurnOff(int step) ;
+
+  // Write image rows y0 to y1 - 1 between columns x0 and x1 - 1 to the
+  // display buffer. Compiled for each orientation and mode so writeImage
+  // picks the span loop once
+  template <bool TRANSPOSE, enum enMode MODE>
+  void blitRows(DisplayImage &img, int xoffset, int yoffset, int x0, int y0, int x1, int y1) ;
+
+  // Write the glyphs of a string to the display buffer from x, y. Compiled
+  // for each orientation and mode as for blitRows. Returns the end x
+  template <bool TRANSPOSE, enum enMode MODE>
+  int textRun(GlyphCache &glyphs, const char *szText, int x, int y) ;
+
+  // Frame cache key for an overwrite of img with the current settings
+  uint64_t frameKey(DisplayImage &img, int xoffset, int yoffset) ;
+
+  // DisplayEffect apply function. pContext is the driver
+  static void applyEffect(void *pContext, DisplayEffect &effect, DisplayEffect::enEffect eEffect) ;
   bool setColumnAddress(uint16_t address);
 
+  // Write a page buffer to the OLED
+  bool sendPages(const uint8_t *pPages) ;
+
+  // Write columns col0 to col1 of one page
+  bool sendRun(const uint8_t *pPages, int page, int col0, int col1) ;
+
+  // Send a frame copied by present(). Called on the present thread
+  static bool sendPresented(void *pContext, uint8_t *pFrame) ;
+
+  // Send segment and COM remapping for the rotation and y origin
+  bool sendRemap() ;
+
   IHardwareGPIO *m_pGPIO ;
   IHardwareSPI *m_pSPI ;
   IHardwareTimer *m_pTime ;
   unsigned int m_dcpin, m_resetpin, m_width, m_height ;
 
+  FrameCache *m_pCache ;
+
+  // Register state
+  int m_nContrast ;
+  bool m_bInverse ;
+  bool m_bDisplayOn ;
+  DisplayEffect m_effect ;
+
+  // Power sequence
+  enSequence m_eSequence ;
+  int m_nStep ; // next step of m_eSequence
+  bool m_bSequence ; // running
+
+  // Display orientation. m_width and m_height are always the unrotated size
+  bool m_bYTop ;
+  unsigned int m_nRotation ;
+
+  Region m_clip ; // display coordinates
+
+  // Columns of each page changed since display(). Clean when col0 > col1
+  int m_dirtyCol0[SDD1306_MAX_PAGES] ;
+  int m_dirtyCol1[SDD1306_MAX_PAGES] ;
+  bool m_bRAMValid ; // OLED RAM matches the display buffer outside the dirty columns
+
   // Display buffer used in this class is different to the 
   // image buffers used to write images. This is arranged to match the page format
   // used in the SDD. Bytes represent columns of data within the pages
   // A future enhancement may replace this buffer with another DisplayImage object but this
   // would require support in DisplayImage or change to display() function.
   uint8_t *m_pDisplay ;
+
+  // Scaled row for writeScaled. Grown when a wider row is scaled
+  uint8_t *m_pScaled ;
+  uint32_t m_nScaledSize ;
+
+  FramePresenter m_presenter ;
 };
 
 #endif // __SDD1306_OLED_HW_HPP
@@ -0,0 +1,523 @@
+#include "slideshow.hpp"
+#include "jpegloader.hpp"
+#include "framecache.hpp"
+#include "framepacer.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+// Longest path built for images and cache files
+#define SLIDESHOW_MAX_PATH 1024
+
+static int comparePaths(const void *a, const void *b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b) ;
+}
+
+// True for names ending .jpg or .jpeg in any case
+static bool isJPEG(const char *szName)
+{
+  const char *szExt = strrchr(szName, '.') ;
+
+  if (!szExt) return false ;
+  return strcasecmp(szExt, ".jpg") == 0 || strcasecmp(szExt, ".jpeg") == 0 ;
+}
+
+Slideshow::Slideshow()
+{
+  m_pLCD = NULL ;
+  m_pszPaths = NULL ;
+  m_nImages = 0 ;
+  m_nShown = -1 ;
+  m_nWant = -1 ;
+  m_szCacheDir = NULL ;
+  m_nCacheMax = SLIDESHOW_DEFAULT_CACHE_SIZE ;
+  m_nPrefetch = SLIDESHOW_DEFAULT_PREFETCH ;
+  m_background[0] = m_background[1] = m_background[2] = 0 ;
+  m_width = m_height = 0 ;
+  m_nFrameSize = 0 ;
+  m_pRGB = NULL ;
+  m_nSlides = 0 ;
+  m_bRunning = false ;
+  m_bQuit = false ;
+  pthread_mutex_init(&m_lock, NULL) ;
+  pthread_cond_init(&m_cond, NULL) ;
+  resetStats() ;
+}
+
+Slideshow::~Slideshow()
+{
+  close() ;
+  if (m_szCacheDir) free(m_szCacheDir) ;
+  pthread_cond_destroy(&m_cond) ;
+  pthread_mutex_destroy(&m_lock) ;
+}
+
+bool Slideshow::setCacheDir(const char *szDir, uint32_t maxBytes)
+{
+  if (m_szCacheDir) free(m_szCacheDir) ;
+  m_szCacheDir = NULL ;
+  m_nCacheMax = maxBytes ;
+  if (!szDir) return true ;
+
+  if (mkdir(szDir, 0755) != 0 && errno != EEXIST){
+    fprintf(stderr, "setCacheDir: cannot create %s\n", szDir) ;
+    return false ;
+  }
+  m_szCacheDir = strdup(szDir) ;
+
+  return m_szCacheDir != NULL ;
+}
+
+void Slideshow::setPrefetch(unsigned int nImages)
+{
+  if (nImages < 1) nImages = 1 ;
+  if (nImages > SLIDESHOW_MAX_PREFETCH) nImages = SLIDESHOW_MAX_PREFETCH ;
+  m_nPrefetch = nImages ;
+}
+
+void Slideshow::setBackground(uint8_t red, uint8_t green, uint8_t blue)
+{
+  m_background[0] = red ;
+  m_background[1] = green ;
+  m_background[2] = blue ;
+}
+
+void Slideshow::resetStats()
+{
+  pthread_mutex_lock(&m_lock) ;
+  memset(&m_stats, 0, sizeof(m_stats)) ;
+  pthread_mutex_unlock(&m_lock) ;
+}
+
+void Slideshow::getStats(SlideshowStats &stats)
+{
+  pthread_mutex_lock(&m_lock) ;
+  stats = m_stats ;
+  pthread_mutex_unlock(&m_lock) ;
+}
+
+void Slideshow::freeImages()
+{
+  for (unsigned int i=0; i < m_nImages; i++) free(m_pszPaths[i]) ;
+  delete[] m_pszPaths ;
+  m_pszPaths = NULL ;
+  m_nImages = 0 ;
+}
+
+bool Slideshow::open(PCF8833LCD &lcd, const char *szDir)
+{
+  char szPath[SLIDESHOW_MAX_PATH] ;
+  struct dirent *pEntry = NULL ;
+  unsigned int nAlloc = 0 ;
+  DIR *pDir = NULL ;
+
+  close() ;
+
+  if ((pDir = opendir(szDir)) == NULL){
+    fprintf(stderr, "open: cannot read %s\n", szDir) ;
+    return false ;
+  }
+
+  // Count then list, as the directory doesn't give its size
+  while ((pEntry = readdir(pDir)) != NULL){
+    if (isJPEG(pEntry->d_name)) nAlloc++ ;
+  }
+  m_pszPaths = new char*[nAlloc + 1] ;
+  rewinddir(pDir) ;
+  while ((pEntry = readdir(pDir)) != NULL && m_nImages < nAlloc){
+    if (!isJPEG(pEntry->d_name)) continue ;
+    snprintf(szPath, sizeof(szPath), "%s/%s", szDir, pEntry->d_name) ;
+    m_pszPaths[m_nImages++] = strdup(szPath) ;
+  }
+  closedir(pDir) ;
+
+  if (m_nImages == 0){
+    fprintf(stderr, "open: no JPEG files in %s\n", szDir) ;
+    freeImages() ;
+    return false ;
+  }
+  qsort(m_pszPaths, m_nImages, sizeof(char *), comparePaths) ;
+
+  m_pLCD = &lcd ;
+  m_width = lcd.getWidth() ;
+  m_height = lcd.getHeight() ;
+  m_nFrameSize = lcd.convertFrame(NULL, PCF8833LCD::rawRGB24, NULL, 0) ;
+  if (m_nFrameSize == 0){
+    fprintf(stderr, "open: LCD not setup\n") ;
+    freeImages() ;
+    return false ;
+  }
+  m_pRGB = new uint8_t[m_width * m_height * 3] ;
+
+  // The cap may be smaller than when the files were written
+  if (m_szCacheDir) trimCache() ;
+
+  // One slot for each prefetched image and one for an image asked for out of order
+  m_nSlides = m_nPrefetch + 1 ;
+  for (unsigned int i=0; i < m_nSlides; i++){
+    m_slides[i].index = -1 ;
+    m_slides[i].state = slideEmpty ;
+    m_slides[i].bInUse = false ;
+    m_slides[i].pFrame = NULL ;
+    m_slides[i].pMap = NULL ;
+    m_slides[i].mapLen = 0 ;
+  }
+  m_nShown = -1 ;
+  m_nWant = -1 ;
+  m_bQuit = false ;
+
+  if (pthread_create(&m_worker, NULL, workerThread, this) != 0){
+    fprintf(stderr, "open: cannot start worker thread\n") ;
+    close() ;
+    return false ;
+  }
+  m_bRunning = true ;
+
+  return true ;
+}
+
+void Slideshow::close()
+{
+  if (m_bRunning){
+    pthread_mutex_lock(&m_lock) ;
+    m_bQuit = true ;
+    pthread_cond_broadcast(&m_cond) ;
+    pthread_mutex_unlock(&m_lock) ;
+    pthread_join(m_worker, NULL) ;
+    m_bRunning = false ;
+  }
+
+  for (unsigned int i=0; i < m_nSlides; i++) release(&m_slides[i]) ;
+  m_nSlides = 0 ;
+  delete[] m_pRGB ;
+  m_pRGB = NULL ;
+  freeImages() ;
+  m_pLCD = NULL ;
+}
+
+bool Slideshow::next()
+{
+  if (m_nImages == 0) return false ;
+  return show((m_nShown + 1) % m_nImages) ;
+}
+
+bool Slideshow::show(unsigned int n)
+{
+  Slide *pSlide = NULL ;
+  uint64_t start = FramePacer::timeMicros(), shown = 0 ;
+  bool bWaited = false, bOK = false ;
+
+  if (!m_bRunning || n >= m_nImages) return false ;
+
+  pthread_mutex_lock(&m_lock) ;
+  m_nWant = n ;
+  pthread_cond_broadcast(&m_cond) ;
+  for (;;){
+    pSlide = NULL ;
+    for (unsigned int i=0; i < m_nSlides; i++){
+      if (m_slides[i].index == (int)n &&
+	  (m_slides[i].state == slideReady || m_slides[i].state == slideFailed)){
+	pSlide = &m_slides[i] ;
+	break ;
+      }
+    }
+    if (pSlide) break ;
+    bWaited = true ;
+    pthread_cond_wait(&m_cond, &m_lock) ;
+  }
+  pSlide->bInUse = true ;
+  m_stats.waitMicros += FramePacer::timeMicros() - start ;
+  pthread_mutex_unlock(&m_lock) ;
+
+  // The frame is copied to the display buffer so the slot is only held while sending
+  start = FramePacer::timeMicros() ;
+  if (pSlide->state == slideReady){
+    bOK = m_pLCD->setFrame(pSlide->pFrame, m_nFrameSize) && m_pLCD->display() ;
+  }
+  shown = FramePacer::timeMicros() ;
+
+  pthread_mutex_lock(&m_lock) ;
+  pSlide->bInUse = false ;
+  m_nShown = n ;
+  m_nWant = -1 ;
+  if (bOK){
+    m_stats.shown++ ;
+    if (!bWaited) m_stats.ready++ ;
+  }else{
+    m_stats.failed++ ;
+  }
+  m_stats.showMicros += shown - start ;
+  pthread_cond_broadcast(&m_cond) ;
+  pthread_mutex_unlock(&m_lock) ;
+
+  return bOK ;
+}
+
+int Slideshow::wanted(int *pIndexes)
+{
+  int nCount = 0, index = 0 ;
+  bool bFound = false ;
+
+  if (m_nWant >= 0) pIndexes[nCount++] = m_nWant ;
+  for (unsigned int i=1; i <= m_nPrefetch; i++){
+    index = (m_nShown + (int)i) % (int)m_nImages ;
+    bFound = false ;
+    for (int j=0; j < nCount; j++) if (pIndexes[j] == index) bFound = true ;
+    if (!bFound) pIndexes[nCount++] = index ;
+  }
+
+  return nCount ;
+}
+
+void *Slideshow::workerThread(void *pArg)
+{
+  ((Slideshow *)pArg)->work() ;
+  return NULL ;
+}
+
+void Slideshow::work()
+{
+  int indexes[SLIDESHOW_MAX_PREFETCH + 1] ;
+  int nWanted = 0, index = -1 ;
+  Slide *pSlide = NULL ;
+  bool bOK = false, bKeep = false ;
+
+  pthread_mutex_lock(&m_lock) ;
+  while (!m_bQuit){
+    // First wanted image which isn't in a slot
+    nWanted = wanted(indexes) ;
+    index = -1 ;
+    for (int i=0; i < nWanted && index < 0; i++){
+      index = indexes[i] ;
+      for (unsigned int j=0; j < m_nSlides; j++){
+	if (m_slides[j].index == index) index = -1 ;
+      }
+    }
+
+    // Reuse a slot which isn't wanted or being shown
+    pSlide = NULL ;
+    for (unsigned int j=0; index >= 0 && j < m_nSlides && !pSlide; j++){
+      if (m_slides[j].bInUse) continue ;
+      bKeep = false ;
+      for (int i=0; i < nWanted; i++) if (m_slides[j].index == indexes[i]) bKeep = true ;
+      if (!bKeep) pSlide = &m_slides[j] ;
+    }
+
+    if (!pSlide){
+      pthread_cond_wait(&m_cond, &m_lock) ;
+      continue ;
+    }
+
+    release(pSlide) ;
+    pSlide->index = index ;
+    pSlide->state = slideLoading ;
+    pthread_mutex_unlock(&m_lock) ;
+
+    bOK = load(index, pSlide) ;
+
+    pthread_mutex_lock(&m_lock) ;
+    pSlide->state = bOK?slideReady:slideFailed ;
+    pthread_cond_broadcast(&m_cond) ;
+  }
+  pthread_mutex_unlock(&m_lock) ;
+}
+
+void Slideshow::release(Slide *pSlide)
+{
+  if (pSlide->pMap) munmap(pSlide->pMap, pSlide->mapLen) ;
+  else delete[] pSlide->pFrame ;
+  pSlide->pMap = NULL ;
+  pSlide->pFrame = NULL ;
+  pSlide->mapLen = 0 ;
+  pSlide->index = -1 ;
+  pSlide->state = slideEmpty ;
+}
+
+bool Slideshow::load(unsigned int n, Slide *pSlide)
+{
+  uint64_t key = 0, start = FramePacer::timeMicros(), t = 0 ;
+  uint8_t *pFrame = NULL ;
+  bool bSaved = false ;
+
+  if (!cacheKey(m_pszPaths[n], key)) return false ;
+
+  if (m_szCacheDir && mapFrame(key, pSlide)){
+    t = FramePacer::timeMicros() - start ;
+    pthread_mutex_lock(&m_lock) ;
+    m_stats.cacheHits++ ;
+    m_stats.mapMicros += t ;
+    pthread_mutex_unlock(&m_lock) ;
+    return true ;
+  }
+
+  if (!JPEGLoader::decode(m_pszPaths[n], m_width, m_height, m_pRGB, m_background)){
+    fprintf(stderr, "Slideshow: cannot decode %s\n", m_pszPaths[n]) ;
+    return false ;
+  }
+
+  pFrame = new uint8_t[m_nFrameSize] ;
+  if (m_pLCD->convertFrame(m_pRGB, PCF8833LCD::rawRGB24, pFrame, m_nFrameSize) != m_nFrameSize){
+    delete[] pFrame ;
+    return false ;
+  }
+  pSlide->pFrame = pFrame ;
+  t = FramePacer::timeMicros() - start ;
+
+  if (m_szCacheDir) bSaved = saveFrame(key, pFrame) ;
+
+  pthread_mutex_lock(&m_lock) ;
+  m_stats.decoded++ ;
+  m_stats.decodeMicros += t ;
+  if (bSaved) m_stats.cacheWrites++ ;
+  pthread_mutex_unlock(&m_lock) ;
+
+  if (bSaved) trimCache() ;
+
+  return true ;
+}
+
+bool Slideshow::cacheKey(const char *szPath, uint64_t &key)
+{
+  struct stat st ;
+  int64_t params[8] ;
+
+  if (stat(szPath, &st) != 0){
+    fprintf(stderr, "Slideshow: cannot read %s\n", szPath) ;
+    return false ;
+  }
+
+  // Everything which changes the frame
+  params[0] = st.st_mtime ;
+  params[1] = st.st_size ;
+  params[2] = m_width ;
+  params[3] = m_height ;
+  params[4] = m_nFrameSize ;
+  params[5] = m_pLCD->getColourMode() ;
+  params[6] = m_pLCD->getDither() ;
+  params[7] = (m_background[0] << 16) | (m_background[1] << 8) | m_background[2] ;
+
+  key = FrameCache::hash(szPath, strlen(szPath)) ;
+  key = FrameCache::hash(params, sizeof(params), key) ;
+
+  return true ;
+}
+
+void Slideshow::cachePath(uint64_t key, const char *szExt, char *szPath, unsigned int len)
+{
+  snprintf(szPath, len, "%s/%016llx%s", m_szCacheDir, (unsigned long long)key, szExt) ;
+}
+
+bool Slideshow::mapFrame(uint64_t key, Slide *pSlide)
+{
+  char szPath[SLIDESHOW_MAX_PATH] ;
+  const CacheHeader *pHeader = NULL ;
+  uint32_t len = sizeof(CacheHeader) + m_nFrameSize ;
+  struct stat st ;
+  void *pMap = NULL ;
+  int fd = -1 ;
+
+  cachePath(key, ".frm", szPath, sizeof(szPath)) ;
+  if ((fd = ::open(szPath, O_RDONLY)) < 0) return false ;
+
+  if (fstat(fd, &st) != 0 || st.st_size != (off_t)len){
+    ::close(fd) ;
+    return false ;
+  }
+  pMap = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0) ;
+  ::close(fd) ;
+  if (pMap == MAP_FAILED) return false ;
+
+  pHeader = (const CacheHeader *)pMap ;
+  if (pHeader->magic != SLIDESHOW_CACHE_MAGIC || pHeader->len != m_nFrameSize || pHeader->key != key){
+    munmap(pMap, len) ;
+    return false ;
+  }
+
+  pSlide->pMap = pMap ;
+  pSlide->mapLen = len ;
+  pSlide->pFrame = (uint8_t *)pMap + sizeof(CacheHeader) ;
+
+  // The modified time orders files for trimCache
+  utimes(szPath, NULL) ;
+
+  return true ;
+}
+
+bool Slideshow::saveFrame(uint64_t key, const uint8_t *pFrame)
+{
+  char szTemp[SLIDESHOW_MAX_PATH], szPath[SLIDESHOW_MAX_PATH] ;
+  CacheHeader header ;
+  bool bOK = false ;
+  int fd = -1 ;
+
+  if (sizeof(CacheHeader) + m_nFrameSize > m_nCacheMax) return false ;
+
+  header.magic = SLIDESHOW_CACHE_MAGIC ;
+  header.len = m_nFrameSize ;
+  header.key = key ;
+
+  // Written under a temporary name so a partly written file is never mapped
+  cachePath(key, ".tmp", szTemp, sizeof(szTemp)) ;
+  cachePath(key, ".frm", szPath, sizeof(szPath)) ;
+  if ((fd = ::open(szTemp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0){
+    fprintf(stderr, "Slideshow: cannot write %s\n", szTemp) ;
+    return false ;
+  }
+  bOK = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+    write(fd, pFrame, m_nFrameSize) == (ssize_t)m_nFrameSize ;
+  if (::close(fd) != 0) bOK = false ;
+
+  if (!bOK || rename(szTemp, szPath) != 0){
+    unlink(szTemp) ;
+    return false ;
+  }
+
+  return true ;
+}
+
+void Slideshow::trimCache()
+{
+  char szPath[SLIDESHOW_MAX_PATH], szOldest[SLIDESHOW_MAX_PATH] ;
+  struct dirent *pEntry = NULL ;
+  struct stat st ;
+  const char *szExt = NULL ;
+  uint64_t total = 0 ;
+  time_t oldest = 0 ;
+  DIR *pDir = NULL ;
+
+  // Cache directories hold a few hundred files at most so scan
+  // for the oldest file each time rather than keeping an index
+  for (;;){
+    if ((pDir = opendir(m_szCacheDir)) == NULL) return ;
+    total = 0 ;
+    szOldest[0] = '\0' ;
+    while ((pEntry = readdir(pDir)) != NULL){
+      szExt = strrchr(pEntry->d_name, '.') ;
+      if (!szExt || strcmp(szExt, ".frm") != 0) continue ;
+      snprintf(szPath, sizeof(szPath), "%s/%s", m_szCacheDir, pEntry->d_name) ;
+      if (stat(szPath, &st) != 0) continue ;
+      total += st.st_size ;
+      if (szOldest[0] == '\0' || st.st_mtime < oldest){
+	oldest = st.st_mtime ;
+	strcpy(szOldest, szPath) ;
+      }
+    }
+    closedir(pDir) ;
+
+    if (total <= m_nCacheMax || szOldest[0] == '\0') return ;
+    if (unlink(szOldest) != 0) return ;
+
+    pthread_mutex_lock(&m_lock) ;
+    m_stats.cacheEvictions++ ;
+    pthread_mutex_unlock(&m_lock) ;
+  }
+}
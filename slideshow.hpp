@@ -0,0 +1,155 @@
+#ifndef __SLIDESHOW_HPP
+#define __SLIDESHOW_HPP
+
+#include "pcf8833lcd.hpp"
+#include <pthread.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// Shows a directory of JPEG files on the PCF8833 LCD.
+// A worker thread decodes and converts the next images
+// while the current one is shown. Converted frames can
+// be kept in a cache directory and mapped straight
+// from the file when the image comes round again,
+// including after a restart
+//
+///////////////////////////////////////////////////
+
+// Images prepared ahead of the one shown
+#define SLIDESHOW_DEFAULT_PREFETCH 2
+#define SLIDESHOW_MAX_PREFETCH 8
+
+// Default cap on the cache directory size. Enough for around 200
+// full 12 bit 132x132 frames
+#define SLIDESHOW_DEFAULT_CACHE_SIZE 16777216
+
+// Start of every cache file
+#define SLIDESHOW_CACHE_MAGIC 0x53444C53
+
+class Slideshow{
+public:
+  Slideshow() ;
+  ~Slideshow() ;
+
+  // Counters since open or resetStats. Times are totals in microseconds
+  struct SlideshowStats{
+    uint32_t shown ;
+    uint32_t ready ; // shown without waiting for the worker
+    uint32_t decoded ; // images decoded and converted
+    uint32_t cacheHits ; // frames mapped from the cache directory
+    uint32_t cacheWrites ;
+    uint32_t cacheEvictions ;
+    uint32_t failed ;
+    uint64_t waitMicros ; // showing thread waiting for frames
+    uint64_t decodeMicros ; // worker decoding and converting
+    uint64_t mapMicros ; // worker mapping cached frames
+    uint64_t showMicros ; // sending frames to the LCD
+  };
+
+  // Keep converted frames in szDir, which is created if missing. Files
+  // are named by a hash of the path, modified time and display settings so
+  // changed images and settings get new frames. The least recently shown
+  // frames are deleted to stay within maxBytes. Call before open
+  bool setCacheDir(const char *szDir, uint32_t maxBytes = SLIDESHOW_DEFAULT_CACHE_SIZE) ;
+
+  // Number of images prepared ahead. Call before open
+  void setPrefetch(unsigned int nImages) ;
+
+  // Background for images which don't cover the display. Call before open
+  void setBackground(uint8_t red, uint8_t green, uint8_t blue) ;
+
+  // Find the .jpg and .jpeg files in szDir, in name order, and start
+  // preparing the first images. The LCD must be set up and initialised.
+  // Leave the size, rotation, colour mode and dither alone until close
+  bool open(PCF8833LCD &lcd, const char *szDir) ;
+
+  // Stop the worker and release the frames
+  void close() ;
+
+  unsigned int getImages(){return m_nImages;}
+  const char *getImagePath(unsigned int n){return n < m_nImages?m_pszPaths[n]:NULL;}
+
+  // Show the image after the current one, wrapping at the end
+  bool next() ;
+
+  // Show an image, waiting for the worker if it isn't ready. Images
+  // after it are then prepared. Returns false if it failed to load
+  bool show(unsigned int n) ;
+
+  void getStats(SlideshowStats &stats) ;
+  void resetStats() ;
+
+protected:
+  enum enState{slideEmpty, slideLoading, slideReady, slideFailed} ;
+
+  // A prepared frame. Frames are either mapped from the cache
+  // directory or held in memory
+  struct Slide{
+    int index ;
+    enState state ;
+    bool bInUse ; // being shown so the worker leaves it alone
+    uint8_t *pFrame ;
+    void *pMap ;
+    uint32_t mapLen ;
+  };
+
+  // Cache file layout, followed by the frame
+  struct CacheHeader{
+    uint32_t magic ;
+    uint32_t len ;
+    uint64_t key ;
+  };
+
+  static void *workerThread(void *pArg) ;
+  void work() ;
+
+  // Images the worker should have ready, most wanted first
+  int wanted(int *pIndexes) ;
+
+  // Fill a slot with image n. Called by the worker without the lock
+  bool load(unsigned int n, Slide *pSlide) ;
+
+  void release(Slide *pSlide) ;
+
+  // Cache key from the file and display settings. Returns false
+  // if the file cannot be read
+  bool cacheKey(const char *szPath, uint64_t &key) ;
+  void cachePath(uint64_t key, const char *szExt, char *szPath, unsigned int len) ;
+  bool mapFrame(uint64_t key, Slide *pSlide) ;
+  bool saveFrame(uint64_t key, const uint8_t *pFrame) ;
+
+  // Delete the oldest cache files until the directory fits the cap
+  void trimCache() ;
+
+  void freeImages() ;
+
+  PCF8833LCD *m_pLCD ;
+  char **m_pszPaths ;
+  unsigned int m_nImages ;
+  int m_nShown ; // -1 before the first image
+  int m_nWant ; // image the showing thread is waiting for or -1
+
+  char *m_szCacheDir ;
+  uint32_t m_nCacheMax ;
+  unsigned int m_nPrefetch ;
+  uint8_t m_background[3] ;
+
+  // Snapshot of the display when opened
+  unsigned int m_width, m_height ;
+  uint32_t m_nFrameSize ;
+  uint8_t *m_pRGB ; // worker decode buffer
+
+  Slide m_slides[SLIDESHOW_MAX_PREFETCH + 1] ;
+  unsigned int m_nSlides ;
+
+  pthread_t m_worker ;
+  pthread_mutex_t m_lock ;
+  pthread_cond_t m_cond ;
+  bool m_bRunning ;
+  bool m_bQuit ;
+
+  SlideshowStats m_stats ;
+};
+
+#endif // __SLIDESHOW_HPP
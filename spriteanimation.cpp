@@ -0,0 +1,127 @@
+#include "spriteanimation.hpp"
+#include <stdio.h>
+
+SpriteAnimation::SpriteAnimation()
+{
+  m_pLCD = NULL ;
+  m_pOLED = NULL ;
+  m_x = 0 ;
+  m_y = 0 ;
+  m_nFrames = 0 ;
+}
+
+SpriteAnimation::~SpriteAnimation()
+{
+  freeFrames() ;
+}
+
+void SpriteAnimation::freeFrames()
+{
+  for (unsigned int i=0; i < m_nFrames; i++){
+    delete[] m_pFrames[i] ;
+  }
+  m_nFrames = 0 ;
+}
+
+bool SpriteAnimation::open(PCF8833LCD &lcd, int x, int y)
+{
+  freeFrames() ;
+  m_pLCD = &lcd ;
+  m_pOLED = NULL ;
+  m_x = x ;
+  m_y = y ;
+
+  return true ;
+}
+
+bool SpriteAnimation::open(SDD1306OLED &oled, int x, int y)
+{
+  freeFrames() ;
+  m_pLCD = NULL ;
+  m_pOLED = &oled ;
+  m_x = x ;
+  m_y = y ;
+
+  return true ;
+}
+
+bool SpriteAnimation::addFrame(DisplayImage &img)
+{
+  uint32_t size = 0 ;
+  uint8_t *pFrame = NULL ;
+
+  if (!m_pLCD && !m_pOLED){
+    fprintf(stderr, "addFrame: animation not open\n") ;
+    return false ;
+  }
+
+  if (m_nFrames >= SPRITE_ANIMATION_MAX_FRAMES){
+    fprintf(stderr, "addFrame: too many frames\n") ;
+    return false ;
+  }
+
+  // Ask the driver for the size, then encode into a buffer of that size
+  if (m_pLCD) size = m_pLCD->encodeImage(img, m_x, m_y, NULL, 0) ;
+  else size = m_pOLED->encodeImage(img, m_x, m_y, NULL, 0) ;
+  if (size == 0) return false ;
+
+  pFrame = new uint8_t[size] ;
+  if (!pFrame){
+    fprintf(stderr, "addFrame: Memory error\n") ;
+    return false ;
+  }
+
+  if (m_pLCD) size = m_pLCD->encodeImage(img, m_x, m_y, pFrame, size) ;
+  else size = m_pOLED->encodeImage(img, m_x, m_y, pFrame, size) ;
+  if (size == 0){
+    delete[] pFrame ;
+    return false ;
+  }
+
+  m_pFrames[m_nFrames] = pFrame ;
+  m_nFrameSize[m_nFrames] = size ;
+  m_nFrames++ ;
+
+  return true ;
+}
+
+bool SpriteAnimation::showFrame(unsigned int frame)
+{
+  if (frame >= m_nFrames){
+    fprintf(stderr, "showFrame: no frame %u\n", frame) ;
+    return false ;
+  }
+
+  if (m_pLCD){
+    // The window no longer matches what display() compares against, so
+    // a display() during playback must send a full frame
+    m_pLCD->invalidate() ;
+    return m_pLCD->writeEncoded(m_pFrames[frame], m_nFrameSize[frame]) ;
+  }
+  return m_pOLED->writeEncoded(m_pFrames[frame], m_nFrameSize[frame]) ;
+}
+
+bool SpriteAnimation::play(FramePacer &pacer, unsigned int loops)
+{
+  pacer.reset() ;
+
+  for (unsigned int l=0; l < loops; l++){
+    for (unsigned int i=0; i < m_nFrames; i++){
+      if (!showFrame(i)) return false ;
+      pacer.wait() ;
+    }
+  }
+
+  return true ;
+}
+
+bool SpriteAnimation::close()
+{
+  freeFrames() ;
+
+  if (m_pLCD) m_pLCD->invalidate() ;
+  m_pLCD = NULL ;
+  m_pOLED = NULL ;
+
+  return true ;
+}
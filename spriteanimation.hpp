@@ -0,0 +1,62 @@
+#ifndef __SPRITE_ANIMATION_HPP
+#define __SPRITE_ANIMATION_HPP
+
+#include "pcf8833lcd.hpp"
+#include "sdd1306oled.hpp"
+#include "framepacer.hpp"
+#include "displayimage.hpp"
+
+///////////////////////////////////////////////////
+//
+// Animation of image frames at a fixed position, such
+// as spinners and progress bars. Each frame is encoded
+// once in the driver's own bus format so playing a
+// frame is a single buffer write
+//
+///////////////////////////////////////////////////
+
+// Most frames held by one animation
+#define SPRITE_ANIMATION_MAX_FRAMES 32
+
+class SpriteAnimation{
+public:
+  SpriteAnimation() ;
+  ~SpriteAnimation() ;
+
+  // Start a new animation at x, y on a set up and initialised display.
+  // Any frames from a previous animation are removed
+  bool open(PCF8833LCD &lcd, int x, int y) ;
+  bool open(SDD1306OLED &oled, int x, int y) ;
+
+  // Encode an image as the next frame. PCF8833 frames use the colours
+  // and colour mode at the time they are added. SDD1306 frames take
+  // pixels sharing their pages from the display buffer
+  bool addFrame(DisplayImage &img) ;
+
+  // Send one frame to the display. The PCF8833 LCD no longer matches its
+  // display buffer so the next display() writes a full frame
+  bool showFrame(unsigned int frame) ;
+
+  // Show every frame in order for a number of loops, waiting on the
+  // pacer between frames
+  bool play(FramePacer &pacer, unsigned int loops=1) ;
+
+  // Remove the frames. The PCF8833 LCD no longer matches its display
+  // buffer so the next display() writes a full frame
+  bool close() ;
+
+  unsigned int getFrames(){return m_nFrames;}
+
+protected:
+  void freeFrames() ;
+
+  PCF8833LCD *m_pLCD ;
+  SDD1306OLED *m_pOLED ;
+  int m_x, m_y ;
+
+  uint8_t *m_pFrames[SPRITE_ANIMATION_MAX_FRAMES] ;
+  uint32_t m_nFrameSize[SPRITE_ANIMATION_MAX_FRAMES] ;
+  unsigned int m_nFrames ;
+};
+
+#endif // __SPRITE_ANIMATION_HPP
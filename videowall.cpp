@@ -0,0 +1,178 @@
+#include "videowall.hpp"
+#include "framepacer.hpp"
+#include <stdio.h>
+#include <string.h>
+
+VideoWall::VideoWall()
+{
+  m_nPanels = 0 ;
+  m_width = 0 ;
+  m_height = 0 ;
+  m_pCanvas = NULL ;
+  m_xoffset = 0 ;
+  m_yoffset = 0 ;
+  m_nStarted = 0 ;
+  m_nFrames = 0 ;
+  m_nLastFrameMicros = 0 ;
+  m_nLastSkew = 0 ;
+  m_nMaxSkew = 0 ;
+  memset(m_buses, 0, sizeof(m_buses)) ;
+}
+
+VideoWall::~VideoWall()
+{
+  stop() ;
+}
+
+bool VideoWall::addPanel(IDisplay &panel, unsigned int bus, int x, int y, unsigned int rotation)
+{
+  int right = 0, bottom = 0 ;
+
+  if (m_workers.isRunning()){
+    fprintf(stderr, "addPanel: cannot add panels once started\n") ;
+    return false ;
+  }
+  if (m_nPanels >= VIDEOWALL_MAX_PANELS){
+    fprintf(stderr, "addPanel: limited to %d panels\n", VIDEOWALL_MAX_PANELS) ;
+    return false ;
+  }
+  if (x < 0 || y < 0){
+    fprintf(stderr, "addPanel: panel offset must be on the canvas\n") ;
+    return false ;
+  }
+  if (!panel.setRotation(rotation)) return false ;
+  if (!m_workers.add(bus)) return false ;
+
+  m_panels[m_nPanels].pPanel = &panel ;
+  m_panels[m_nPanels].x = x ;
+  m_panels[m_nPanels].y = y ;
+  m_buses[m_workers.getBusIndex(m_nPanels)].panels++ ;
+  m_nPanels++ ;
+
+  // The wall covers every panel
+  right = x + (int)panel.getWidth() ;
+  bottom = y + (int)panel.getHeight() ;
+  if (right > (int)m_width) m_width = right ;
+  if (bottom > (int)m_height) m_height = bottom ;
+
+  return true ;
+}
+
+bool VideoWall::start()
+{
+  if (m_workers.isRunning()) return true ;
+  if (m_nPanels == 0){
+    fprintf(stderr, "start: no panels added\n") ;
+    return false ;
+  }
+
+  m_nFrames = 0 ;
+  m_nLastFrameMicros = m_nLastSkew = m_nMaxSkew = 0 ;
+  for (unsigned int b=0; b < m_workers.getBuses(); b++){
+    m_buses[b].drawMicros = m_buses[b].sendMicros = 0 ;
+    m_buses[b].lastSendMicros = 0 ;
+  }
+  m_nStarted = FramePacer::timeMicros() ;
+
+  return m_workers.start(drawPanel, sendPanel, this, true) ;
+}
+
+void VideoWall::stop()
+{
+  m_workers.stop() ;
+}
+
+bool VideoWall::present(DisplayImage &canvas, int xoffset, int yoffset)
+{
+  uint64_t start = FramePacer::timeMicros() ;
+  bool bOK = true ;
+
+  if (!m_workers.isRunning()){
+    fprintf(stderr, "present: call start first\n") ;
+    return false ;
+  }
+
+  m_pCanvas = &canvas ;
+  m_xoffset = xoffset ;
+  m_yoffset = yoffset ;
+  bOK = m_workers.run() ;
+  m_pCanvas = NULL ;
+
+  m_nLastFrameMicros = (uint32_t)(FramePacer::timeMicros() - start) ;
+  m_nFrames++ ;
+  addTimes() ;
+
+  return bOK ;
+}
+
+void VideoWall::addTimes()
+{
+  uint64_t first = 0, last = 0 ;
+  uint64_t busFirst[VIDEOWALL_MAX_PANELS], busLast[VIDEOWALL_MAX_PANELS] ;
+  unsigned int b = 0 ;
+
+  memset(busFirst, 0, sizeof(busFirst)) ;
+  memset(busLast, 0, sizeof(busLast)) ;
+  for (unsigned int n=0; n < m_nPanels; n++){
+    const DisplayWorkers::Timing &timing = m_workers.getTiming(n) ;
+
+    b = m_workers.getBusIndex(n) ;
+    m_buses[b].drawMicros += timing.drawEnd - timing.drawStart ;
+    if (busFirst[b] == 0 || timing.sendStart < busFirst[b]) busFirst[b] = timing.sendStart ;
+    if (timing.sendEnd > busLast[b]) busLast[b] = timing.sendEnd ;
+    if (first == 0 || timing.sendStart < first) first = timing.sendStart ;
+    if (timing.sendEnd > last) last = timing.sendEnd ;
+  }
+
+  // A bus is busy from its first panel starting to send to its last
+  // panel finishing
+  for (b=0; b < m_workers.getBuses(); b++){
+    m_buses[b].lastSendMicros = (uint32_t)(busLast[b] - busFirst[b]) ;
+    m_buses[b].sendMicros += m_buses[b].lastSendMicros ;
+  }
+
+  m_nLastSkew = (uint32_t)(last - first) ;
+  if (m_nLastSkew > m_nMaxSkew) m_nMaxSkew = m_nLastSkew ;
+}
+
+void VideoWall::getStats(WallStats &stats)
+{
+  stats.frames = m_nFrames ;
+  stats.elapsedMicros = m_workers.isRunning()?FramePacer::timeMicros() - m_nStarted:0 ;
+  stats.lastFrameMicros = m_nLastFrameMicros ;
+  stats.lastSkewMicros = m_nLastSkew ;
+  stats.maxSkewMicros = m_nMaxSkew ;
+}
+
+bool VideoWall::getBusStats(unsigned int n, BusStats &stats)
+{
+  uint64_t elapsed = 0 ;
+
+  if (n >= m_workers.getBuses()) return false ;
+
+  elapsed = FramePacer::timeMicros() - m_nStarted ;
+  stats.bus = m_workers.getBus(n) ;
+  stats.panels = m_buses[n].panels ;
+  stats.drawMicros = m_buses[n].drawMicros ;
+  stats.sendMicros = m_buses[n].sendMicros ;
+  stats.lastSendMicros = m_buses[n].lastSendMicros ;
+  stats.utilization = elapsed > 0?(unsigned int)((stats.sendMicros * 100) / elapsed):0 ;
+
+  return true ;
+}
+
+bool VideoWall::drawPanel(void *pContext, unsigned int n)
+{
+  VideoWall *pWall = (VideoWall *)pContext ;
+  WallPanel &panel = pWall->m_panels[n] ;
+
+  return panel.pPanel->writeImage(*pWall->m_pCanvas, IDisplay::overwrite,
+				  pWall->m_xoffset - panel.x, pWall->m_yoffset - panel.y) ;
+}
+
+bool VideoWall::sendPanel(void *pContext, unsigned int n)
+{
+  VideoWall *pWall = (VideoWall *)pContext ;
+
+  return pWall->m_panels[n].pPanel->display() ;
+}
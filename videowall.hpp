@@ -0,0 +1,123 @@
+#ifndef __VIDEO_WALL_HPP
+#define __VIDEO_WALL_HPP
+
+#include "idisplay.hpp"
+#include "displayworkers.hpp"
+#include <stdint.h>
+
+///////////////////////////////////////////////////
+//
+// Tiles several panels into one large display. Each
+// panel shows the part of a virtual canvas at its
+// offset, so an image the size of the wall is split
+// across the panels.
+//
+// Each panel gets a DisplayWorkers thread with the
+// barrier set. A frame is written into every panel
+// buffer first and then all buses start sending
+// together, so the panels of a frame change within
+// the send time of the busiest bus rather than after
+// all the drawing as well
+//
+///////////////////////////////////////////////////
+
+#define VIDEOWALL_MAX_PANELS 16
+
+class VideoWall{
+public:
+  VideoWall() ;
+  ~VideoWall() ;
+
+  // Add a set up and initialised panel with its top left at x, y on the
+  // canvas. The panel is rotated before its size is read, so rotated
+  // panels cover the rotated area. Panels given the same bus number take
+  // turns to send, so give panels on the same SPI bus, such as spidev0.0
+  // and spidev0.1, the same number. Call before start
+  bool addPanel(IDisplay &panel, unsigned int bus, int x, int y, unsigned int rotation = 0) ;
+
+  // Start a worker for each panel
+  bool start() ;
+
+  // Stop the workers. Panels can then be used directly again
+  void stop() ;
+
+  // Draw the canvas across the panels and wait for them all to finish.
+  // The canvas is placed at xoffset, yoffset on the wall and the wall
+  // outside of it is set to the background. The canvas must not change
+  // until this returns. Returns false if any panel failed
+  bool present(DisplayImage &canvas, int xoffset = 0, int yoffset = 0) ;
+
+  unsigned int getPanels(){return m_nPanels;}
+  unsigned int getBuses(){return m_workers.getBuses();}
+
+  // Size of the area covered by the panels
+  unsigned int getWidth(){return m_width;}
+  unsigned int getHeight(){return m_height;}
+
+  // Counters since start. Times are in microseconds. Skew is from the
+  // first panel starting to send to the last panel finishing, which is
+  // how long the wall shows parts of two frames
+  struct WallStats{
+    uint32_t frames ;
+    uint64_t elapsedMicros ;
+    uint32_t lastFrameMicros ;
+    uint32_t lastSkewMicros ;
+    uint32_t maxSkewMicros ;
+  };
+
+  // Counters for one bus since start. Utilization is the percentage of
+  // the time since start spent sending
+  struct BusStats{
+    unsigned int bus ;
+    unsigned int panels ;
+    uint64_t drawMicros ;
+    uint64_t sendMicros ;
+    uint32_t lastSendMicros ;
+    unsigned int utilization ;
+  };
+
+  // Call between presents
+  void getStats(WallStats &stats) ;
+  bool getBusStats(unsigned int n, BusStats &stats) ;
+
+protected:
+  struct WallPanel{
+    IDisplay *pPanel ;
+    int x ;
+    int y ;
+  };
+
+  // Counters for a bus, indexed as DisplayWorkers numbers them
+  struct WallBus{
+    unsigned int panels ;
+    uint64_t drawMicros ;
+    uint64_t sendMicros ;
+    uint32_t lastSendMicros ;
+  };
+
+  // Worker callbacks with the wall as context
+  static bool drawPanel(void *pContext, unsigned int n) ;
+  static bool sendPanel(void *pContext, unsigned int n) ;
+
+  void addTimes() ;
+
+  WallPanel m_panels[VIDEOWALL_MAX_PANELS] ;
+  unsigned int m_nPanels ;
+  WallBus m_buses[VIDEOWALL_MAX_PANELS] ;
+  DisplayWorkers m_workers ;
+  unsigned int m_width ;
+  unsigned int m_height ;
+
+  // The frame being presented, read by the workers
+  DisplayImage *m_pCanvas ;
+  int m_xoffset ;
+  int m_yoffset ;
+
+  uint64_t m_nStarted ;
+  uint32_t m_nFrames ;
+  uint32_t m_nLastFrameMicros ;
+  uint32_t m_nLastSkew ;
+  uint32_t m_nMaxSkew ;
+};
+
+#endif // __VIDEO_WALL_HPP
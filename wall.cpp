@@ -0,0 +1,98 @@
+#include "hardware.hpp"
+#include "wpihardware.hpp"
+#include "spihardware.hpp"
+#include "pcf8833lcd.hpp"
+#include "videowall.hpp"
+#include "panelsequencer.hpp"
+#include "displayimage.hpp"
+#include <stdio.h>
+
+///////////////////////////////////////////////////
+//
+// Scrolls an image across a 2x2 wall of Nokia 6100
+// LCDs. The top row is on spidev0.0 and spidev0.1 and
+// the bottom row on spidev1.0 and spidev1.1, so the
+// rows send in parallel. Each LCD needs its own reset
+// line. spidev1 needs dtoverlay=spi1-2cs
+//
+///////////////////////////////////////////////////
+
+#define WALL_PANELS 4
+
+int main(int argc, char **argv)
+{
+  // BCM pins
+  const int reset_pins[WALL_PANELS] = {25, 24, 23, 22} ;
+  const char *szFile = argc > 1?argv[1]:"images/test2.jpg" ;
+  const int frames = 200 ;
+
+  wPi pi ; // init GPIO
+
+  spiHw spi[WALL_PANELS] ;
+  PCF8833LCD lcd[WALL_PANELS] ;
+  VideoWall wall ;
+  PanelSequencer sequencer ;
+
+  for (int i=0; i < WALL_PANELS; i++){
+    if (!spi[i].spiopen(i / 2, i % 2)){
+      fprintf(stderr, "Cannot Open SPI %d.%d\n", i / 2, i % 2) ;
+      return 0;
+    }
+    spi[i].setSpeed(6000000) ;
+
+    lcd[i].setGPIO(pi) ;
+    lcd[i].setSPI(spi[i]) ;
+    lcd[i].setTime(pi) ;
+    if (!lcd[i].setup(132,132, reset_pins[i])){
+      fprintf(stderr,"Failed to set up LCD %d\n", i) ;
+      return -1 ;
+    }
+    sequencer.add(lcd[i], IDisplay::sequenceInitialise) ;
+  }
+
+  // Initialise the LCDs together rather than one after the other
+  if (!sequencer.run(pi)){
+    fprintf(stderr,"Failed to initialise LCDs\n") ;
+    return -1 ;
+  }
+  printf("Initialised %d LCDs in %u ms\n", WALL_PANELS, sequencer.getRunMicros() / 1000) ;
+
+  // Bus number is the spidev bus
+  for (int i=0; i < WALL_PANELS; i++){
+    if (!wall.addPanel(lcd[i], i / 2, (i % 2) * 132, (i / 2) * 132)) return -1 ;
+  }
+
+  DisplayImage img ;
+  if (!img.loadJPG(szFile)){
+    fprintf(stderr, "Cannot load %s\n", szFile) ;
+    return -1 ;
+  }
+
+  if (!wall.start()) return -1 ;
+
+  // Bounce the image around the wall as fast as the buses allow
+  int x = 0, y = 0, dx = 3, dy = 2 ;
+  for (int i=0; i < frames; i++){
+    if (!wall.present(img, x, y)) fprintf(stderr, "Failed to present frame %d\n", i) ;
+    x += dx ;
+    y += dy ;
+    if (x < -100 || x > (int)wall.getWidth() - 100) dx = -dx ;
+    if (y < -100 || y > (int)wall.getHeight() - 100) dy = -dy ;
+  }
+
+  VideoWall::WallStats stats ;
+  VideoWall::BusStats bus ;
+  wall.getStats(stats) ;
+  printf("%u frames in %u ms, %.1f fps, max skew %u us\n", stats.frames,
+	 (unsigned int)(stats.elapsedMicros / 1000),
+	 stats.elapsedMicros > 0?(stats.frames * 1000000.0) / stats.elapsedMicros:0.0,
+	 stats.maxSkewMicros) ;
+  for (unsigned int n=0; wall.getBusStats(n, bus); n++){
+    printf("Bus %u: %u panels, %u%% busy, draw %u ms, send %u ms\n", bus.bus, bus.panels,
+	   bus.utilization, (unsigned int)(bus.drawMicros / 1000), (unsigned int)(bus.sendMicros / 1000)) ;
+  }
+
+  wall.stop() ;
+
+  return 0 ;
+}
@@ -0,0 +1,379 @@
+#include "widget.hpp"
+#include "displayimage.hpp"
+#include <stdio.h>
+#include <string.h>
+
+// Gap between the progress outline and the bar
+#define PROGRESS_BORDER 2
+
+Widget::Widget(int x, int y, unsigned int width, unsigned int height)
+{
+  m_x = x ;
+  m_y = y ;
+  m_width = width ;
+  m_height = height ;
+  m_bVisible = true ;
+  m_pParent = NULL ;
+  m_pChild = NULL ;
+  m_pNext = NULL ;
+  m_pScreen = NULL ;
+}
+
+Widget::~Widget()
+{
+}
+
+bool Widget::addChild(Widget &child)
+{
+  Widget *pLast = m_pChild ;
+
+  if (child.m_pParent || child.m_pScreen || &child == this){
+    fprintf(stderr, "addChild: widget is already in a tree\n") ;
+    return false ;
+  }
+
+  child.m_pParent = this ;
+  if (!pLast){
+    m_pChild = &child ;
+  }else{
+    while (pLast->m_pNext) pLast = pLast->m_pNext ;
+    pLast->m_pNext = &child ;
+  }
+
+  child.attach(m_pScreen) ;
+  child.damageTree() ;
+
+  return true ;
+}
+
+void Widget::attach(WidgetScreen *pScreen)
+{
+  m_pScreen = pScreen ;
+  for (Widget *p=m_pChild; p; p=p->m_pNext) p->attach(pScreen) ;
+}
+
+void Widget::setPosition(int x, int y)
+{
+  if (x == m_x && y == m_y) return ;
+
+  // Children move too
+  damageTree() ;
+  m_x = x ;
+  m_y = y ;
+  damageTree() ;
+}
+
+void Widget::setVisible(bool bVisible)
+{
+  if (bVisible == m_bVisible) return ;
+
+  // Damage while shown so the area is redrawn either way
+  if (!bVisible) damageTree() ;
+  m_bVisible = bVisible ;
+  if (bVisible) damageTree() ;
+}
+
+int Widget::getScreenX()
+{
+  return m_pParent?m_pParent->getScreenX() + m_x:m_x ;
+}
+
+int Widget::getScreenY()
+{
+  return m_pParent?m_pParent->getScreenY() + m_y:m_y ;
+}
+
+bool Widget::isShown()
+{
+  for (Widget *p=this; p; p=p->m_pParent){
+    if (!p->m_bVisible) return false ;
+  }
+
+  return m_pScreen != NULL ;
+}
+
+void Widget::damage()
+{
+  damage(0, 0, m_width, m_height) ;
+}
+
+void Widget::damageTree()
+{
+  // Children can be outside of their parent
+  damage() ;
+  for (Widget *p=m_pChild; p; p=p->m_pNext) p->damageTree() ;
+}
+
+void Widget::damage(int x, int y, unsigned int width, unsigned int height)
+{
+  Area area ;
+
+  if (!isShown() || width == 0 || height == 0) return ;
+
+  area.x0 = getScreenX() + x ;
+  area.y0 = getScreenY() + y ;
+  area.x1 = area.x0 + (int)width - 1 ;
+  area.y1 = area.y0 + (int)height - 1 ;
+  m_pScreen->damage(area) ;
+}
+
+bool Widget::inside(const Area &area, int x, int y, unsigned int width, unsigned int height)
+{
+  return area.x0 >= x && area.y0 >= y && area.x1 < x + (int)width && area.y1 < y + (int)height ;
+}
+
+RectWidget::RectWidget(int x, int y, unsigned int width, unsigned int height, bool bFill) :
+  Widget(x, y, width, height)
+{
+  m_bFill = bFill ;
+}
+
+bool RectWidget::draw(IDisplay &display, int x, int y, const Area &clip)
+{
+  if (!m_bFill && m_width > 2 && m_height > 2 && inside(clip, x + 1, y + 1, m_width - 2, m_height - 2)) return true ;
+
+  return display.drawRect(x, y, m_width, m_height, m_bFill) ;
+}
+
+ProgressWidget::ProgressWidget(int x, int y, unsigned int width, unsigned int height) :
+  Widget(x, y, width, height)
+{
+  m_nValue = 0 ;
+}
+
+unsigned int ProgressWidget::fillWidth(unsigned int percent)
+{
+  if (m_width <= 2 * PROGRESS_BORDER) return 0 ;
+
+  return ((m_width - (2 * PROGRESS_BORDER)) * percent) / 100 ;
+}
+
+void ProgressWidget::setValue(unsigned int percent)
+{
+  unsigned int from = 0, to = 0 ;
+
+  if (percent > 100) percent = 100 ;
+  if (percent == m_nValue) return ;
+
+  // Only the columns between the old and new ends change
+  from = fillWidth(m_nValue) ;
+  to = fillWidth(percent) ;
+  m_nValue = percent ;
+  if (from > to){
+    to = from ;
+    from = fillWidth(percent) ;
+  }
+  if (from < to && m_height > 2 * PROGRESS_BORDER){
+    damage(PROGRESS_BORDER + from, PROGRESS_BORDER, to - from, m_height - (2 * PROGRESS_BORDER)) ;
+  }
+}
+
+bool ProgressWidget::draw(IDisplay &display, int x, int y, const Area &clip)
+{
+  unsigned int fill = fillWidth(m_nValue) ;
+
+  // Value changes only damage the bar inside the outline
+  if (m_width <= 2 || m_height <= 2 || !inside(clip, x + 1, y + 1, m_width - 2, m_height - 2)){
+    if (!display.drawRect(x, y, m_width, m_height)) return false ;
+  }
+  if (fill == 0 || m_height <= 2 * PROGRESS_BORDER) return true ;
+
+  return display.drawRect(x + PROGRESS_BORDER, y + PROGRESS_BORDER, fill, m_height - (2 * PROGRESS_BORDER), true) ;
+}
+
+LabelWidget::LabelWidget(DisplayFont &font, int x, int y, unsigned int width, unsigned int height) :
+  Widget(x, y, width, height)
+{
+  m_pFont = &font ;
+  m_pText = NULL ;
+  m_szText[0] = 0 ;
+}
+
+LabelWidget::~LabelWidget()
+{
+  delete m_pText ;
+}
+
+bool LabelWidget::setText(const char *szText)
+{
+  if (!szText) szText = "" ;
+  if (strncmp(szText, m_szText, WIDGET_MAX_TEXT - 1) == 0) return true ;
+
+  strncpy(m_szText, szText, WIDGET_MAX_TEXT - 1) ;
+  m_szText[WIDGET_MAX_TEXT - 1] = 0 ;
+
+  // The text image is reused so changing text doesn't allocate
+  if (m_szText[0]){
+    if (m_pText) m_pFont->createText(m_szText, m_pText) ;
+    else m_pText = m_pFont->createText(m_szText) ;
+    if (!m_pText){
+      fprintf(stderr, "setText: cannot create text\n") ;
+      return false ;
+    }
+  }
+  damage() ;
+
+  return true ;
+}
+
+bool LabelWidget::draw(IDisplay &display, int x, int y, const Area &)
+{
+  if (!m_szText[0] || !m_pText) return true ;
+
+  return display.writeImage(*m_pText, IDisplay::overlay, x, y) ;
+}
+
+IconWidget::IconWidget(DisplayImage &img, int x, int y, unsigned int width, unsigned int height) :
+  Widget(x, y, width, height)
+{
+  m_pImg = &img ;
+}
+
+void IconWidget::setImage(DisplayImage &img)
+{
+  m_pImg = &img ;
+  damage() ;
+}
+
+bool IconWidget::draw(IDisplay &display, int x, int y, const Area &)
+{
+  return display.writeImage(*m_pImg, IDisplay::overlay, x, y) ;
+}
+
+WidgetScreen::WidgetScreen()
+{
+  m_pDisplay = NULL ;
+  m_pFirst = NULL ;
+  m_nDamage = 0 ;
+  m_nLastAreas = 0 ;
+  m_nLastPixels = 0 ;
+}
+
+void WidgetScreen::setDisplay(IDisplay &display)
+{
+  m_pDisplay = &display ;
+  damageAll() ;
+}
+
+bool WidgetScreen::add(Widget &widget)
+{
+  Widget *pLast = m_pFirst ;
+
+  if (widget.m_pParent || widget.m_pScreen){
+    fprintf(stderr, "add: widget is already in a tree\n") ;
+    return false ;
+  }
+
+  if (!pLast){
+    m_pFirst = &widget ;
+  }else{
+    while (pLast->m_pNext) pLast = pLast->m_pNext ;
+    pLast->m_pNext = &widget ;
+  }
+
+  widget.attach(this) ;
+  widget.damageTree() ;
+
+  return true ;
+}
+
+void WidgetScreen::damage(const Widget::Area &area)
+{
+  Widget::Area rc = area ;
+  int i = 0 ;
+
+  if (!m_pDisplay) return ;
+
+  if (rc.x0 < 0) rc.x0 = 0 ;
+  if (rc.y0 < 0) rc.y0 = 0 ;
+  if (rc.x1 >= (int)m_pDisplay->getWidth()) rc.x1 = m_pDisplay->getWidth() - 1 ;
+  if (rc.y1 >= (int)m_pDisplay->getHeight()) rc.y1 = m_pDisplay->getHeight() - 1 ;
+  if (rc.x0 > rc.x1 || rc.y0 > rc.y1) return ; // off the screen
+
+  // Merge with an area it touches, or with the last area when full
+  for (i=0; i < m_nDamage; i++){
+    if (rc.x0 <= m_damage[i].x1 + 1 && rc.x1 + 1 >= m_damage[i].x0 &&
+	rc.y0 <= m_damage[i].y1 + 1 && rc.y1 + 1 >= m_damage[i].y0) break ;
+  }
+  if (i == m_nDamage && m_nDamage < WIDGET_MAX_DAMAGE){
+    m_damage[m_nDamage++] = rc ;
+    return ;
+  }
+  if (i == m_nDamage) i = m_nDamage - 1 ;
+
+  if (rc.x0 < m_damage[i].x0) m_damage[i].x0 = rc.x0 ;
+  if (rc.y0 < m_damage[i].y0) m_damage[i].y0 = rc.y0 ;
+  if (rc.x1 > m_damage[i].x1) m_damage[i].x1 = rc.x1 ;
+  if (rc.y1 > m_damage[i].y1) m_damage[i].y1 = rc.y1 ;
+}
+
+void WidgetScreen::damageAll()
+{
+  if (!m_pDisplay) return ;
+
+  m_nDamage = 1 ;
+  m_damage[0].x0 = m_damage[0].y0 = 0 ;
+  m_damage[0].x1 = m_pDisplay->getWidth() - 1 ;
+  m_damage[0].y1 = m_pDisplay->getHeight() - 1 ;
+}
+
+bool WidgetScreen::drawTree(Widget *pWidget, int x, int y, const Widget::Area &area)
+{
+  Widget::Area clip ;
+  bool bRet = true ;
+
+  for (; pWidget; pWidget=pWidget->m_pNext){
+    if (!pWidget->m_bVisible) continue ;
+
+    // Clip to the part of the widget in the area
+    clip.x0 = x + pWidget->m_x ;
+    clip.y0 = y + pWidget->m_y ;
+    clip.x1 = clip.x0 + (int)pWidget->m_width - 1 ;
+    clip.y1 = clip.y0 + (int)pWidget->m_height - 1 ;
+    if (clip.x0 < area.x0) clip.x0 = area.x0 ;
+    if (clip.y0 < area.y0) clip.y0 = area.y0 ;
+    if (clip.x1 > area.x1) clip.x1 = area.x1 ;
+    if (clip.y1 > area.y1) clip.y1 = area.y1 ;
+
+    if (clip.x0 <= clip.x1 && clip.y0 <= clip.y1){
+      if (!m_pDisplay->setClip(clip.x0, clip.y0, clip.x1 - clip.x0 + 1, clip.y1 - clip.y0 + 1) ||
+	  !pWidget->draw(*m_pDisplay, x + pWidget->m_x, y + pWidget->m_y, clip)) bRet = false ;
+    }
+
+    // Children can be outside of their parent
+    if (!drawTree(pWidget->m_pChild, x + pWidget->m_x, y + pWidget->m_y, area)) bRet = false ;
+  }
+
+  return bRet ;
+}
+
+bool WidgetScreen::update()
+{
+  Widget::Area *pArea = NULL ;
+  bool bRet = true ;
+
+  if (!m_pDisplay){
+    fprintf(stderr, "update: no display set\n") ;
+    return false ;
+  }
+
+  m_nLastAreas = m_nDamage ;
+  m_nLastPixels = 0 ;
+  if (m_nDamage == 0) return true ;
+
+  for (int i=0; i < m_nDamage; i++){
+    pArea = &m_damage[i] ;
+    m_nLastPixels += (pArea->x1 - pArea->x0 + 1) * (pArea->y1 - pArea->y0 + 1) ;
+
+    if (!m_pDisplay->setClip(pArea->x0, pArea->y0, pArea->x1 - pArea->x0 + 1, pArea->y1 - pArea->y0 + 1) ||
+	!m_pDisplay->clearImage()) bRet = false ;
+    if (!drawTree(m_pFirst, 0, 0, *pArea)) bRet = false ;
+  }
+  m_pDisplay->clearClip() ;
+  m_nDamage = 0 ;
+
+  // The drivers only send what the clipped writes changed
+  if (!m_pDisplay->display()) bRet = false ;
+
+  return bRet ;
+}
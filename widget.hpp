@@ -0,0 +1,194 @@
+#ifndef __WIDGET_HPP
+#define __WIDGET_HPP
+
+#include "idisplay.hpp"
+#include <stdint.h>
+
+// displayimage.hpp is left to the drivers as for idisplay.hpp
+class DisplayFont ;
+
+///////////////////////////////////////////////////
+//
+// Retained widgets for status screens. Widgets are
+// kept in a tree and remember what they show, so a
+// change only marks the area it covers as damaged.
+// WidgetScreen::update redraws just the damaged
+// areas through the display clip region and sends
+// them with display(), which only sends what changed
+//
+///////////////////////////////////////////////////
+
+// Separate damaged areas kept between updates. More are merged
+#define WIDGET_MAX_DAMAGE 8
+
+// Longest label text
+#define WIDGET_MAX_TEXT 64
+
+class WidgetScreen ;
+
+class Widget{
+public:
+  Widget(int x, int y, unsigned int width, unsigned int height) ;
+  virtual ~Widget() ;
+
+  // Inclusive screen coordinates
+  struct Area{
+    int x0, y0, x1, y1 ;
+  };
+
+  // Add a child which is drawn after this widget. Child positions are
+  // relative to this widget and hiding this widget hides its children
+  bool addChild(Widget &child) ;
+
+  void setPosition(int x, int y) ;
+  void setVisible(bool bVisible) ;
+
+  int getX(){return m_x;}
+  int getY(){return m_y;}
+  unsigned int getWidth(){return m_width;}
+  unsigned int getHeight(){return m_height;}
+  bool isVisible(){return m_bVisible;}
+
+  // Position on the screen
+  int getScreenX() ;
+  int getScreenY() ;
+
+protected:
+  friend class WidgetScreen ;
+
+  // Draw at screen position x, y. The display clip is already set to
+  // clip, which is the damaged part of the widget, so pixels outside
+  // of it are left alone. Widgets may use clip to skip drawing parts
+  // which cannot reach it
+  virtual bool draw(IDisplay &display, int x, int y, const Area &clip) = 0 ;
+
+  // Area lies wholly within a box
+  static bool inside(const Area &area, int x, int y, unsigned int width, unsigned int height) ;
+
+  // Redraw the widget, or part of it in widget coordinates, on the
+  // next update
+  void damage() ;
+  void damage(int x, int y, unsigned int width, unsigned int height) ;
+
+  // Damage this widget and all of its children
+  void damageTree() ;
+
+  // Visible with every parent visible and on a screen
+  bool isShown() ;
+
+  // Set the screen for this widget and its children
+  void attach(WidgetScreen *pScreen) ;
+
+  int m_x, m_y ; // relative to the parent
+  unsigned int m_width, m_height ;
+  bool m_bVisible ;
+
+  Widget *m_pParent ;
+  Widget *m_pChild ; // first child
+  Widget *m_pNext ; // next sibling
+  WidgetScreen *m_pScreen ;
+};
+
+// Rectangle outline or filled rectangle
+class RectWidget : public Widget{
+public:
+  RectWidget(int x, int y, unsigned int width, unsigned int height, bool bFill = false) ;
+
+protected:
+  // Outlines are skipped when the clip is inside them
+  bool draw(IDisplay &display, int x, int y, const Area &clip) ;
+
+  bool m_bFill ;
+};
+
+// Outlined bar filled from the left by a percentage
+class ProgressWidget : public Widget{
+public:
+  ProgressWidget(int x, int y, unsigned int width, unsigned int height) ;
+
+  // 0 to 100. Only the columns which change are redrawn
+  void setValue(unsigned int percent) ;
+  unsigned int getValue(){return m_nValue;}
+
+protected:
+  // The outline is skipped when the clip is inside it
+  bool draw(IDisplay &display, int x, int y, const Area &clip) ;
+
+  // Filled width inside the outline for a value
+  unsigned int fillWidth(unsigned int percent) ;
+
+  unsigned int m_nValue ;
+};
+
+// Text in a fixed area. Text beyond the area is clipped
+class LabelWidget : public Widget{
+public:
+  LabelWidget(DisplayFont &font, int x, int y, unsigned int width, unsigned int height) ;
+  ~LabelWidget() ;
+
+  // Nothing is redrawn when the text is the same
+  bool setText(const char *szText) ;
+  const char *getText(){return m_szText;}
+
+protected:
+  // The display clip limits the text so the clip area isn't needed
+  bool draw(IDisplay &display, int x, int y, const Area &) ;
+
+  DisplayFont *m_pFont ;
+  DisplayImage *m_pText ; // reused for each text
+  char m_szText[WIDGET_MAX_TEXT] ;
+};
+
+// Image drawn over the area. The image belongs to the caller
+class IconWidget : public Widget{
+public:
+  IconWidget(DisplayImage &img, int x, int y, unsigned int width, unsigned int height) ;
+
+  // Call again after changing the image
+  void setImage(DisplayImage &img) ;
+
+protected:
+  // The display clip limits the image so the clip area isn't needed
+  bool draw(IDisplay &display, int x, int y, const Area &) ;
+
+  DisplayImage *m_pImg ;
+};
+
+class WidgetScreen{
+public:
+  WidgetScreen() ;
+
+  // Draw on a set up and initialised display. Everything is drawn on
+  // the next update
+  void setDisplay(IDisplay &display) ;
+
+  // Add a widget with no parent. Widgets are drawn in the order added
+  // and must stay in scope while the screen is used
+  bool add(Widget &widget) ;
+
+  // Redraw an area in screen coordinates on the next update
+  void damage(const Widget::Area &area) ;
+  void damageAll() ;
+
+  // Clear the damaged areas to the background, draw the widgets over
+  // them and send them to the display. Does nothing without damage
+  bool update() ;
+
+  // Areas and pixels redrawn by the last update
+  unsigned int getLastAreas(){return m_nLastAreas;}
+  uint32_t getLastPixels(){return m_nLastPixels;}
+
+protected:
+  // Draw a widget and its children over an area
+  bool drawTree(Widget *pWidget, int x, int y, const Widget::Area &area) ;
+
+  IDisplay *m_pDisplay ;
+  Widget *m_pFirst ;
+  Widget::Area m_damage[WIDGET_MAX_DAMAGE] ;
+  int m_nDamage ;
+
+  unsigned int m_nLastAreas ;
+  uint32_t m_nLastPixels ;
+};
+
+#endif // __WIDGET_HPP